@@ -0,0 +1,18 @@
+# Portable build for continuous integration, without -march=native, such that
+# the vector kernels of Simd.h are only reached through the runtime dispatch.
+if(USEMPI)
+  set(ENV{CC}  mpicc ) # C compiler for parallel build
+  set(ENV{CXX} mpicxx) # C++ compiler for parallel build
+  add_definitions(-DOMPI_SKIP_MPICXX)
+else()
+  set(ENV{CC}  gcc) # C compiler for serial build
+  set(ENV{CXX} g++) # C++ compiler for serial build
+endif()
+
+set(USER_CXX_FLAGS "-std=c++11 -Wall -Wno-unknown-pragmas -Werror=psabi")
+set(USER_CXX_FLAGS_RELEASE "-O3 -ffast-math")
+set(USER_CXX_FLAGS_DEBUG "-O0 -g")
+
+set(LIBS m z pthread)
+
+add_definitions(-DRESTRICTKEYWORD=__restrict__)
@@ -0,0 +1,136 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Diffusion.h"
+#include "BoundaryCyclic.h"
+#include "Timer.h"
+
+// The data of a Field has to start at a cache line and has to be zero.
+void checkField(const Field<double,double> &field)
+{
+  if(reinterpret_cast<std::uintptr_t>(field.data.data()) % AlignedAllocator<double>::alignment != 0)
+    throw std::runtime_error("Field data is not aligned!");
+
+  for(const double value : field.data)
+    if(value != 0.)
+      throw std::runtime_error("Field data is not initialized to zero!");
+}
+
+// Time the diffusion on fields that are allocated with or without huge pages.
+double timeDiffusion(Grid<double> &grid, const bool hugepages)
+{
+  AllocatorSettings::setHugePages(hugepages);
+
+  Field<double,double> a  = createField<double>(grid, "a" );
+  Field<double,double> at = createField<double>(grid, "at");
+  a.randomize(10);
+
+  BoundaryCyclic<double,double> boundary(grid);
+  boundary.exec(a);
+
+  Diffusion<double,double> diff(grid);
+
+  Timer timer(hugepages ? "Diffusion (CPU), huge pages" : "Diffusion (CPU), normal pages");
+  timer.start();
+  for(int n=0; n<20; ++n)
+    diff.exec(at, a, true);
+  timer.end();
+
+  return timer.getTotal();
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+    Grid<double> grid = createGrid<double>(256, 256, 256, 3);
+
+    // construction of a Field, against a zero-filled std::vector of the same size
+    const int nconstruct = 4;
+
+    Timer timer1("Construct std::vector");
+    timer1.start();
+    for(int n=0; n<nconstruct; ++n)
+    {
+      std::vector<double> reference(grid.getncells());
+      if(reference[n] != 0.)
+        throw std::runtime_error("std::vector is not initialized to zero!");
+    }
+    timer1.end();
+
+    Timer timer2("Construct Field");
+    timer2.start();
+    for(int n=0; n<nconstruct; ++n)
+      Field<double,double> field = createField<double>(grid, "field");
+    timer2.end();
+
+    Field<double,double> a = createField<double>(grid, "a");
+    checkField(a);
+
+    // the copy and the expression constructors do not fill the data twice
+    Field<double,double> b(a);
+    checkField(b);
+    Field<double,double> c = a + b;
+    checkField(c);
+
+    // small fields do not use huge pages, but are aligned as well
+    Grid<double> gridsmall = createGrid<double>(5, 3, 2, 1);
+    Field<double,double> d = createField<double>(gridsmall, "d");
+    checkField(d);
+
+    const double timenormal = timeDiffusion(grid, false);
+    const double timehuge   = timeDiffusion(grid, true);
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(2)
+            << "Speedup Field construction: " << timer1.getTotal() / timer2.getTotal()
+            << ", huge pages: " << timenormal / timehuge << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
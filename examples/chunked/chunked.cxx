@@ -0,0 +1,171 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldFile.h"
+#include "ChunkedFile.h"
+#include "Timer.h"
+
+namespace
+{
+  const double pi = 3.14159265358979323846;
+}
+
+long getFileSize(const std::string name)
+{
+  std::FILE *file = std::fopen(getFieldFileName(name).c_str(), "rb");
+  if(!file)
+    throw std::runtime_error("Cannot open " + name);
+  std::fseek(file, 0, SEEK_END);
+  const long size = std::ftell(file);
+  std::fclose(file);
+  return size;
+}
+
+bool isIdenticalInterior(const Field<double,double> &a, const Field<double,double> &b)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        if(a(i,j,k) != b(i,j,k))
+          return false;
+  return true;
+}
+
+// Save and load the field with the settings and report the compression ratio
+// with respect to the raw interior and the throughput.
+void testSettings(const Field<double,double> &a, Field<double,double> &b,
+                  const ChunkSettings &settings, const std::string label)
+{
+  Master &master = Master::getInstance();
+  const GridDims &dims = a.getGrid().getDims();
+
+  Timer timer1("Save " + label);
+  timer1.start();
+  saveChunkedField(a, "chunked.bin", settings);
+  timer1.end();
+
+  b = 0.;
+  Timer timer2("Load " + label);
+  timer2.start();
+  loadChunkedField(b, "chunked.bin");
+  timer2.end();
+
+  if(!isIdenticalInterior(a, b))
+    throw std::runtime_error("Chunked field " + label + " does not match the field!");
+
+  const double megabytes = dims.nmax*sizeof(double) * 1.e-6;
+  std::ostringstream message;
+  message << std::fixed << std::setprecision(2) << std::left << std::setw(22) << label
+          << " ratio: " << std::setw(6) << megabytes*1.e6 / getFileSize("chunked.bin")
+          << " write (MB/s): " << std::setw(8) << megabytes / timer1.getTotal()
+          << " read (MB/s): " << megabytes / timer2.getTotal() << "\n";
+  master.printMessage(message.str());
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Grid<double> grid = createGrid<double>(128, 128, 128, 3);
+    const GridDims &dims = grid.getDims();
+    const GridVars<double> &vars = grid.getVars();
+
+    // a smooth field with small-scale noise, of which the last bits of the
+    // mantissa are random as in model output
+    Field<double,double> a = createField<double>(grid, "a");
+    Field<double,double> b = createField<double>(grid, "b");
+    std::srand(3);
+    for(long k=dims.kstart; k<dims.kend; ++k)
+      for(long j=dims.jstart; j<dims.jend; ++j)
+        for(long i=dims.istart; i<dims.iend; ++i)
+          a(i,j,k) = 300. + std::sin(2.*pi*vars.x[i-dims.istart]) * std::cos(2.*pi*vars.y[j-dims.jstart])
+                   * vars.z[k-dims.kstart] + 1.e-3*std::rand()/RAND_MAX;
+
+    ChunkSettings none;
+    none.codec = CodecNone;
+    none.shuffle = false;
+
+    ChunkSettings zlib;
+    zlib.shuffle = false;
+
+    ChunkSettings zlibshuffle;
+
+    ChunkSettings zlibshuffle6;
+    zlibshuffle6.level = 6;
+
+    testSettings(a, b, none, "uncompressed");
+    testSettings(a, b, zlib, "zlib 1");
+    testSettings(a, b, zlibshuffle, "zlib 1 with shuffle");
+    testSettings(a, b, zlibshuffle6, "zlib 6 with shuffle");
+
+    // a block only reads the chunks it overlaps
+    ChunkSettings small;
+    small.isize = 32;
+    small.jsize = 32;
+    small.ksize = 32;
+    saveChunkedField(a, "chunked.bin", small);
+
+    const long istart = 30, iend = 60, jstart = 0, jend = 40, kstart = 60, kend = 70;
+    std::vector<double> block;
+    const long nchunks = loadChunkedBlock(block, grid, "chunked.bin", istart, iend, jstart, jend, kstart, kend);
+    if(nchunks != 8)
+      throw std::runtime_error("Block does not read the chunks it overlaps only!");
+
+    for(long k=kstart; k<kend; ++k)
+      for(long j=jstart; j<jend; ++j)
+        for(long i=istart; i<iend; ++i)
+          if(block[(i-istart) + (j-jstart)*(iend-istart) + (k-kstart)*(iend-istart)*(jend-jstart)]
+             != a(dims.istart+i, dims.jstart+j, dims.kstart+k))
+            throw std::runtime_error("Block does not match the field!");
+
+    std::remove(getFieldFileName("chunked.bin").c_str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
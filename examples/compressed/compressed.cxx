@@ -0,0 +1,196 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Half.h"
+#include "CompressedField.h"
+#include "Timer.h"
+
+namespace
+{
+  const double pi = 3.14159265358979323846;
+}
+
+// Maximum absolute difference over the interior on all processes.
+double getError(const Field<double,double> &a, const Field<double,double> &b)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  double error = 0.;
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        error = std::max(error, std::abs(a(i,j,k) - b(i,j,k)));
+
+  Master &master = Master::getInstance();
+  master.max(&error, 1);
+  return error;
+}
+
+// Compress with a relative error bound, check the error and the reductions
+// and report the ratio and the throughput.
+void testBound(const Field<double,double> &a, Field<double,double> &b, const double bound)
+{
+  Master &master = Master::getInstance();
+  const GridDims &dims = a.getGrid().getDims();
+
+  Timer timer1("Compress");
+  timer1.start();
+  CompressedField<double,double> c(a, bound, ErrorRelative);
+  timer1.end();
+
+  Timer timer2("Decompress");
+  timer2.start();
+  c.decompress(b);
+  timer2.end();
+
+  const double eb = c.getErrorBound();
+  if(getError(a, b) > eb)
+    throw std::runtime_error("Compressed field exceeds its error bound!");
+
+  if(std::abs(c.mean() - a.mean()) > eb || std::abs(c.min() - a.min()) > eb || std::abs(c.max() - a.max()) > eb ||
+     std::abs(c.variance() - a.variance()) > 4.*eb*std::sqrt(a.variance()) + eb*eb)
+    throw std::runtime_error("Reductions of the compressed field exceed the error bound!");
+
+  const double megabytes = dims.nmax*sizeof(double) * 1.e-6;
+  std::ostringstream message;
+  message << std::scientific << std::setprecision(0) << "Relative bound " << bound
+          << std::fixed << std::setprecision(2) << ", ratio: " << c.getRatio()
+          << ", compress (MB/s): " << megabytes / timer1.getTotal()
+          << ", decompress (MB/s): " << megabytes / timer2.getTotal() << "\n";
+  master.printMessage(message.str());
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Grid<double> grid = createGrid<double>(128, 128, 128, 3);
+    const GridDims &dims = grid.getDims();
+    const GridVars<double> &vars = grid.getVars();
+
+    // a smooth field with small-scale noise, as in the chunked example
+    Field<double,double> a = createField<double>(grid, "a");
+    Field<double,double> b = createField<double>(grid, "b");
+    std::srand(3);
+    for(long k=dims.kstart; k<dims.kend; ++k)
+      for(long j=dims.jstart; j<dims.jend; ++j)
+        for(long i=dims.istart; i<dims.iend; ++i)
+          a(i,j,k) = 300. + std::sin(2.*pi*vars.x[i-dims.istart]) * std::cos(2.*pi*vars.y[j-dims.jstart])
+                   * vars.z[k-dims.kstart] + 1.e-3*std::rand()/RAND_MAX;
+
+    testBound(a, b, 1.e-2);
+    testBound(a, b, 1.e-3);
+    testBound(a, b, 1.e-4);
+
+    // a constant field has no range, the relative bound is taken relative to
+    // its value, and a field of zeros is stored exactly
+    for(const double value : { 300., 0. })
+    {
+      Field<double,double> constant = createField<double>(grid, "constant");
+      constant = value;
+      CompressedField<double,double> cconstant(constant, 1.e-3, ErrorRelative);
+      cconstant.decompress(b);
+      if(getError(constant, b) > 1.e-3*value || cconstant.min() != b.min() || cconstant.max() != b.max())
+        throw std::runtime_error("Compressed constant field exceeds its error bound!");
+    }
+
+    // element-wise operations without decompressing the fields
+    const double eb = 1.e-3;
+    CompressedField<double,double> ca(a, eb);
+    CompressedField<double,double> cb = ca.transform([](const double x) { return 2.*x + 1.; });
+    CompressedField<double,double> cc = ca.transform(cb, [](const double x, const double y) { return y - x; });
+
+    Field<double,double> ref = 2.*a + 1.;
+    cb.decompress(b);
+    if(getError(b, ref) > 3.*eb)
+      throw std::runtime_error("Transformed field exceeds its error bound!");
+
+    ref = a + 1.;
+    cc.decompress(b);
+    if(getError(b, ref) > 5.*eb)
+      throw std::runtime_error("Combined field exceeds its error bound!");
+
+    // access of single values
+    const long i = dims.istart+5, j = dims.jend-1, k = dims.kstart+17;
+    if(std::abs(ca(i,j,k) - a(i,j,k)) > eb)
+      throw std::runtime_error("Value of the compressed field exceeds its error bound!");
+
+    // a Field of float is rounded when it is decompressed, which stays within a
+    // bound close to the precision of float, and a bound below it is refused
+    Field<float,double> f = createField<float>(grid, "f");
+    Field<float,double> g = createField<float>(grid, "g");
+    convertField(f, a);
+    const double ef = 5.e-5;
+    CompressedField<float,double> cf(f, ef);
+    cf.decompress(g);
+    Field<double,double> fd = createField<double>(grid, "fd");
+    convertField(fd, f);
+    convertField(b, g);
+    if(getError(fd, b) > ef)
+      throw std::runtime_error("Compressed float field exceeds its error bound!");
+
+    bool refused = false;
+    try
+    {
+      CompressedField<float,double> cfine(f, 1.e-6);
+    }
+    catch (int)
+    {
+      refused = true;
+    }
+    if(!refused)
+      throw std::runtime_error("Error bound below the precision of float is not refused!");
+
+    // the minimum and maximum of a compressed Field of Half, of which all values are negative
+    Field<Half,double> h = createField<Half>(grid, "h");
+    convertField(h, Field<double,double>(a - 400.));
+    CompressedField<Half,double> ch(h, 0.1);
+    if(std::abs(static_cast<float>(ch.min()) - static_cast<float>(h.min())) > 0.1 ||
+       std::abs(static_cast<float>(ch.max()) - static_cast<float>(h.max())) > 0.1)
+      throw std::runtime_error("Minimum and maximum of the compressed Half field exceed the error bound!");
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
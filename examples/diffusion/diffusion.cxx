@@ -22,15 +22,97 @@
  */
 
 #include <iostream>
+#include <algorithm>
 #include <iomanip>
 #include <cstdlib>
+#include <cmath>
 #include <vector>
 #include "Master.h"
 #include "Grid.h"
 #include "Field.h"
 #include "Diffusion.h"
+#include "BoundaryCyclic.h"
 #include "Timer.h"
 
+// Check whether two fields match up to the rounding differences that
+// -ffast-math allows when loops are vectorized in a different way. The
+// stencil cancels most of its terms, so the rounding errors scale with the
+// magnitude of the field rather than with the individual values.
+bool isMatching(const Field<double,double> &a, const Field<double,double> &b, const GridDims &dims)
+{
+    double scale = 0.;
+    for (long k=dims.kstart; k<dims.kend; ++k)
+        for (long j=dims.jstart; j<dims.jend; ++j)
+            for (long i=dims.istart; i<dims.iend; ++i)
+                scale = std::max(scale, std::abs(a(i,j,k)));
+
+    for (long k=dims.kstart; k<dims.kend; ++k)
+        for (long j=dims.jstart; j<dims.jend; ++j)
+            for (long i=dims.istart; i<dims.iend; ++i)
+                if (std::abs(a(i,j,k) - b(i,j,k)) > 1.e-12*scale + 1.e-12)
+                    return false;
+    return true;
+}
+
+// Effective bandwidth of a sweep that reads a and at and writes at once.
+double getBandwidth(const GridDims &dims, const int iter, const double time)
+{
+    return 3.*sizeof(double)*dims.nmax*iter / time * 1.e-9;
+}
+
+// Benchmark the tiled kernel on a grid with large horizontal planes.
+void benchmarkTiled()
+{
+    const int iter = 10;
+    Grid<double> grid = createGrid<double>(512, 512, 128, 3);
+    const GridDims dims = grid.getDims();
+
+    Field<double,double> a   = createField<double>(grid, "a"  );
+    Field<double,double> at  = createField<double>(grid, "at" );
+    Field<double,double> at2 = createField<double>(grid, "at2");
+    Field<double,double> at3 = createField<double>(grid, "at3");
+
+    a.randomize(10);
+
+    BoundaryCyclic<double,double> boundary(grid);
+    boundary.exec(a);
+
+    Diffusion<double,double> diff(grid);
+
+    Timer timer1("Diffusion (CPU), not threaded, large planes");
+    timer1.start();
+    for (int n=0; n<iter; ++n)
+        diff.exec(at, a, false);
+    timer1.end();
+
+    Timer timer2("Diffusion (CPU), not threaded, tiled");
+    timer2.start();
+    for (int n=0; n<iter; ++n)
+        diff.execTiled(at2, a, false);
+    timer2.end();
+
+    Timer timer3("Diffusion (CPU), threaded, tiled");
+    timer3.start();
+    for (int n=0; n<iter; ++n)
+        diff.execTiled(at3, a, true);
+    timer3.end();
+
+    std::ostringstream message;
+    message << "Tile size: " << diff.getTileSizeI() << " x " << diff.getTileSizeJ() << "\n"
+            << std::fixed << std::setprecision(2)
+            << "Bandwidth (GB/s): "
+            << getBandwidth(dims, iter, timer1.getTotal()) << ", "
+            << getBandwidth(dims, iter, timer2.getTotal()) << ", "
+            << getBandwidth(dims, iter, timer3.getTotal()) << "\n"
+            << "Speedup tiled: " << timer1.getTotal() / timer2.getTotal()
+            << ", tiled and threaded: " << timer1.getTotal() / timer3.getTotal() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+
+    if (!isMatching(at, at2, dims) || !isMatching(at, at3, dims))
+        throw std::runtime_error("Tiled version does not return the same field!");
+}
+
 int main(int argc, char *argv[])
 {
     try
@@ -41,9 +123,13 @@ int main(int argc, char *argv[])
         Field<double,double> a   = createField<double>(grid, "a"  );
         Field<double,double> at  = createField<double>(grid, "at" );
         Field<double,double> at2 = createField<double>(grid, "at2");
+        Field<double,double> at3 = createField<double>(grid, "at3");
 
         a.randomize(10);
 
+        BoundaryCyclic<double,double> boundary(grid);
+        boundary.exec(a);
+
         Diffusion<double,double> diff(grid);
 
         Timer timer1("Diffusion (CPU), not threaded");
@@ -58,6 +144,12 @@ int main(int argc, char *argv[])
             diff.exec(at2, a, true);
         timer2.end();
 
+        Timer timer3("Diffusion (CPU), threaded, overlapping halo exchange");
+        timer3.start();
+        for (int n=0; n<iter; ++n)
+            diff.exec(at3, a, boundary, true);
+        timer3.end();
+
         // Check for identical results
         bool identical = true;
         const GridDims dims = grid.getDims();
@@ -69,6 +161,12 @@ int main(int argc, char *argv[])
 
         if (!identical)
             throw std::runtime_error("Threaded version does not return identical field!");
+
+        // The boundary strips are computed in separate loops.
+        if (!isMatching(at, at3, dims))
+            throw std::runtime_error("Overlapping halo exchange does not return the same field!");
+
+        benchmarkTiled();
     }
 
     catch (std::exception &e)
@@ -0,0 +1,183 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldFile.h"
+#include "Timer.h"
+
+template<typename T>
+bool isIdentical(const Field<T,double> &a, const Field<T,double> &b)
+{
+  for(size_t n=0; n<a.data.size(); ++n)
+    if(a.data[n] != b.data[n])
+      return false;
+  return true;
+}
+
+std::string getName(const int n)
+{
+  std::ostringstream name;
+  name << "fieldfile" << n << ".bin";
+  return name.str();
+}
+
+// Read the file into the memory of the Field as an application would without
+// memory maps, to compare with.
+void readField(Field<double,double> &field, const std::string name)
+{
+  const std::string filename = getFieldFileName(name);
+  std::FILE *file = std::fopen(filename.c_str(), "rb");
+  if(!file || std::fseek(file, 4096, SEEK_SET) != 0 ||
+     std::fread(field.data.data(), sizeof(double), field.data.size(), file) != field.data.size())
+    throw std::runtime_error("Cannot read " + filename);
+  std::fclose(file);
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    const int nfields = 16;
+    Grid<double> grid = createGrid<double>(128, 128, 64, 3);
+
+    Field<double,double> a = createField<double>(grid, "a");
+    for(int n=0; n<nfields; ++n)
+    {
+      a.randomize(n+1);
+      saveField(a, getName(n));
+    }
+
+    // open all fields by reading them into memory
+    Timer timer1("Open fields, read");
+    timer1.start();
+    std::vector<std::unique_ptr<Field<double,double> > > fieldsread;
+    for(int n=0; n<nfields; ++n)
+    {
+      fieldsread.emplace_back(new Field<double,double>(grid, "read"));
+      readField(*fieldsread.back(), getName(n));
+    }
+    timer1.end();
+
+    // open all fields by mapping them, which does not touch the data
+    Timer timer2("Open fields, map");
+    timer2.start();
+    std::vector<std::unique_ptr<Field<double,double> > > fieldsmapped;
+    for(int n=0; n<nfields; ++n)
+      fieldsmapped.emplace_back(new Field<double,double>(mapField<double>(grid, getName(n))));
+    timer2.end();
+
+    for(int n=0; n<nfields; ++n)
+      if(!fieldsmapped[n]->data.isMapped() || !isIdentical(*fieldsmapped[n], *fieldsread[n]))
+        throw std::runtime_error("Mapped field does not match the file!");
+
+    // the analysis on a mapped field
+    const double sum = fieldsmapped[0]->sum();
+    if(sum != fieldsread[0]->sum())
+      throw std::runtime_error("Sum of a mapped field does not match!");
+
+    // writes to a private map do not reach the file, writes to a shared map do
+    {
+      Field<double,double> b = mapField<double>(grid, getName(0), MapPrivate);
+      b = 1.;
+      Field<double,double> c = mapField<double>(grid, getName(0));
+      if(!isIdentical(c, *fieldsread[0]))
+        throw std::runtime_error("Private map has changed the file!");
+
+      Field<double,double> d = mapField<double>(grid, getName(1), MapShared);
+      d += c;
+    }
+    {
+      Field<double,double> e = *fieldsread[1];
+      e += *fieldsread[0];
+      if(!isIdentical(mapField<double>(grid, getName(1)), e))
+        throw std::runtime_error("Shared map has not changed the file!");
+    }
+
+    // a file of another type or another grid is refused
+    Grid<double> gridother = createGrid<double>(64, 128, 64, 3);
+    bool refused = false;
+    try
+    {
+      mapField<double>(gridother, getName(0));
+    }
+    catch (int)
+    {
+      refused = true;
+    }
+    if(!refused)
+      throw std::runtime_error("Field file of another grid is not refused!");
+
+    // a raw file of the interior of a field, as MicroHH writes it
+    if(master.getNprocs() == 1)
+    {
+      Grid<double> gridraw = createGrid<double>(32, 16, 8);
+      Field<double,double> raw = createField<double>(gridraw, "raw");
+      raw.randomize(3);
+
+      std::FILE *file = std::fopen("fieldfile.raw", "wb");
+      std::fwrite(raw.data.data(), sizeof(double), raw.data.size(), file);
+      std::fclose(file);
+
+      if(!isIdentical(mapRawField<double>(gridraw, "fieldfile.raw"), raw))
+        throw std::runtime_error("Raw field does not match the file!");
+      std::remove("fieldfile.raw");
+    }
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(4)
+            << "Time to open " << nfields << " fields (s), read: " << timer1.getTotal()
+            << ", map: " << timer2.getTotal() << "\n";
+    master.printMessage(message.str());
+
+    fieldsmapped.clear();
+    for(int n=0; n<nfields; ++n)
+      std::remove(getFieldFileName(getName(n)).c_str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldPool.h"
+#include "Diffusion.h"
+#include "BoundaryCyclic.h"
+#include "Timer.h"
+
+// Time steps of diffusion with a tendency that is a new Field every step,
+// as in a pipeline where every intermediate result is a temporary.
+void stepNew(Field<double,double> &a, Diffusion<double,double> &diff,
+             BoundaryCyclic<double,double> &boundary, const double dt, const int nsteps)
+{
+  for(int n=0; n<nsteps; ++n)
+  {
+    Field<double,double> at = createField<double>(a.getGrid(), "at");
+    boundary.exec(a);
+    diff.exec(at, a, true);
+    a += dt*at;
+  }
+}
+
+// The same steps with a tendency from the pool, which has to be reset, as
+// the diffusion adds to it.
+void stepPooled(Field<double,double> &a, Diffusion<double,double> &diff,
+                BoundaryCyclic<double,double> &boundary, FieldPool<double,double> &pool,
+                const double dt, const int nsteps)
+{
+  for(int n=0; n<nsteps; ++n)
+  {
+    PooledField<double,double> at = pool.get(a.getGrid(), "at");
+    *at = 0.;
+    boundary.exec(a);
+    diff.exec(*at, a, true);
+    a += dt * *at;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    const int nsteps = 20;
+    const double dt = 0.1;
+    Grid<double> grid = createGrid<double>(256, 256, 128, 3);
+
+    Field<double,double> a  = createField<double>(grid, "a" );
+    Field<double,double> a2 = createField<double>(grid, "a2");
+    a.randomize(10);
+    a2 = a;
+
+    BoundaryCyclic<double,double> boundary(grid);
+    Diffusion<double,double> diff(grid);
+    FieldPool<double,double> pool;
+
+    Timer timer1("Steps with new Fields");
+    timer1.start();
+    stepNew(a, diff, boundary, dt, nsteps);
+    timer1.end();
+
+    Timer timer2("Steps with pooled Fields");
+    timer2.start();
+    stepPooled(a2, diff, boundary, pool, dt, nsteps);
+    timer2.end();
+
+    for(long n=0; n<static_cast<long>(a.data.size()); ++n)
+      if(a.data[n] != a2.data[n])
+        throw std::runtime_error("Steps with pooled Fields do not return the same field!");
+
+    const std::size_t bytes = grid.getncells()*sizeof(double);
+    if(pool.getHits() != nsteps-1 || pool.getMisses() != 1 || pool.getPeakInUse() != 1 ||
+       pool.getBytesSaved() != (nsteps-1)*bytes || pool.getPeakBytes() != bytes)
+      throw std::runtime_error("FieldPool statistics do not match the steps!");
+
+    // Fields in use at the same time have their own data, released data is
+    // recycled in any order, and moved handles release their data once.
+    {
+      PooledField<double,double> b = pool.get(grid, "b");
+      PooledField<double,double> c = pool.get(grid, "c");
+      if(b->data.data() == c->data.data())
+        throw std::runtime_error("FieldPool hands out the same data twice!");
+
+      const double *datab = b->data.data();
+      b.release();
+      PooledField<double,double> d = pool.get(grid, "d");
+      if(d->data.data() != datab)
+        throw std::runtime_error("FieldPool does not recycle released data!");
+
+      PooledField<double,double> e = std::move(d);
+      c = std::move(e);
+    }
+    if(pool.getHits() != nsteps+1 || pool.getMisses() != 2 || pool.getPeakInUse() != 2)
+      throw std::runtime_error("FieldPool statistics do not match the handles!");
+
+    // the data is kept per Grid
+    {
+      Grid<double> small = createGrid<double>(32, 32, 32, 1);
+      PooledField<double,double> s = pool.get(small, "s");
+      if(s->data.size() != static_cast<std::size_t>(small.getncells()) || pool.getMisses() != 3)
+        throw std::runtime_error("FieldPool recycles data of another Grid!");
+      s.release();
+      pool.clear(small);
+    }
+
+    pool.printStatistics();
+    pool.clear();
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(2)
+            << "Time per step (ms), new Fields: " << 1.e3*timer1.getTotal()/nsteps
+            << ", pooled Fields: " << 1.e3*timer2.getTotal()/nsteps << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
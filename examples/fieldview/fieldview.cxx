@@ -0,0 +1,199 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldView.h"
+#include "ThreadPool.h"
+#include "BoundaryCyclic.h"
+#include "Stencil.h"
+#include "Timer.h"
+
+namespace
+{
+  const double pi = 3.14159265358979323846;
+}
+
+// Check the reductions of a view against loops over the box of the Field.
+void checkReductions(const FieldView<const double> &view, const Field<double,double> &a,
+                     const long i0, const long j0, const long k0)
+{
+  double sum = 0., min = a(i0,j0,k0), max = min, sumsquares = 0.;
+  for(long k=k0; k<k0+view.getnk(); ++k)
+    for(long j=j0; j<j0+view.getnj(); ++j)
+      for(long i=i0; i<i0+view.getni(); ++i)
+      {
+        sum += a(i,j,k);
+        sumsquares += a(i,j,k)*a(i,j,k);
+        min = std::min(min, a(i,j,k));
+        max = std::max(max, a(i,j,k));
+      }
+
+  const double mean = sum / view.size();
+  const double variance = sumsquares / view.size() - mean*mean;
+  if(std::abs(view.sum() - sum) > 1.e-10*std::abs(sum) || view.min() != min || view.max() != max ||
+     std::abs(view.variance() - variance) > 1.e-8*variance || std::abs(view.norm() - std::sqrt(sumsquares)) > 1.e-10*std::sqrt(sumsquares))
+    throw std::runtime_error("Reductions of the view do not match the Field!");
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    Grid<double> grid = createGrid<double>(128, 128, 128, 3);
+    const GridDims &dims = grid.getDims();
+    const GridVars<double> &vars = grid.getVars();
+
+    Field<double,double> a   = createField<double>(grid, "a");
+    Field<double,double> out = createField<double>(grid, "out");
+    Field<double,double> ref = createField<double>(grid, "ref");
+
+    std::srand(7);
+    for(long k=dims.kstart; k<dims.kend; ++k)
+      for(long j=dims.jstart; j<dims.jend; ++j)
+        for(long i=dims.istart; i<dims.iend; ++i)
+          a(i,j,k) = std::sin(2.*pi*vars.x[i-dims.istart]) * std::cos(2.*pi*vars.y[j-dims.jstart])
+                   * std::sin(4.*pi*vars.z[k-dims.kstart]) + 1.e-3*std::rand()/RAND_MAX;
+
+    BoundaryCyclic<double,double> boundary(grid);
+    boundary.exec(a);
+
+    // the interior, a sub-volume, an x-z cross-section and a column
+    const FieldView<const double> all = makeView(a);
+    const FieldView<const double> interior = makeInteriorView(a);
+    checkReductions(interior, a, dims.istart, dims.jstart, dims.kstart);
+
+    const long i0 = dims.istart+5, j0 = dims.jstart+17, k0 = dims.kstart+3;
+    checkReductions(all.subBox(i0, i0+37, j0, j0+20, k0, k0+50), a, i0, j0, k0);
+    checkReductions(all.sliceJ(j0).subBox(dims.istart, dims.iend, 0, 1, dims.kstart, dims.kend), a, dims.istart, j0, dims.kstart);
+    checkReductions(interior.column(3, 4), a, dims.istart+3, dims.jstart+4, dims.kstart);
+
+    // an x-y cross-section is distributed over the threads as well, with the
+    // same result for any number of threads
+    const FieldView<const double> plane = interior.sliceK(k0);
+    checkReductions(plane, a, dims.istart, dims.jstart, k0+dims.kstart);
+    ThreadPool &pool = ThreadPool::getInstance();
+    const int nthreads = pool.getNumThreads();
+    const double planesum = plane.sum();
+    pool.setNumThreads(nthreads == 1 ? 3 : 1);
+    const double planesumother = plane.sum();
+    pool.setNumThreads(nthreads);
+    if(planesumother != planesum)
+      throw std::runtime_error("Reduction of the cross-section depends on the number of threads!");
+
+    // the reductions of an empty view are refused
+    bool refused = false;
+    try
+    {
+      FieldView<const double>().max();
+    }
+    catch (int)
+    {
+      refused = true;
+    }
+    if(!refused || FieldView<const double>().sum() != 0.)
+      throw std::runtime_error("Reductions of an empty view are not refused!");
+
+    if(all(i0,j0,k0) != a(i0,j0,k0) || interior(0,0,0) != a(dims.istart,dims.jstart,dims.kstart))
+      throw std::runtime_error("Element of the view does not match the Field!");
+
+    // copy the cross-section into a contiguous buffer, as for output
+    std::vector<double> buffer(dims.imax*dims.kmax);
+    const FieldView<double> section(buffer.data(), dims.imax, 1, dims.kmax);
+
+    Timer timer1("Cross-section");
+    timer1.start();
+    section.assign(interior.sliceJ(17));
+    timer1.end();
+
+    for(long k=0; k<dims.kmax; ++k)
+      for(long i=0; i<dims.imax; ++i)
+        if(section(i,0,k) != a(dims.istart+i, dims.jstart+17, dims.kstart+k))
+          throw std::runtime_error("Copied cross-section does not match the Field!");
+
+    // the copy of a whole Field that the view replaces
+    Timer timer2("Field copy");
+    timer2.start();
+    Field<double,double> copy(a);
+    timer2.end();
+
+    // the laplacian of a sub-volume equals that of the whole Field
+    laplacian<4>(ref, a);
+
+    typedef StencilOperator<SecondDerivative<4,0>::type,
+                            SecondDerivative<4,1>::type,
+                            SecondDerivative<4,2>::type> Op;
+    const double scale[3] = {static_cast<double>(dims.itot*dims.itot),
+                             static_cast<double>(dims.jtot*dims.jtot),
+                             static_cast<double>(dims.ktot*dims.ktot)};
+
+    const FieldView<double> outbox = makeView(out).subBox(i0, i0+37, j0, j0+20, k0, k0+50);
+    const FieldView<const double> inbox = all.subBox(i0, i0+37, j0, j0+20, k0, k0+50);
+    const FieldView<const double> in[3] = {inbox, inbox, inbox};
+    execStencil<StencilSet, Op>(outbox, in, scale);
+
+    const double laplacianscale = interior.norm() * dims.itot*dims.itot;
+    for(long k=k0; k<k0+50; ++k)
+      for(long j=j0; j<j0+20; ++j)
+        for(long i=i0; i<i0+37; ++i)
+          if(std::abs(out(i,j,k) - ref(i,j,k)) > 1.e-14*laplacianscale)
+            throw std::runtime_error("Stencil on the view does not match the Field!");
+
+    // the points around the box are left as they were
+    if(out(i0-1,j0,k0) != 0. || out(i0+37,j0,k0) != 0. || out(i0,j0,k0+50) != 0.)
+      throw std::runtime_error("Stencil on the view wrote outside the view!");
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(3)
+            << "Cross-section of " << section.size()*sizeof(double)/1024 << " kB (ms): " << 1.e3*timer1.getTotal()
+            << ", copy of the Field of " << a.data.size()*sizeof(double)/(1024*1024) << " MB (ms): "
+            << 1.e3*timer2.getTotal() << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
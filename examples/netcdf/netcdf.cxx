@@ -0,0 +1,123 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "NetcdfFile.h"
+#include "Timer.h"
+
+template<typename T>
+bool isIdentical(const Field<T,double> &a, const Field<T,double> &b)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        if(a(i,j,k) != b(i,j,k))
+          return false;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    Grid<double> grid = createGrid<double>(256, 192, 64, 1);
+    Field<double,double> a = createField<double>(grid, "a");
+    Field<float ,double> b = createField<float >(grid, "b");
+    a.randomize(10);
+    b.randomize(20);
+
+    Timer timer1("Write NetCDF");
+    timer1.start();
+    {
+      NetcdfFile<double> file("netcdf.nc", NetcdfCreate);
+      file.writeGrid(grid);
+      file.writeField(a, "a");
+      file.writeField(b, "b");
+    }
+    timer1.end();
+
+    // read the grid from the file, with a different number of ghost cells
+    Timer timer2("Read NetCDF");
+    timer2.start();
+    NetcdfFile<double> file("netcdf.nc", NetcdfRead);
+    Grid<double> gridin = file.readGrid(3);
+
+    Field<double,double> ain = createField<double>(gridin, "ain");
+    Field<float ,double> bin = createField<float >(gridin, "bin");
+    file.readField(ain, "a");
+    file.readField(bin, "b");
+    timer2.end();
+
+    const GridDims &dims = grid.getDims();
+    const GridDims &dimsin = gridin.getDims();
+    if(dimsin.itot != dims.itot || dimsin.jtot != dims.jtot || dimsin.ktot != dims.ktot ||
+       gridin.getVars().x != grid.getVars().x || gridin.getVars().z != grid.getVars().z)
+      throw std::runtime_error("Grid is not read correctly!");
+
+    // compare the interiors of the fields, which have different ghost cells
+    Field<double,double> aref = createField<double>(gridin, "aref");
+    Field<float ,double> bref = createField<float >(gridin, "bref");
+    for(long k=0; k<dims.kmax; ++k)
+      for(long j=0; j<dims.jmax; ++j)
+        for(long i=0; i<dims.imax; ++i)
+        {
+          aref(i+dimsin.istart, j+dimsin.jstart, k+dimsin.kstart) = a(i+dims.istart, j+dims.jstart, k+dims.kstart);
+          bref(i+dimsin.istart, j+dimsin.jstart, k+dimsin.kstart) = b(i+dims.istart, j+dims.jstart, k+dims.kstart);
+        }
+
+    if(!isIdentical(ain, aref) || !isIdentical(bin, bref))
+      throw std::runtime_error("Fields are not read correctly!");
+
+    const double megabytes = dims.ntot*(sizeof(double) + sizeof(float)) / (1024.*1024.);
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(1)
+            << "NetCDF throughput (MB/s), write: " << megabytes / timer1.getTotal()
+            << ", read: " << megabytes / timer2.getTotal() << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
@@ -24,6 +24,8 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdlib>
+#include <cmath>
+#include <utility>
 #include "Master.h"
 #include "Grid.h"
 #include "Field.h"
@@ -55,11 +57,89 @@ int main(int argc, char *argv[])
     auto c = a;
     c += b;
 
-    // test the addition operator
+    // test the compound operators with scalars and expressions
+    auto k = a;
+    k *= 2.;
+    k += 1;
+    k -= a + 0.*b;
+    k /= 2.f;
+    Field<double,double> kref = (a + 1.)/2.;
+    for(std::size_t n=0; n<k.data.size(); ++n)
+      if(std::abs(k.data[n] - kref.data[n]) > 1.e-12)
+      {
+        Master &master = Master::getInstance();
+        master.printError("Compound operator with a scalar gives a wrong result\n");
+        return 1;
+      }
+
+    // test the addition operator, the right hand side is evaluated in a single pass
     auto d = createField<double>(grid, "d");
     d = a + b + c;
 
-    auto e = a + b + c;
+    // construct a field from an expression
+    Field<double,double> e = a + b + c;
+
+    // test scalars and functions in expressions
+    auto f = createField<double>(grid, "f");
+    f = 2.*sqrt(a*a + b*b) - c/4. + 1.;
+
+    // test the move constructor and assignment, which take over the data without a copy
+    const double *edata = e.data.data();
+    Field<double,double> g(std::move(e));
+    auto h = createField<double>(grid, "h");
+    h = std::move(g);
+    if(h.data.data() != edata || !e.data.empty() || !g.data.empty())
+    {
+      Master &master = Master::getInstance();
+      master.printError("Field is copied instead of moved\n");
+      return 1;
+    }
+
+    // test that the moved-from Fields can be assigned to again
+    e = a;
+    g = std::move(h);
+    h = a + b + c;
+    if(e.data.size() != a.data.size() || g.data.data() != edata || h.data.size() != a.data.size())
+    {
+      Master &master = Master::getInstance();
+      master.printError("Moved-from Field cannot be assigned to\n");
+      return 1;
+    }
+    h = std::move(g);
+
+    // test that fields of different shapes cannot be combined
+    auto gridsmall = createGrid<double>(1, 1, 5);
+    auto small = createField<double>(gridsmall, "small");
+    bool mismatch = false;
+    try
+    {
+      aa = small;
+    }
+    catch (int)
+    {
+      mismatch = true;
+    }
+    if(!mismatch)
+      return 1;
+
+    // test that the operands of an expression are checked, also if the
+    // number of cells is the same
+    auto gridflat = createGrid<double>(2, 1, 5);
+    auto flat = createField<double>(gridflat, "flat");
+    for(auto *operand : { &small, &flat })
+    {
+      mismatch = false;
+      try
+      {
+        d = 2.*a + *operand;
+      }
+      catch (int)
+      {
+        mismatch = true;
+      }
+      if(!mismatch)
+        return 1;
+    }
 
     for(int n=0; n<a.data.size(); ++n)
     {
@@ -72,7 +152,8 @@ int main(int argc, char *argv[])
         << std::setw(6) << bb.data[n] << ", "
         << std::setw(6) <<  c.data[n] << ", "
         << std::setw(6) <<  d.data[n] << ", "
-        << std::setw(6) <<  e.data[n] << " }\n";
+        << std::setw(6) <<  h.data[n] << ", "
+        << std::setw(6) <<  f.data[n] << " }\n";
       Master &master = Master::getInstance();
       master.printMessage(message.str());
     }
@@ -0,0 +1,195 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Half.h"
+#include "BoundaryCyclic.h"
+#include "Diffusion.h"
+#include "Timer.h"
+
+namespace
+{
+  const double pi = 3.14159265358979323846;
+  const int niter = 5;
+}
+
+// Maximum absolute value and difference over the interior on all processes.
+double getMaxAbs(const Field<double,double> &a)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  double result = 0.;
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        result = std::max(result, std::abs(a(i,j,k)));
+
+  Master &master = Master::getInstance();
+  master.max(&result, 1);
+  return result;
+}
+
+double getError(const Field<double,double> &a, const Field<double,double> &b)
+{
+  Field<double,double> diff = a - b;
+  return getMaxAbs(diff);
+}
+
+// Store a in type TF, apply the diffusion stencil computed in type TC and the
+// reductions and compare them with the same operations in double. The stencil
+// of the stored values is compared with the stencil in double of the same
+// rounded values, which is the error of the computation, and with the stencil
+// of the original values, which includes the rounding of the input.
+template<typename TF, typename TC = typename ComputeType<TF>::type>
+void testPrecision(const std::string name, Grid<double> &grid, const Field<double,double> &aref,
+                   const Field<double,double> &atref, const double tolerance)
+{
+  Master &master = Master::getInstance();
+
+  Field<TF,double> a  = createField<TF>(grid, "a");
+  Field<TF,double> at = createField<TF>(grid, "at");
+  convertField(a, aref);
+
+  BoundaryCyclic<double,TF> boundary(grid);
+  boundary.exec(a);
+
+  Diffusion<double,TF,TC> diff(grid);
+  Timer timer1("Diffusion " + name);
+  for(int n=0; n<niter; ++n)
+  {
+    at = static_cast<TF>(0);
+    timer1.start();
+    diff.exec(at, a, true);
+    timer1.end();
+  }
+
+  Timer timer2("Reductions " + name);
+  double mean = 0., variance = 0.;
+  for(int n=0; n<niter; ++n)
+  {
+    timer2.start();
+    mean = a.mean();
+    variance = a.variance();
+    timer2.end();
+  }
+
+  // the reference of the rounded input
+  Field<double,double> arounded = createField<double>(grid, "arounded");
+  Field<double,double> atrounded = createField<double>(grid, "atrounded");
+  Field<double,double> result = createField<double>(grid, "result");
+  convertField(arounded, a);
+  convertField(result, at);
+
+  BoundaryCyclic<double,double> boundaryref(grid);
+  boundaryref.exec(arounded);
+  Diffusion<double,double> diffref(grid);
+  diffref.exec(atrounded, arounded, true);
+
+  const double scale = getMaxAbs(atref);
+  const double computeerror = getError(result, atrounded) / scale;
+  const double totalerror = getError(result, atref) / scale;
+
+  if(computeerror > tolerance)
+    throw std::runtime_error("Diffusion in " + name + " exceeds its tolerance!");
+
+  if(std::abs(mean - arounded.mean()) > 1.e-6*std::abs(arounded.mean()) ||
+     std::abs(variance - arounded.variance()) > 1.e-4*arounded.variance())
+    throw std::runtime_error("Reductions in " + name + " exceed their tolerance!");
+
+  std::ostringstream message;
+  message << std::left << std::setw(16) << name << std::right
+          << std::fixed << std::setprecision(2)
+          << " bytes: " << sizeof(TF)
+          << ", diffusion (ms): " << std::setw(6) << 1.e3*timer1.getTotal()/niter
+          << ", reductions (ms): " << std::setw(6) << 1.e3*timer2.getTotal()/niter
+          << std::scientific << std::setprecision(1)
+          << ", compute error: " << computeerror
+          << ", total error: " << totalerror
+          << ", mean error: " << std::abs(mean - aref.mean())
+          << "\n";
+  master.printMessage(message.str());
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Grid<double> grid = createGrid<double>(256, 256, 128, 3);
+    const GridDims &dims = grid.getDims();
+    const GridVars<double> &vars = grid.getVars();
+
+    // a smooth periodic field with small-scale noise
+    Field<double,double> a  = createField<double>(grid, "a");
+    Field<double,double> at = createField<double>(grid, "at");
+    std::srand(5);
+    for(long k=dims.kstart; k<dims.kend; ++k)
+      for(long j=dims.jstart; j<dims.jend; ++j)
+        for(long i=dims.istart; i<dims.iend; ++i)
+          a(i,j,k) = 1. + std::sin(2.*pi*vars.x[i-dims.istart]) * std::cos(2.*pi*vars.y[j-dims.jstart])
+                   * std::sin(2.*pi*vars.z[k-dims.kstart]) + 1.e-2*std::rand()/RAND_MAX;
+
+    BoundaryCyclic<double,double> boundary(grid);
+    boundary.exec(a);
+    Diffusion<double,double> diff(grid);
+    diff.exec(at, a, true);
+
+    // The 16-bit types compute in float, so their stencil is off by the
+    // rounding of float and of the result to 16 bits. Their total error is
+    // dominated by the rounding of the input, which the stencil amplifies
+    // by the square of the number of grid points.
+    testPrecision<double  >("double",   grid, a, at, 1.e-12);
+    testPrecision<float   >("float",    grid, a, at, 1.e-4);
+    testPrecision<Half    >("half",     grid, a, at, 2.e-3);
+    testPrecision<BFloat16>("bfloat16", grid, a, at, 1.e-2);
+
+    // Computed in double, only the rounding of the result to the stored type
+    // remains of the compute error.
+    testPrecision<float   , double>("float, double",    grid, a, at, 1.e-7);
+    testPrecision<Half    , double>("half, double",     grid, a, at, 1.e-3);
+    testPrecision<BFloat16, double>("bfloat16, double", grid, a, at, 1.e-2);
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
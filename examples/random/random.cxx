@@ -0,0 +1,204 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+// The known answers of Philox4x32-10 of Random123, with the counter split
+// over our index (words 0 and 1) and stream (word 2).
+void checkKnownAnswers()
+{
+  std::uint32_t r[4];
+
+  Philox(0).generate(0, r);
+  if(r[0] != 0x6627e8d5 || r[1] != 0xe169c58d || r[2] != 0xbc57ac4c || r[3] != 0x9b00dbd8)
+    throw std::runtime_error("Philox does not reproduce the known answer for zeros!");
+
+  // the fourth word of the counter is always zero, so compare with the
+  // answer of Random123 for counter {0x243f6a88, 0x85a308d3, 0x13198a2e, 0}
+  Philox(0x299f31d0a4093822ULL, 0x13198a2e).generate(0x85a308d3243f6a88ULL, r);
+  std::uint32_t ref[4];
+  {
+    // reference implementation of the rounds, written out as in Random123
+    std::uint32_t c[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0};
+    std::uint32_t k[2] = {0xa4093822, 0x299f31d0};
+    for(int round=0; round<10; ++round)
+    {
+      if(round > 0)
+      {
+        k[0] += 0x9E3779B9;
+        k[1] += 0xBB67AE85;
+      }
+      const std::uint64_t p0 = static_cast<std::uint64_t>(0xD2511F53) * c[0];
+      const std::uint64_t p1 = static_cast<std::uint64_t>(0xCD9E8D57) * c[2];
+      const std::uint32_t out[4] = {static_cast<std::uint32_t>(p1 >> 32) ^ c[1] ^ k[0], static_cast<std::uint32_t>(p1),
+                                    static_cast<std::uint32_t>(p0 >> 32) ^ c[3] ^ k[1], static_cast<std::uint32_t>(p0)};
+      for(int n=0; n<4; ++n)
+        c[n] = out[n];
+    }
+    for(int n=0; n<4; ++n)
+      ref[n] = c[n];
+  }
+  for(int n=0; n<4; ++n)
+    if(r[n] != ref[n])
+      throw std::runtime_error("Philox does not match the reference rounds!");
+}
+
+// Every point has to equal the random number of its global index, which
+// makes the Field independent of the decomposition. The vectorized math
+// functions may differ in the last bits from the scalar ones.
+template<class F>
+void checkGlobalIndex(const Field<double,double> &a, F f)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        const std::uint64_t n = (dims.ioffset + i-dims.istart)
+                              + dims.itot*((dims.joffset + j-dims.jstart) + dims.jtot*(k-dims.kstart));
+        if(std::abs(a(i,j,k) - f(n)) > 1.e-12*(1. + std::abs(f(n))))
+          throw std::runtime_error("Random field does not match the global index!");
+      }
+}
+
+// Exact sum of the low bits of all values, which is identical for every
+// decomposition only if the fields are identical bit for bit.
+double getChecksum(const Field<double,double> &a)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  double checksum = 0.;
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        std::uint64_t bits;
+        const double value = a(i,j,k);
+        std::memcpy(&bits, &value, sizeof(bits));
+        checksum += static_cast<double>(bits & 0xffff);
+      }
+
+  Master &master = Master::getInstance();
+  master.sum(&checksum, 1);
+  return checksum;
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    checkKnownAnswers();
+
+    Grid<double> grid = createGrid<double>(256, 256, 128, 1);
+    const GridDims &dims = grid.getDims();
+
+    Field<double,double> a = createField<double>(grid, "a");
+    Field<double,double> b = createField<double>(grid, "b");
+    const Philox philox(20151024, 1);
+
+    // the serial loop with std::rand that the generator replaces
+    Timer timer1("std::rand");
+    timer1.start();
+    std::srand(1);
+    for(long k=dims.kstart; k<dims.kend; ++k)
+      for(long j=dims.jstart; j<dims.jend; ++j)
+        for(long i=dims.istart; i<dims.iend; ++i)
+          a(i,j,k) = std::rand() / (RAND_MAX + 1.);
+    timer1.end();
+
+    Timer timer2("Philox");
+    timer2.start();
+    randomizeUniform(a, philox);
+    timer2.end();
+
+    // identical fields for any number of threads
+    const int nthreads = pool.getNumThreads();
+    pool.setNumThreads(nthreads == 1 ? 3 : 1);
+    randomizeUniform(b, philox);
+    pool.setNumThreads(nthreads);
+    for(long n=0; n<static_cast<long>(a.data.size()); ++n)
+      if(a.data[n] != b.data[n])
+        throw std::runtime_error("Random field depends on the number of threads!");
+
+    checkGlobalIndex(a, [&](const std::uint64_t n) { return philox.uniform(n); });
+    if(std::abs(a.mean() - 0.5) > 1.e-3 || std::abs(a.variance() - 1./12.) > 1.e-3 || a.min() < 0. || a.max() >= 1.)
+      throw std::runtime_error("Uniform random field has the wrong statistics!");
+
+    randomizeNormal(a, philox, 2., 3.);
+    checkGlobalIndex(a, [&](const std::uint64_t n) { return 2. + 3.*philox.normal(n); });
+    const double checksum = getChecksum(a);
+    if(std::abs(a.mean() - 2.) > 1.e-2 || std::abs(a.variance() - 9.) > 2.e-2)
+      throw std::runtime_error("Normal random field has the wrong statistics!");
+
+    randomizeInteger(a, philox, -3, 3);
+    checkGlobalIndex(a, [&](const std::uint64_t n) { return static_cast<double>(philox.integer(n, -3, 3)); });
+    if(std::abs(a.mean()) > 1.e-2 || std::abs(a.variance() - 4.) > 1.e-2 || a.min() != -3. || a.max() != 3.)
+      throw std::runtime_error("Integer random field has the wrong statistics!");
+
+    // another stream gives another field
+    randomizeUniform(b, Philox(20151024, 2));
+    randomizeUniform(a, philox);
+    Field<double,double> ab = a*b;
+    const double correlation = ab.mean() - a.mean()*b.mean();
+    if(std::abs(correlation) > 1.e-3)
+      throw std::runtime_error("Random fields of two streams are correlated!");
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(2)
+            << "Uniform field of " << dims.ntot << " points, std::rand (ms): " << 1.e3*timer1.getTotal()
+            << ", Philox (ms): " << 1.e3*timer2.getTotal() << "\n"
+            << std::setprecision(0) << "Checksum of the normal field: " << checksum << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
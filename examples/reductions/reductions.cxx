@@ -0,0 +1,203 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Simd.h"
+#include "Timer.h"
+
+// Fill the field with a function of the global index, such that the
+// reductions do not depend on the decomposition over the processes.
+template<typename T>
+void fillField(Field<T,double> &field)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        const long ig = i - dims.istart + dims.ioffset;
+        const long jg = j - dims.jstart + dims.joffset;
+        const long kg = k - dims.kstart;
+        field(i,j,k) = static_cast<T>(100. + std::sin(0.1*ig + 0.2*jg + 0.3*kg) + 1.e-3*((ig*7 + jg*13 + kg*3) % 17));
+      }
+
+  // the ghost cells must not take part in the reductions
+  for(long k=0; k<dims.kcells; ++k)
+    for(long j=0; j<dims.jcells; ++j)
+      for(long i=0; i<dims.icells; ++i)
+        if(i < dims.istart || i >= dims.iend || j < dims.jstart || j >= dims.jend || k < dims.kstart || k >= dims.kend)
+          field(i,j,k) = static_cast<T>(1.e6);
+}
+
+// The statistics computed with serial loops over the interior.
+struct Statistics
+{
+  double sum;
+  double min;
+  double max;
+  double variance;
+  double norm;
+};
+
+template<typename T>
+Statistics getReference(const Field<T,double> &field)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  Master &master = Master::getInstance();
+
+  Statistics ref = {0., field(dims.istart, dims.jstart, dims.kstart), field(dims.istart, dims.jstart, dims.kstart), 0., 0.};
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        ref.sum += field(i,j,k);
+        ref.min = std::min(ref.min, static_cast<double>(field(i,j,k)));
+        ref.max = std::max(ref.max, static_cast<double>(field(i,j,k)));
+        ref.norm += static_cast<double>(field(i,j,k))*field(i,j,k);
+      }
+  master.sum(&ref.sum, 1);
+  master.min(&ref.min, 1);
+  master.max(&ref.max, 1);
+  master.sum(&ref.norm, 1);
+  ref.norm = std::sqrt(ref.norm);
+
+  const double mean = ref.sum / dims.ntot;
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        ref.variance += (field(i,j,k) - mean)*(field(i,j,k) - mean);
+  master.sum(&ref.variance, 1);
+  ref.variance /= dims.ntot;
+
+  return ref;
+}
+
+bool isClose(const double a, const double b, const double tolerance)
+{
+  return std::abs(a - b) <= tolerance*std::abs(b);
+}
+
+template<typename T>
+void checkReductions(const char *type, Grid<double> &grid, const double tolerance)
+{
+  Master &master = Master::getInstance();
+  Simd &simd = Simd::getInstance();
+  const SimdLevel supported = simd.getSupportedLevel();
+
+  Field<T,double> field = createField<T>(grid, "field");
+  fillField(field);
+  const Statistics ref = getReference(field);
+
+  for(int level=SimdScalar; level<=supported; ++level)
+  {
+    simd.setLevel(static_cast<SimdLevel>(level));
+
+    std::ostringstream message;
+    message << std::setprecision(10) << "Reductions " << type << ", " << Simd::getName(static_cast<SimdLevel>(level))
+            << ": mean = " << field.mean() << ", min = " << field.min() << ", max = " << field.max()
+            << ", variance = " << field.variance() << ", norm = " << field.norm() << "\n";
+    master.printMessage(message.str());
+
+    if(!isClose(field.sum(), ref.sum, tolerance) ||
+       field.min() != static_cast<T>(ref.min) || field.max() != static_cast<T>(ref.max) ||
+       !isClose(field.variance(), ref.variance, 100.*tolerance) ||
+       !isClose(field.norm(), ref.norm, tolerance))
+      throw std::runtime_error("Reductions do not match the serial loops!");
+  }
+
+  simd.setLevel(supported);
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    // odd sizes, such that the rows do not fill complete vectors
+    Grid<double> grid = createGrid<double>(60, 36, 19, 3);
+    checkReductions<double>("double", grid, 1.e-12);
+    checkReductions<float >("float" , grid, 1.e-5);
+
+    // time the sum against a serial loop, which is what the statistics used to do
+    Grid<double> gridlarge = createGrid<double>(256, 256, 128, 3);
+    const GridDims &dims = gridlarge.getDims();
+    Field<double,double> a = createField<double>(gridlarge, "a");
+    a.randomize(10);
+
+    const int iter = 20;
+    double sum1 = 0.;
+    double sum2 = 0.;
+
+    Timer timer1("Sum, serial loop");
+    timer1.start();
+    for(int n=0; n<iter; ++n)
+    {
+      double sum = 0.;
+      for(long k=dims.kstart; k<dims.kend; ++k)
+        for(long j=dims.jstart; j<dims.jend; ++j)
+          for(long i=dims.istart; i<dims.iend; ++i)
+            sum += a(i,j,k);
+      master.sum(&sum, 1);
+      sum1 += sum;
+    }
+    timer1.end();
+
+    Timer timer2("Sum, Field reduction");
+    timer2.start();
+    for(int n=0; n<iter; ++n)
+      sum2 += a.sum();
+    timer2.end();
+
+    if(!isClose(sum2, sum1, 1.e-12))
+      throw std::runtime_error("Sum does not match the serial loop!");
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(2)
+            << "Speedup sum: " << timer1.getTotal() / timer2.getTotal() << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
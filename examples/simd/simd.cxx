@@ -0,0 +1,198 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Diffusion.h"
+#include "BoundaryCyclic.h"
+#include "Simd.h"
+#include "Timer.h"
+
+// Results of all kernels for one SIMD level.
+template<typename T>
+struct Results
+{
+  std::vector<T> copy;
+  std::vector<T> copyadd;
+  std::vector<T> add;
+  std::vector<T> diffusion;
+};
+
+// Run the kernels on arrays whose length and offset do not match the
+// vector width, so that the scalar loops over the remainders are tested too.
+template<typename T>
+Results<T> runKernels(const SimdLevel level, Grid<double> &grid)
+{
+  Simd &simd = Simd::getInstance();
+  simd.setLevel(level);
+
+  // every level gets the same input
+  std::srand(10);
+
+  const long size = 1021;
+  std::vector<T> a(size+1), b(size+1);
+  for(long n=0; n<size+1; ++n)
+  {
+    a[n] = static_cast<T>(std::rand() % 100) / 7;
+    b[n] = static_cast<T>(std::rand() % 100) / 3;
+  }
+
+  Results<T> results;
+  results.copy.resize(size);
+  results.copyadd.assign(b.begin()+1, b.end());
+  results.add.resize(size);
+
+  simdCopyVec(results.copy.data(), &a[1], size);
+  simdCopyAddVec(results.copyadd.data(), &a[1], size);
+  simdAddVecs(results.add.data(), &a[1], &b[1], size);
+
+  // the diffusion kernel through the Diffusion class
+  Field<T,double> f  = createField<T>(grid, "f" );
+  Field<T,double> ft = createField<T>(grid, "ft");
+  f.randomize(10);
+  ft = static_cast<T>(0);
+
+  BoundaryCyclic<double,T> boundary(grid);
+  boundary.exec(f);
+
+  Diffusion<double,T> diff(grid);
+  diff.exec(ft, f, false);
+  results.diffusion.assign(ft.data.begin(), ft.data.end());
+
+  return results;
+}
+
+template<typename T>
+bool isIdentical(const std::vector<T> &a, const std::vector<T> &b)
+{
+  return a == b;
+}
+
+// The stencil is allowed to differ by the rounding that -ffast-math introduces.
+template<typename T>
+bool isMatching(const std::vector<T> &a, const std::vector<T> &b, const T tolerance)
+{
+  if(a.size() != b.size())
+    return false;
+  for(size_t n=0; n<a.size(); ++n)
+    if(std::abs(a[n] - b[n]) > tolerance*(std::abs(a[n]) + 1))
+      return false;
+  return true;
+}
+
+template<typename T>
+void compareLevels(const char *type, Grid<double> &grid, const T tolerance)
+{
+  Master &master = Master::getInstance();
+  Simd &simd = Simd::getInstance();
+  const SimdLevel supported = simd.getSupportedLevel();
+
+  const Results<T> reference = runKernels<T>(SimdScalar, grid);
+
+  for(int level=SimdAVX2; level<=supported; ++level)
+  {
+    const Results<T> results = runKernels<T>(static_cast<SimdLevel>(level), grid);
+
+    std::ostringstream message;
+    message << "Compare " << Simd::getName(static_cast<SimdLevel>(level)) << " with scalar (" << type << ")\n";
+    master.printMessage(message.str());
+
+    if(!isIdentical(results.copy, reference.copy) ||
+       !isIdentical(results.copyadd, reference.copyadd) ||
+       !isIdentical(results.add, reference.add))
+      throw std::runtime_error("Vector kernels do not return identical results!");
+
+    if(!isMatching(results.diffusion, reference.diffusion, tolerance))
+      throw std::runtime_error("Vector diffusion kernel does not return the same field!");
+  }
+
+  simd.setLevel(supported);
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+    Simd &simd = Simd::getInstance();
+    const SimdLevel supported = simd.getSupportedLevel();
+
+    // odd rows, such that they do not fill complete vectors, on a grid that
+    // can still be decomposed over the processes in j
+    Grid<double> grid = createGrid<double>(61, 38, 19, 3);
+    compareLevels<double>("double", grid, 1.e-12);
+    compareLevels<float >("float" , grid, 1.e-5f);
+
+    // time the diffusion kernel for all levels
+    Grid<double> gridlarge = createGrid<double>(128, 128, 128, 3);
+    Field<double,double> a  = createField<double>(gridlarge, "a" );
+    Field<double,double> at = createField<double>(gridlarge, "at");
+    a.randomize(10);
+    at = 0.;
+
+    Diffusion<double,double> diff(gridlarge);
+
+    std::vector<double> times;
+    for(int level=SimdScalar; level<=supported; ++level)
+    {
+      simd.setLevel(static_cast<SimdLevel>(level));
+
+      Timer timer(std::string("Diffusion (CPU), ") + Simd::getName(static_cast<SimdLevel>(level)));
+      timer.start();
+      for(int n=0; n<50; ++n)
+        diff.exec(at, a, false);
+      timer.end();
+      times.push_back(timer.getTotal());
+    }
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(2) << "Speedup over scalar:";
+    for(int level=SimdScalar; level<=supported; ++level)
+      message << " " << Simd::getName(static_cast<SimdLevel>(level)) << " " << times[0] / times[level];
+    message << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Simd.h"
+#include "Statistics.h"
+#include "Timer.h"
+
+// Fill the fields with a function of the global index, such that the profiles
+// do not depend on the decomposition. The mean of a depends strongly on
+// height and is large compared to its fluctuations, as for a temperature.
+template<typename T>
+void fillFields(Field<T,double> &a, Field<T,double> &b)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        const long ig = i - dims.istart + dims.ioffset;
+        const long jg = j - dims.jstart + dims.joffset;
+        const long kg = k - dims.kstart;
+        const double noise = ((ig*7 + jg*13 + kg*3) % 17) / 17.;
+        a(i,j,k) = static_cast<T>(300. + 3.*kg + std::sin(0.3*ig)*std::cos(0.2*jg) + noise*noise*noise);
+        b(i,j,k) = static_cast<T>(std::sin(0.3*ig) + 0.5*noise);
+      }
+}
+
+// The profiles computed with two passes of serial loops per level.
+template<typename T>
+void calcReference(MomentProfiles &moments, std::vector<double> &covariance,
+                   const Field<T,double> &a, const Field<T,double> &b)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  Master &master = Master::getInstance();
+  const double n = dims.itot*dims.jtot;
+
+  std::vector<double> meana(dims.kmax, 0.), meanb(dims.kmax, 0.);
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        meana[k-dims.kstart] += a(i,j,k);
+        meanb[k-dims.kstart] += b(i,j,k);
+      }
+  master.sum(meana.data(), dims.kmax);
+  master.sum(meanb.data(), dims.kmax);
+  for(long k=0; k<dims.kmax; ++k)
+  {
+    meana[k] /= n;
+    meanb[k] /= n;
+  }
+
+  std::vector<double> m(4*dims.kmax, 0.);
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        const long kk = k-dims.kstart;
+        const double da = a(i,j,k) - meana[kk];
+        const double db = b(i,j,k) - meanb[kk];
+        m[4*kk  ] += da*da;
+        m[4*kk+1] += da*da*da;
+        m[4*kk+2] += da*da*da*da;
+        m[4*kk+3] += da*db;
+      }
+  master.sum(m.data(), 4*dims.kmax);
+
+  moments.mean = meana;
+  moments.variance.resize(dims.kmax);
+  moments.skewness.resize(dims.kmax);
+  moments.kurtosis.resize(dims.kmax);
+  covariance.resize(dims.kmax);
+  for(long k=0; k<dims.kmax; ++k)
+  {
+    moments.variance[k] = m[4*k] / n;
+    moments.skewness[k] = m[4*k+1] / n / std::pow(moments.variance[k], 1.5);
+    moments.kurtosis[k] = m[4*k+2] / n / (moments.variance[k]*moments.variance[k]);
+    covariance[k] = m[4*k+3] / n;
+  }
+}
+
+bool isClose(const std::vector<double> &a, const std::vector<double> &b, const double tolerance)
+{
+  if(a.size() != b.size())
+    return false;
+  for(size_t k=0; k<a.size(); ++k)
+    if(std::abs(a[k] - b[k]) > tolerance*(std::abs(b[k]) + 1.))
+      return false;
+  return true;
+}
+
+template<typename T>
+void checkProfiles(const char *type, Grid<double> &grid, const double tolerance)
+{
+  Master &master = Master::getInstance();
+  Simd &simd = Simd::getInstance();
+  const SimdLevel supported = simd.getSupportedLevel();
+
+  Field<T,double> a = createField<T>(grid, "a");
+  Field<T,double> b = createField<T>(grid, "b");
+  fillFields(a, b);
+
+  MomentProfiles ref;
+  std::vector<double> covref;
+  calcReference(ref, covref, a, b);
+
+  Statistics<double,T> stats(grid);
+
+  for(int level=SimdScalar; level<=supported; ++level)
+  {
+    simd.setLevel(static_cast<SimdLevel>(level));
+
+    MomentProfiles moments;
+    std::vector<double> mean, covariance;
+    stats.calcMean(mean, a);
+    stats.calcMoments(moments, a);
+    stats.calcCovariance(covariance, a, b);
+
+    std::ostringstream message;
+    message << std::setprecision(8) << "Profiles " << type << ", " << Simd::getName(static_cast<SimdLevel>(level))
+            << ", level 1: mean = " << moments.mean[1] << ", variance = " << moments.variance[1]
+            << ", skewness = " << moments.skewness[1] << ", kurtosis = " << moments.kurtosis[1]
+            << ", covariance = " << covariance[1] << "\n";
+    master.printMessage(message.str());
+
+    if(!isClose(mean, ref.mean, tolerance) || !isClose(moments.mean, ref.mean, tolerance) ||
+       !isClose(moments.variance, ref.variance, tolerance) ||
+       !isClose(moments.skewness, ref.skewness, tolerance) ||
+       !isClose(moments.kurtosis, ref.kurtosis, tolerance) ||
+       !isClose(covariance, covref, tolerance))
+      throw std::runtime_error("Profiles do not match the serial loops!");
+  }
+
+  simd.setLevel(supported);
+}
+
+// The statistics of a set of fields in a single pass have to match the
+// statistics that are computed per field and per pair of fields.
+void checkFused(Grid<double> &grid)
+{
+  Field<double,double> u = createField<double>(grid, "u");
+  Field<double,double> v = createField<double>(grid, "v");
+  Field<double,double> w = createField<double>(grid, "w");
+  Field<double,double> b = createField<double>(grid, "b");
+  fillFields(b, w);
+  fillFields(u, v);
+  v = 2.*v;
+  u += w;
+
+  Statistics<double,double> stats(grid);
+
+  std::vector<const Field<double,double>*> fields = {&u, &v, &w, &b};
+  std::vector<ProfileRequest> requests;
+  requests.push_back(ProfileRequest(StatisticsMean      , 0));
+  requests.push_back(ProfileRequest(StatisticsVariance  , 2));
+  requests.push_back(ProfileRequest(StatisticsSkewness  , 3));
+  requests.push_back(ProfileRequest(StatisticsCovariance, 2, 3));
+  requests.push_back(ProfileRequest(StatisticsCovariance, 0, 2));
+  requests.push_back(ProfileRequest(StatisticsCovariance, 1, 2));
+  requests.push_back(ProfileRequest(StatisticsCovariance, 2, 3));
+  stats.calcProfiles(requests, fields);
+
+  MomentProfiles momentsu, momentsw, momentsb;
+  std::vector<double> wb, uw, vw;
+  stats.calcMoments(momentsu, u);
+  stats.calcMoments(momentsw, w);
+  stats.calcMoments(momentsb, b);
+  stats.calcCovariance(wb, w, b);
+  stats.calcCovariance(uw, u, w);
+  stats.calcCovariance(vw, v, w);
+
+  const double tolerance = 1.e-12;
+  if(!isClose(requests[0].profile, momentsu.mean, tolerance) ||
+     !isClose(requests[1].profile, momentsw.variance, tolerance) ||
+     !isClose(requests[2].profile, momentsb.skewness, tolerance) ||
+     !isClose(requests[3].profile, wb, tolerance) ||
+     !isClose(requests[4].profile, uw, tolerance) ||
+     !isClose(requests[5].profile, vw, tolerance) ||
+     !isClose(requests[6].profile, wb, tolerance))
+    throw std::runtime_error("Fused profiles do not match the profiles per field!");
+}
+
+// Time the fused statistics of a set of fields against the statistics per field.
+void timeFused(Grid<double> &grid)
+{
+  Master &master = Master::getInstance();
+
+  Field<double,double> u = createField<double>(grid, "u");
+  Field<double,double> v = createField<double>(grid, "v");
+  Field<double,double> w = createField<double>(grid, "w");
+  Field<double,double> b = createField<double>(grid, "b");
+  fillFields(b, w);
+  fillFields(u, v);
+
+  Statistics<double,double> stats(grid);
+
+  // variances of all fields and the fluxes u'w', v'w' and w'b'
+  std::vector<const Field<double,double>*> fields = {&u, &v, &w, &b};
+  std::vector<ProfileRequest> requests;
+  for(int n=0; n<4; ++n)
+    requests.push_back(ProfileRequest(StatisticsVariance, n));
+  requests.push_back(ProfileRequest(StatisticsCovariance, 0, 2));
+  requests.push_back(ProfileRequest(StatisticsCovariance, 1, 2));
+  requests.push_back(ProfileRequest(StatisticsCovariance, 2, 3));
+
+  const int iter = 5;
+  MomentProfiles moments;
+  std::vector<double> covariance;
+
+  Timer timer1("Profiles, per field");
+  timer1.start();
+  for(int n=0; n<iter; ++n)
+  {
+    for(const Field<double,double> *field : fields)
+      stats.calcMoments(moments, *field);
+    stats.calcCovariance(covariance, u, w);
+    stats.calcCovariance(covariance, v, w);
+    stats.calcCovariance(covariance, w, b);
+  }
+  timer1.end();
+
+  Timer timer2("Profiles, fused");
+  timer2.start();
+  for(int n=0; n<iter; ++n)
+    stats.calcProfiles(requests, fields);
+  timer2.end();
+
+  std::ostringstream message;
+  message << std::fixed << std::setprecision(2)
+          << "Speedup fused profiles: " << timer1.getTotal() / timer2.getTotal() << "\n";
+  master.printMessage(message.str());
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    // odd sizes, such that the rows do not fill complete vectors
+    Grid<double> grid = createGrid<double>(60, 36, 7, 1);
+    checkProfiles<double>("double", grid, 1.e-9);
+    checkProfiles<float >("float" , grid, 1.e-3);
+
+    checkFused(grid);
+
+    // time the single pass against the two passes of serial loops
+    Grid<double> gridlarge = createGrid<double>(256, 256, 128, 1);
+    Field<double,double> a = createField<double>(gridlarge, "a");
+    Field<double,double> b = createField<double>(gridlarge, "b");
+    fillFields(a, b);
+
+    Statistics<double,double> stats(gridlarge);
+    MomentProfiles moments;
+    std::vector<double> covariance;
+
+    const int iter = 5;
+
+    Timer timer1("Profiles, serial loops");
+    timer1.start();
+    for(int n=0; n<iter; ++n)
+      calcReference(moments, covariance, a, b);
+    timer1.end();
+
+    Timer timer2("Profiles, Statistics");
+    timer2.start();
+    for(int n=0; n<iter; ++n)
+    {
+      stats.calcMoments(moments, a);
+      stats.calcCovariance(covariance, a, b);
+    }
+    timer2.end();
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(2)
+            << "Speedup profiles: " << timer1.getTotal() / timer2.getTotal() << "\n";
+    master.printMessage(message.str());
+
+    timeFused(gridlarge);
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
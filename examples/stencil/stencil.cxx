@@ -0,0 +1,227 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "BoundaryCyclic.h"
+#include "Diffusion.h"
+#include "Stencil.h"
+
+namespace
+{
+  const double pi = 3.14159265358979323846;
+}
+
+// Errors of the operators for a periodic sine on a grid of n^3 points.
+struct Errors
+{
+  double gradient;
+  double laplacian;
+  double divergence;
+};
+
+// Maximum absolute difference over the interior.
+double getError(const Field<double,double> &field, const Field<double,double> &ref)
+{
+  const GridDims &dims = field.getGrid().getDims();
+
+  double error = 0.;
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        error = std::max(error, std::abs(field(i,j,k) - ref(i,j,k)));
+  return error;
+}
+
+template<int order>
+Errors getErrors(const long n)
+{
+  Grid<double> grid = createGrid<double>(n, n, n, 3);
+  const GridDims &dims = grid.getDims();
+  const GridVars<double> &vars = grid.getVars();
+
+  Field<double,double> u = createField<double>(grid, "u");
+  Field<double,double> v = createField<double>(grid, "v");
+  Field<double,double> w = createField<double>(grid, "w");
+  Field<double,double> out = createField<double>(grid, "out");
+  Field<double,double> ref = createField<double>(grid, "ref");
+
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        const double x = vars.x[i-dims.istart];
+        const double y = vars.y[j-dims.jstart];
+        const double z = vars.z[k-dims.kstart];
+        u(i,j,k) = std::sin(2.*pi*x) * std::cos(2.*pi*y);
+        v(i,j,k) = std::sin(2.*pi*y) * std::cos(2.*pi*z);
+        w(i,j,k) = std::sin(2.*pi*z) * std::cos(2.*pi*x);
+      }
+
+  BoundaryCyclic<double,double> boundary(grid);
+  boundary.exec(u);
+  boundary.exec(v);
+  boundary.exec(w);
+
+  Errors errors;
+
+  // du/dx
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        ref(i,j,k) = 2.*pi * std::cos(2.*pi*vars.x[i-dims.istart]) * std::cos(2.*pi*vars.y[j-dims.jstart]);
+  gradient<order,0>(out, u);
+  errors.gradient = getError(out, ref);
+
+  // the laplacian of u is -8 pi^2 u
+  ref = -8.*pi*pi*u;
+  laplacian<order>(out, u);
+  errors.laplacian = getError(out, ref);
+
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+      {
+        const double x = vars.x[i-dims.istart];
+        const double y = vars.y[j-dims.jstart];
+        const double z = vars.z[k-dims.kstart];
+        ref(i,j,k) = 2.*pi * (std::cos(2.*pi*x) * std::cos(2.*pi*y)
+                            + std::cos(2.*pi*y) * std::cos(2.*pi*z)
+                            + std::cos(2.*pi*z) * std::cos(2.*pi*x));
+      }
+  divergence<order>(out, u, v, w);
+  errors.divergence = getError(out, ref);
+
+  return errors;
+}
+
+// Check that halving the grid spacing reduces the errors by 2^order.
+template<int order>
+void checkOrder()
+{
+  const Errors coarse = getErrors<order>(16);
+  const Errors fine   = getErrors<order>(32);
+
+  const double gradient   = std::log2(coarse.gradient   / fine.gradient  );
+  const double laplacian  = std::log2(coarse.laplacian  / fine.laplacian );
+  const double divergence = std::log2(coarse.divergence / fine.divergence);
+
+  Master &master = Master::getInstance();
+  std::ostringstream message;
+  message << std::fixed << std::setprecision(2)
+          << "Order " << order << ", measured order of gradient, laplacian and divergence: "
+          << gradient << ", " << laplacian << ", " << divergence << "\n";
+  master.printMessage(message.str());
+
+  const double tolerance = 0.2;
+  if(gradient < order-tolerance || laplacian < order-tolerance || divergence < order-tolerance)
+    throw std::runtime_error("Operator does not converge at the expected order!");
+}
+
+// The diffusion stencil is the fourth order second derivative without grid
+// spacing, so for a sine of wave number k it has to return -(k dx)^2 times the sine.
+void checkDiffusion()
+{
+  const long n = 32;
+  Grid<double> grid = createGrid<double>(n, n, n, 3);
+  const GridDims &dims = grid.getDims();
+  const GridVars<double> &vars = grid.getVars();
+
+  Field<double,double> a  = createField<double>(grid, "a" );
+  Field<double,double> at = createField<double>(grid, "at");
+
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        a(i,j,k) = std::sin(2.*pi*vars.x[i-dims.istart]);
+
+  BoundaryCyclic<double,double> boundary(grid);
+  boundary.exec(a);
+
+  Diffusion<double,double> diff(grid);
+  at = 0.;
+  diff.exec(at, a, false);
+
+  Field<double,double> ref = -std::pow(2.*pi/n, 2)*a;
+  const double error = getError(at, ref) / std::pow(2.*pi/n, 2);
+
+  Master &master = Master::getInstance();
+  std::ostringstream message;
+  message << "Relative error of the diffusion stencil: " << error << "\n";
+  master.printMessage(message.str());
+
+  if(error > 1.e-3)
+    throw std::runtime_error("Diffusion stencil is not a second derivative!");
+}
+
+// The operators refuse Fields of another shape and an output that is an input.
+void checkArguments()
+{
+  Grid<double> grid = createGrid<double>(16, 16, 16, 3);
+  Grid<double> gridother = createGrid<double>(32, 16, 16, 3);
+  Field<double,double> a = createField<double>(grid, "a");
+  Field<double,double> b = createField<double>(grid, "b");
+  Field<double,double> c = createField<double>(gridother, "c");
+
+  int nrefused = 0;
+  try { gradient<2,0>(a, c); } catch (int) { ++nrefused; }
+  try { divergence<2>(a, b, c, b); } catch (int) { ++nrefused; }
+  try { laplacian<2>(a, a); } catch (int) { ++nrefused; }
+  try { divergence<2>(b, a, a, b); } catch (int) { ++nrefused; }
+
+  if(nrefused != 4)
+    throw std::runtime_error("Operator accepts Fields of another shape or an output that is an input!");
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    checkOrder<2>();
+    checkOrder<4>();
+    checkOrder<6>();
+    checkDiffusion();
+    checkArguments();
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cmath>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "Half.h"
+#include "FieldFile.h"
+#include "FieldStream.h"
+#include "BoundaryCyclic.h"
+#include "Diffusion.h"
+#include "Timer.h"
+
+// The interior of the Fields is allowed to differ by the rounding of
+// sums in another order.
+bool isMatching(const Field<double,double> &a, const Field<double,double> &b, const double tolerance)
+{
+  const GridDims &dims = a.getGrid().getDims();
+  for(long k=dims.kstart; k<dims.kend; ++k)
+    for(long j=dims.jstart; j<dims.jend; ++j)
+      for(long i=dims.istart; i<dims.iend; ++i)
+        if(std::abs(a(i,j,k) - b(i,j,k)) > tolerance*(std::abs(a(i,j,k)) + 1))
+          return false;
+  return true;
+}
+
+bool isMatching(const double a, const double b)
+{
+  return std::abs(a - b) <= 1.e-12*std::abs(a);
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    Grid<double> grid = createGrid<double>(128, 128, 128, 3);
+    BoundaryCyclic<double,double> boundary(grid);
+    Diffusion<double,double> diff(grid);
+
+    Field<double,double> a = createField<double>(grid, "a");
+    a.randomize(10);
+    boundary.exec(a);
+    saveField(a, "stream_a.bin");
+    createFieldFile<double>(grid, "stream_at.bin");
+    createFieldFile<double>(grid, "stream_b.bin");
+
+    // the diffusion in memory and out-of-core in slabs of 16 planes, with
+    // the number of planes of the slab rounded down to a divisor of kmax
+    Field<double,double> at = createField<double>(grid, "at");
+    Timer timer1("Diffusion, in memory");
+    timer1.start();
+    diff.exec(at, a, true);
+    timer1.end();
+
+    Timer timer2("Diffusion, streamed");
+    {
+      FieldStream<double,double> astream(grid, "stream_a.bin", 17);
+      FieldStream<double,double> atstream(grid, "stream_at.bin", 17, StreamReadWrite);
+      if(astream.getSlabSize() != 16 || astream.getNslabs() != 8)
+        throw std::runtime_error("Slab size is not rounded down to a divisor of kmax!");
+
+      timer2.start();
+      diff.exec(atstream, astream, true);
+      timer2.end();
+    }
+
+    if(!isMatching(mapField<double>(grid, "stream_at.bin"), at, 1.e-12))
+      throw std::runtime_error("Streamed diffusion does not match the diffusion in memory!");
+
+    // element-wise operators on the slabs of a written stream
+    {
+      FieldStream<double,double> astream(grid, "stream_a.bin", 32);
+      FieldStream<double,double> bstream(grid, "stream_b.bin", 32, StreamWrite);
+      streamSlabs([](const long, Field<double,double> &bslab, Field<double,double> &aslab)
+      {
+        bslab = 2.*aslab + 1.;
+      }, bstream, astream);
+    }
+
+    Field<double,double> b = 2.*a + 1.;
+    if(!isMatching(mapField<double>(grid, "stream_b.bin"), b, 0.))
+      throw std::runtime_error("Streamed operators do not match the operators in memory!");
+
+    // a slab of StreamReadWrite is read after the slab below is written, so
+    // its lower ghost planes have the new values of that slab
+    {
+      FieldStream<double,double> bstream(grid, "stream_b.bin", 32, StreamReadWrite);
+      const GridDims &dims = grid.getDims();
+      const GridDims &slabdims = bstream.getSlabGrid().getDims();
+      bool isUpdated = true;
+      streamSlabs([&](const long koffset, Field<double,double> &bslab)
+      {
+        if(koffset > 0)
+          for(long j=slabdims.jstart; j<slabdims.jend; ++j)
+            for(long i=slabdims.istart; i<slabdims.iend; ++i)
+              if(bslab(i,j,slabdims.kstart-1) != b(i,j,dims.kstart+koffset-1) + 1.)
+                isUpdated = false;
+        bslab = bslab + 1.;
+      }, bstream);
+
+      if(!isUpdated)
+        throw std::runtime_error("Streamed slab is read before the slab below is written!");
+    }
+
+    // the reductions in a single pass over the file
+    FieldStream<double,double> astream(grid, "stream_a.bin", 8);
+    if(!isMatching(astream.sum(), a.sum()) || !isMatching(astream.mean(), a.mean()) ||
+       astream.min() != a.min() || astream.max() != a.max() ||
+       !isMatching(astream.variance(), a.variance()) || !isMatching(astream.norm(), a.norm()))
+      throw std::runtime_error("Streamed reductions do not match the reductions in memory!");
+
+    // the minimum and maximum of a stream of Half, of which all values are negative
+    Field<Half,double> h = createField<Half>(grid, "h");
+    convertField(h, Field<double,double>(a - 20.));
+    saveField(h, "stream_h.bin");
+    {
+      FieldStream<Half,double> hstream(grid, "stream_h.bin", 8);
+      if(static_cast<float>(hstream.min()) != static_cast<float>(h.min()) ||
+         static_cast<float>(hstream.max()) != static_cast<float>(h.max()) ||
+         static_cast<float>(hstream.max()) != static_cast<float>(a.max()) - 20.f)
+        throw std::runtime_error("Streamed minimum and maximum of Half do not match!");
+    }
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(4)
+            << "Time of the diffusion (s), in memory: " << timer1.getTotal()
+            << ", streamed: " << timer2.getTotal() << "\n";
+    master.printMessage(message.str());
+
+    std::remove(getFieldFileName("stream_a.bin").c_str());
+    std::remove(getFieldFileName("stream_at.bin").c_str());
+    std::remove(getFieldFileName("stream_b.bin").c_str());
+    std::remove(getFieldFileName("stream_h.bin").c_str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldFile.h"
+#include "Random.h"
+#include "Statistics.h"
+#include "ThreadPool.h"
+#include "TimeParallel.h"
+#include "Timer.h"
+
+namespace
+{
+  std::string getName(const long n)
+  {
+    std::ostringstream name;
+    name << "snapshot" << n << ".bin";
+    return name.str();
+  }
+}
+
+// Statistics of a series of random snapshots in Field files, whose mean and
+// spread grow in time. The results are the sum of the mean profiles, the sums
+// of the means and variances, and the minimum and maximum over all snapshots.
+// The cost of the snapshots varies, to load the processes and threads
+// unevenly.
+class SnapshotApplication : public TimeParallelApplication
+{
+  public:
+    SnapshotApplication(int argc, char *argv[], const long nsnapshots, Grid<double> &gridin) :
+      TimeParallelApplication(argc, argv, nsnapshots, gridin.getDims().ktot + 4),
+      grid(gridin),
+      nlevels(gridin.getDims().ktot)
+    {
+    }
+
+    const std::vector<double> &getResults() const { return results; }
+
+    // every process writes a part of the snapshots, which are read by all
+    void createSnapshots()
+    {
+      Master &master = Master::getInstance();
+      Master::setLocal(true);
+      Field<double,double> a(grid, "snapshot");
+      for(long n=master.mpiid; n<getNumSnapshots(); n+=master.getNprocs())
+      {
+        randomizeNormal(a, Philox(20151024, n), 0.01*n, 1. + 0.001*n);
+        saveField(a, getName(n));
+      }
+      Master::setLocal(false);
+      synchronize();
+    }
+
+    void removeSnapshots()
+    {
+      Master &master = Master::getInstance();
+      synchronize();
+      for(long n=master.mpiid; n<getNumSnapshots(); n+=master.getNprocs())
+        std::remove(getName(n).c_str());
+    }
+
+    // the same results from a loop over the snapshots on this process
+    std::vector<double> calcReference()
+    {
+      std::vector<double> reference(getNumResults()), snapshot(getNumResults());
+      Master::setLocal(true);
+      analyze(0, reference.data());
+      for(long n=1; n<getNumSnapshots(); ++n)
+      {
+        analyze(n, snapshot.data());
+        merge(reference.data(), snapshot.data());
+      }
+      Master::setLocal(false);
+      return reference;
+    }
+
+  protected:
+    void analyze(const long n, double *result)
+    {
+      const Field<double,double> a = mapField<double>(grid, getName(n));
+
+      std::vector<double> profile;
+      Statistics<double,double> statistics(grid);
+      for(int repeat=0; repeat<1+n%4; ++repeat)
+        statistics.calcMean(profile, a);
+
+      std::copy(profile.begin(), profile.end(), result);
+      result[nlevels  ] = a.mean();
+      result[nlevels+1] = a.variance();
+      result[nlevels+2] = a.min();
+      result[nlevels+3] = a.max();
+    }
+
+    void merge(double *a, const double *b)
+    {
+      for(long k=0; k<nlevels+2; ++k)
+        a[k] += b[k];
+      a[nlevels+2] = std::min(a[nlevels+2], b[nlevels+2]);
+      a[nlevels+3] = std::max(a[nlevels+3], b[nlevels+3]);
+    }
+
+    void finish(const double *merged)
+    {
+      results.assign(merged, merged + getNumResults());
+    }
+
+  private:
+    // a reduction over all processes waits for all of them
+    void synchronize()
+    {
+      double dummy = 0.;
+      Master::getInstance().sum(&dummy, 1);
+    }
+
+    Grid<double> &grid;
+    const long nlevels;
+    std::vector<double> results;
+};
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    // every process holds whole snapshots
+    const long nsnapshots = 96;
+    Grid<double> grid = createLocalGrid<double>(64, 64, 32);
+    SnapshotApplication application(argc, argv, nsnapshots, grid);
+    application.createSnapshots();
+
+    Timer timer("Time-parallel analysis");
+    timer.start();
+    application.exec();
+    timer.end();
+    const std::vector<double> results = application.getResults();
+
+    // the number of snapshots per process shows the balance of the load
+    std::vector<double> counts(master.getNprocs(), 0.);
+    counts[master.mpiid] = application.getNumAnalyzed();
+    master.sum(counts.data(), counts.size());
+
+    // identical results for another number of threads
+    const int nthreads = pool.getNumThreads();
+    pool.setNumThreads(nthreads == 1 ? 3 : 1);
+    application.exec();
+    pool.setNumThreads(nthreads);
+    if(application.getResults() != results)
+      throw std::runtime_error("Time-parallel results depend on the number of threads!");
+
+    const std::vector<double> reference = application.calcReference();
+    const long nlevels = grid.getDims().ktot;
+    for(long n=0; n<nlevels+2; ++n)
+      if(std::abs(results[n] - reference[n]) > 1.e-12*(1. + std::abs(reference[n])))
+        throw std::runtime_error("Time-parallel results do not match the serial loop!");
+    if(results[nlevels+2] != reference[nlevels+2] || results[nlevels+3] != reference[nlevels+3])
+      throw std::runtime_error("Time-parallel minimum and maximum do not match the serial loop!");
+    application.removeSnapshots();
+
+    std::ostringstream message;
+    message << "Snapshots per process:";
+    for(const double count : counts)
+      message << " " << count;
+    message << "\n" << std::setprecision(17)
+            << "Mean of all snapshots: " << results[nlevels] / nsnapshots
+            << ", minimum: " << results[nlevels+2] << ", maximum: " << results[nlevels+3] << "\n"
+            << std::fixed << std::setprecision(2)
+            << "Time per snapshot (ms): " << 1.e3*timer.getTotal() / nsnapshots << "\n";
+    master.printMessage(message.str());
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
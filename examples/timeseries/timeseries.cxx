@@ -0,0 +1,264 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "TimeSeriesField.h"
+#include "Random.h"
+#include "Timer.h"
+
+// Reductions in time of a list of levels, computed directly per point.
+struct Reference
+{
+  Reference(Grid<double> &grid) :
+    mean(grid, "mean ref"), variance(grid, "variance ref"), trend(grid, "trend ref"),
+    min(grid, "min ref"), max(grid, "max ref") {}
+
+  void calc(const std::vector<const Field<double,double> *> &levels, const std::vector<double> &times)
+  {
+    const double n = levels.size();
+    double tmean = 0.;
+    for(const double t : times)
+      tmean += t / n;
+    double tm2 = 0.;
+    for(const double t : times)
+      tm2 += (t - tmean)*(t - tmean);
+
+    for(long i=0; i<static_cast<long>(mean.data.size()); ++i)
+    {
+      double sum = 0.;
+      min.data[i] = max.data[i] = levels[0]->data[i];
+      for(const Field<double,double> *level : levels)
+      {
+        sum += level->data[i];
+        min.data[i] = std::min(min.data[i], level->data[i]);
+        max.data[i] = std::max(max.data[i], level->data[i]);
+      }
+      mean.data[i] = sum / n;
+
+      double m2 = 0., txm = 0.;
+      for(size_t l=0; l<levels.size(); ++l)
+      {
+        const double dx = levels[l]->data[i] - mean.data[i];
+        m2 += dx*dx;
+        txm += (times[l] - tmean)*dx;
+      }
+      variance.data[i] = m2 / n;
+      trend.data[i] = tm2 > 0. ? txm / tm2 : 0.;
+    }
+  }
+
+  Field<double,double> mean, variance, trend, min, max;
+};
+
+double getError(const Field<double,double> &a, const Field<double,double> &b)
+{
+  double error = 0.;
+  for(long i=0; i<static_cast<long>(a.data.size()); ++i)
+    error = std::max(error, std::abs(a.data[i] - b.data[i]));
+
+  Master &master = Master::getInstance();
+  master.max(&error, 1);
+  return error;
+}
+
+// A random field around a linear trend in time.
+void fillLevel(Field<double,double> &level, const Field<double,double> &slope, const double time, const int step)
+{
+  randomizeUniform(level, Philox(step));
+  level += time*slope;
+}
+
+// Check the window after every step against the direct reductions over the
+// levels, with irregular steps in time and more steps than levels.
+void checkReductions(Grid<double> &grid)
+{
+  const int nlevels = 6;
+  TimeSeriesField<double,double> series(grid, "x", nlevels);
+  Field<double,double> slope = createField<double>(grid, "slope");
+  Field<double,double> out = createField<double>(grid, "out");
+  Reference ref(grid);
+  randomizeNormal(slope, Philox(1234));
+
+  double time = 0.;
+  for(int step=0; step<40; ++step)
+  {
+    time += 1. + 0.5*(step % 3);
+    fillLevel(series.advance(time), slope, time, step);
+
+    std::vector<const Field<double,double> *> levels;
+    std::vector<double> times;
+    for(int n=0; n<series.getSize(); ++n)
+    {
+      levels.push_back(&series.getLevel(n));
+      times.push_back(series.getTime(n));
+    }
+    ref.calc(levels, times);
+
+    const double tolerance = 1.e-10;
+    series.mean(out);
+    if(getError(out, ref.mean) > tolerance)
+      throw std::runtime_error("Mean in time does not match the levels!");
+    series.variance(out);
+    if(getError(out, ref.variance) > tolerance)
+      throw std::runtime_error("Variance in time does not match the levels!");
+    series.trend(out);
+    if(getError(out, ref.trend) > tolerance)
+      throw std::runtime_error("Trend in time does not match the levels!");
+    series.min(out);
+    if(getError(out, ref.min) != 0.)
+      throw std::runtime_error("Minimum in time does not match the levels!");
+    series.max(out);
+    if(getError(out, ref.max) != 0.)
+      throw std::runtime_error("Maximum in time does not match the levels!");
+  }
+
+  if(series.getSize() != nlevels)
+    throw std::runtime_error("Window does not hold all levels!");
+
+  // a level that is changed after it has been added is taken into account
+  // by recomputing the reductions
+  series.getLevel(2) += slope;
+  series.recompute();
+  {
+    std::vector<const Field<double,double> *> levels;
+    std::vector<double> times;
+    for(int n=0; n<series.getSize(); ++n)
+    {
+      levels.push_back(&series.getLevel(n));
+      times.push_back(series.getTime(n));
+    }
+    ref.calc(levels, times);
+
+    series.variance(out);
+    if(getError(out, ref.variance) > 1.e-10)
+      throw std::runtime_error("Recomputed variance in time does not match the levels!");
+  }
+
+  // interpolation between the two newest levels and at a level
+  const double t0 = series.getTime(1), t1 = series.getTime(0);
+  series.interpolate(out, 0.75*t0 + 0.25*t1);
+  Field<double,double> interp = 0.75*series.getLevel(1) + 0.25*series.getLevel(0);
+  if(getError(out, interp) > 1.e-12)
+    throw std::runtime_error("Interpolation in time does not match the levels!");
+
+  series.interpolate(out, series.getTime(3));
+  if(getError(out, series.getLevel(3)) != 0.)
+    throw std::runtime_error("Interpolation at a level does not return the level!");
+}
+
+// The window of the analysis before: every snapshot is a new Field and the
+// reductions are recomputed over all levels of the window.
+void benchmark(Grid<double> &grid, const int nlevels, const int nsteps)
+{
+  Master &master = Master::getInstance();
+  Field<double,double> slope = createField<double>(grid, "slope");
+  Field<double,double> mean = createField<double>(grid, "mean");
+  Field<double,double> variance = createField<double>(grid, "variance");
+  randomizeNormal(slope, Philox(1234));
+
+  Timer timer1("Window of new Fields");
+  timer1.start();
+  {
+    std::vector<std::unique_ptr<Field<double,double> > > window;
+    for(int step=0; step<nsteps; ++step)
+    {
+      window.emplace_back(new Field<double,double>(grid, "snapshot"));
+      fillLevel(*window.back(), slope, step, step);
+      if(static_cast<int>(window.size()) > nlevels)
+        window.erase(window.begin());
+
+      mean = 0.;
+      for(const auto &level : window)
+        mean += *level;
+      mean = (1./window.size())*mean;
+      variance = 0.;
+      for(const auto &level : window)
+        variance += (*level - mean)*(*level - mean);
+      variance = (1./window.size())*variance;
+    }
+  }
+  timer1.end();
+
+  Field<double,double> mean2 = createField<double>(grid, "mean2");
+  Field<double,double> variance2 = createField<double>(grid, "variance2");
+
+  Timer timer2("TimeSeriesField");
+  timer2.start();
+  {
+    TimeSeriesField<double,double> series(grid, "x", nlevels);
+    for(int step=0; step<nsteps; ++step)
+    {
+      fillLevel(series.advance(step), slope, step, step);
+      series.mean(mean2);
+      series.variance(variance2);
+    }
+  }
+  timer2.end();
+
+  if(getError(mean, mean2) > 1.e-10 || getError(variance, variance2) > 1.e-10)
+    throw std::runtime_error("TimeSeriesField does not match the window of new Fields!");
+
+  std::ostringstream message;
+  message << std::fixed << std::setprecision(2)
+          << "Time per snapshot (ms) with " << nlevels << " levels, new Fields: " << 1.e3*timer1.getTotal()/nsteps
+          << ", TimeSeriesField: " << 1.e3*timer2.getTotal()/nsteps << "\n";
+  master.printMessage(message.str());
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Grid<double> small = createGrid<double>(24, 20, 16, 1);
+    checkReductions(small);
+
+    Grid<double> grid = createGrid<double>(128, 128, 64, 1);
+    benchmark(grid, 16, 48);
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
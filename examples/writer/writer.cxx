@@ -0,0 +1,193 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldFile.h"
+#include "FieldWriter.h"
+#include "BoundaryCyclic.h"
+#include "Diffusion.h"
+#include "Timer.h"
+
+std::string getName(const std::string mode, const int n)
+{
+  std::ostringstream name;
+  name << "writer_" << mode << n << ".bin";
+  return name.str();
+}
+
+bool isIdentical(const Field<double,double> &a, const Field<double,double> &b)
+{
+  return std::memcmp(a.data.data(), b.data.data(), a.data.size()*sizeof(double)) == 0;
+}
+
+// Run the diffusion and write the field after every few steps, either
+// directly or with the writer.
+template<class W>
+void runDiffusion(Grid<double> &grid, const std::string mode, W write)
+{
+  const int noutput = 8;
+  const int nsteps = 4;
+
+  Field<double,double> a  = createField<double>(grid, "a" );
+  Field<double,double> at = createField<double>(grid, "at");
+  std::srand(1);
+  a.randomize(10);
+
+  BoundaryCyclic<double,double> boundary(grid);
+  Diffusion<double,double> diff(grid);
+
+  for(int n=0; n<noutput; ++n)
+  {
+    diff.advance(a, at, boundary, 0.01, nsteps, true);
+    write(a, getName(mode, n));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    Master &master = Master::getInstance();
+
+    Grid<double> grid = createGrid<double>(128, 128, 128, 3);
+
+    Timer timer1("Diffusion with output, synchronous");
+    timer1.start();
+    runDiffusion(grid, "sync",
+        [](const Field<double,double> &a, const std::string name) { saveField(a, name); });
+    timer1.end();
+
+    // the time includes the wait for the last write
+    Timer timer2("Diffusion with output, asynchronous");
+    double waittime;
+    {
+      FieldWriter<double,double> writer(grid);
+      timer2.start();
+      runDiffusion(grid, "async",
+          [&](const Field<double,double> &a, const std::string name) { writer.write(a, name); });
+      writer.flush();
+      timer2.end();
+      waittime = writer.getWaitTime();
+    }
+
+    // the snapshots are those of the time of the write
+    for(int n=0; n<8; ++n)
+      if(!isIdentical(mapField<double>(grid, getName("sync", n)), mapField<double>(grid, getName("async", n))))
+        throw std::runtime_error("Asynchronous output does not match the synchronous output!");
+
+    // the errors of the I/O thread are thrown by flush
+    bool thrown = false;
+    try
+    {
+      FieldWriter<double,double> writer(grid, 1);
+      writer.write(mapField<double>(grid, getName("sync", 0)), "nonexistent/writer.bin");
+      writer.flush();
+    }
+    catch (int)
+    {
+      thrown = true;
+    }
+    if(!thrown)
+      throw std::runtime_error("Error of the writer is not thrown!");
+
+    // a write of which the copy fails returns its buffer to the writer
+    {
+      Grid<double> other = createGrid<double>(64, 64, 64, 3);
+      FieldWriter<double,double> writer(grid, 1);
+      thrown = false;
+      try
+      {
+        writer.write(createField<double>(other, "other"), getName("async", 0));
+      }
+      catch (int)
+      {
+        thrown = true;
+      }
+      if(!thrown)
+        throw std::runtime_error("Write of a Field of another Grid is not refused!");
+
+      writer.write(mapField<double>(grid, getName("sync", 0)), getName("async", 0));
+      writer.flush();
+    }
+
+    // the writes of a thread that is restricted to its process go to the
+    // file without the process number, as saveField on that thread does
+    {
+      Grid<double> local = createLocalGrid<double>(32, 32, 32);
+      Field<double,double> c = createField<double>(local, "c");
+      c.randomize(10);
+
+      std::ostringstream name;
+      name << "writer_local" << master.mpiid << ".bin";
+
+      Master::setLocal(true);
+      {
+        FieldWriter<double,double> writer(local);
+        writer.write(c, name.str());
+        writer.flush();
+      }
+      const bool isWritten = isIdentical(mapField<double>(local, name.str()), c);
+      std::remove(getFieldFileName(name.str()).c_str());
+      Master::setLocal(false);
+
+      if(!isWritten)
+        throw std::runtime_error("Local output does not match the local Field!");
+    }
+
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(4)
+            << "Time of the diffusion with output (s), synchronous: " << timer1.getTotal()
+            << ", asynchronous: " << timer2.getTotal() << ", of which waiting for a buffer: " << waittime << "\n";
+    master.printMessage(message.str());
+
+    for(int n=0; n<8; ++n)
+    {
+      std::remove(getFieldFileName(getName("sync", n)).c_str());
+      std::remove(getFieldFileName(getName("async", n)).c_str());
+    }
+  }
+
+  catch (std::exception &e)
+  {
+    std::ostringstream message;
+    message << "Exited with exception: " << e.what() << "\n";
+    Master &master = Master::getInstance();
+    master.printMessage(message.str());
+    return 1;
+  }
+
+  catch (...)
+  {
+    return 1;
+  }
+
+  return 0;
+}
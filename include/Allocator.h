@@ -0,0 +1,143 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ALLOCATOR
+#define ALLOCATOR
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <limits>
+#include <sys/mman.h>
+
+// Allocator for the data of Fields. The memory is aligned to a cache line,
+// such that the vector loops start at an aligned address, and arrays that
+// span huge pages are aligned to the huge page size and marked for transparent
+// huge pages, which reduces the TLB misses of the stencil loops over large
+// fields. Elements are default initialized rather than value initialized, so
+// the allocation does not touch the memory. The Field fills its data with a
+// parallel loop, which places the pages with the threads that use them.
+class AllocatorSettings
+{
+  public:
+    // Switch the use of transparent huge pages for new allocations on or
+    // off, by default they are used if the operating system supports them.
+    static void setHugePages(bool hugepagesin) { useHugePages() = hugepagesin; }
+    static bool getHugePages() { return useHugePages(); }
+
+  protected:
+    static bool &useHugePages();
+};
+
+template<typename T>
+class AlignedAllocator : public AllocatorSettings
+{
+  public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template<typename U> struct rebind { typedef AlignedAllocator<U> other; };
+
+    static const std::size_t alignment = 64;
+    static const std::size_t hugepagesize = 2*1024*1024;
+
+    AlignedAllocator() {}
+    template<typename U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    T *allocate(std::size_t, const void * = 0);
+    void deallocate(T *, std::size_t);
+
+    std::size_t max_size() const { return std::numeric_limits<std::size_t>::max() / sizeof(T); }
+
+    // default initialization, which leaves trivial types uninitialized
+    template<typename U> void construct(U *p) { ::new(static_cast<void *>(p)) U; }
+    template<typename U, typename... Args>
+    void construct(U *p, Args&&... args) { ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+    template<typename U> void destroy(U *p) { p->~U(); }
+};
+
+template<typename T, typename U>
+inline bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &) { return true; }
+template<typename T, typename U>
+inline bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &) { return false; }
+
+
+// IMPLEMENTATION BELOW
+inline bool &AllocatorSettings::useHugePages()
+{
+  static bool hugepages = true;
+  return hugepages;
+}
+
+template<typename T>
+const std::size_t AlignedAllocator<T>::alignment;
+
+template<typename T>
+const std::size_t AlignedAllocator<T>::hugepagesize;
+
+template<typename T>
+inline T *AlignedAllocator<T>::allocate(const std::size_t n, const void *)
+{
+  if(n == 0)
+    return 0;
+  if(n > max_size())
+    throw std::bad_alloc();
+
+  const std::size_t bytes = n*sizeof(T);
+
+  #ifdef MADV_HUGEPAGE
+  const bool hugepages = useHugePages() && bytes >= hugepagesize;
+  #else
+  const bool hugepages = false;
+  #endif
+
+  // round up to whole huge pages, otherwise the last page is a normal one
+  const std::size_t align = hugepages ? hugepagesize : alignment;
+  const std::size_t size  = hugepages ? (bytes + hugepagesize - 1) / hugepagesize * hugepagesize : bytes;
+
+  void *p = 0;
+  if(posix_memalign(&p, align, size) != 0)
+    throw std::bad_alloc();
+
+  // the advice is only a hint, the memory is usable if it fails
+  #ifdef MADV_HUGEPAGE
+  if(hugepages)
+    madvise(p, size, MADV_HUGEPAGE);
+  #endif
+
+  return static_cast<T *>(p);
+}
+
+template<typename T>
+inline void AlignedAllocator<T>::deallocate(T *p, std::size_t)
+{
+  std::free(p);
+}
+#endif
@@ -0,0 +1,318 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOUNDARYCYCLIC
+#define BOUNDARYCYCLIC
+
+#include <vector>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+
+// Fills the ghost cells of a Field with periodic boundary conditions in all
+// three directions. The horizontal directions are exchanged with the
+// neighbouring processes when the grid is decomposed, the vertical direction
+// is never decomposed and is filled locally.
+//
+// exec() fills all ghost cells including the edges and corners. The
+// start()/finish() pair only fills the faces, which is what cross-shaped
+// stencils need, and allows computations on the interior while the messages
+// are in flight.
+template<class T, class TF>
+class BoundaryCyclic
+{
+  public:
+    BoundaryCyclic(Grid<T> &);
+    virtual ~BoundaryCyclic();
+
+    // disable the assignment and copy constructors
+    BoundaryCyclic(const BoundaryCyclic &) = delete;
+    BoundaryCyclic &operator=(const BoundaryCyclic &) = delete;
+
+    void exec(Field<TF,T> &);
+
+    void start(Field<TF,T> &);
+    void finish();
+
+  protected:
+    Grid<T> &grid;
+
+  private:
+    void execVertical(TF * const);
+
+    #ifdef USEMPI
+    void exchange(TF * const, MPI_Datatype, MPI_Datatype, bool);
+    void waitAll();
+
+    MPI_Datatype eastwestedge;
+    MPI_Datatype northsouthedge;
+    MPI_Datatype eastwestface;
+    MPI_Datatype northsouthface;
+
+    std::vector<MPI_Request> reqs;
+    #else
+    void execEastWest(TF * const, long, long, long, long);
+    void execNorthSouth(TF * const, long, long, long, long);
+    #endif
+};
+
+
+// IMPLEMENTATION BELOW
+#ifdef USEMPI
+namespace
+{
+  template<typename TF> MPI_Datatype getMPIType();
+  template<> inline MPI_Datatype getMPIType<float >() { return MPI_FLOAT;  }
+  template<> inline MPI_Datatype getMPIType<double>() { return MPI_DOUBLE; }
+  // the 16-bit types are exchanged as their bits, see Half.h
+  template<> inline MPI_Datatype getMPIType<Half    >() { return MPI_UINT16_T; }
+  template<> inline MPI_Datatype getMPIType<BFloat16>() { return MPI_UINT16_T; }
+
+  // create a block of the 3d array with the ordering (k,j,i) as a datatype
+  inline MPI_Datatype createBlock(const GridDims &dims, const int ni, const int nj, const int nk, MPI_Datatype type)
+  {
+    int sizes   [3] = {(int)dims.kcells, (int)dims.jcells, (int)dims.icells};
+    int subsizes[3] = {nk, nj, ni};
+    int starts  [3] = {0, 0, 0};
+
+    MPI_Datatype block;
+    MPI_Type_create_subarray(3, sizes, subsizes, starts, MPI_ORDER_C, type, &block);
+    MPI_Type_commit(&block);
+    return block;
+  }
+}
+
+template<class T, class TF>
+inline BoundaryCyclic<T,TF>::BoundaryCyclic(Grid<T> &gridin) :
+  grid(gridin)
+{
+  const GridDims &dims = grid.getDims();
+  MPI_Datatype type = getMPIType<TF>();
+
+  // the edges cover the full plane including the ghost cells of the other
+  // directions, the faces only the interior of the subdomain
+  eastwestedge   = MPI_DATATYPE_NULL;
+  northsouthedge = MPI_DATATYPE_NULL;
+  eastwestface   = MPI_DATATYPE_NULL;
+  northsouthface = MPI_DATATYPE_NULL;
+
+  if(dims.igc > 0)
+  {
+    eastwestedge = createBlock(dims, dims.igc, dims.jcells, dims.kcells, type);
+    eastwestface = createBlock(dims, dims.igc, dims.jmax, dims.kmax, type);
+  }
+  if(dims.jgc > 0)
+  {
+    northsouthedge = createBlock(dims, dims.icells, dims.jgc, dims.kcells, type);
+    northsouthface = createBlock(dims, dims.imax, dims.jgc, dims.kmax, type);
+  }
+
+  Master &master = Master::getInstance();
+  master.printMessage("Constructed BoundaryCyclic\n");
+}
+
+template<class T, class TF>
+inline BoundaryCyclic<T,TF>::~BoundaryCyclic()
+{
+  if(eastwestedge != MPI_DATATYPE_NULL)
+  {
+    MPI_Type_free(&eastwestedge);
+    MPI_Type_free(&eastwestface);
+  }
+  if(northsouthedge != MPI_DATATYPE_NULL)
+  {
+    MPI_Type_free(&northsouthedge);
+    MPI_Type_free(&northsouthface);
+  }
+
+  Master &master = Master::getInstance();
+  master.printMessage("Destructed BoundaryCyclic\n");
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::exchange(TF * const data, MPI_Datatype eastwest, MPI_Datatype northsouth, const bool faces)
+{
+  Master &master = Master::getInstance();
+  const GridDims &dims = grid.getDims();
+
+  // the faces start at the first interior point, the edges at the first cell
+  const long jk = faces ? dims.jstart*dims.icells + dims.kstart*dims.ijcells : 0;
+  const long ik = faces ? dims.istart + dims.kstart*dims.ijcells : 0;
+
+  if(eastwest != MPI_DATATYPE_NULL)
+  {
+    const long westin  = jk;
+    const long westout = jk + dims.istart;
+    const long eastin  = jk + dims.iend;
+    const long eastout = jk + dims.iend - dims.igc;
+
+    reqs.push_back(MPI_Request());
+    MPI_Isend(&data[eastout], 1, eastwest, master.neast, 1, master.commxy, &reqs.back());
+    reqs.push_back(MPI_Request());
+    MPI_Irecv(&data[westin ], 1, eastwest, master.nwest, 1, master.commxy, &reqs.back());
+    reqs.push_back(MPI_Request());
+    MPI_Isend(&data[westout], 1, eastwest, master.nwest, 2, master.commxy, &reqs.back());
+    reqs.push_back(MPI_Request());
+    MPI_Irecv(&data[eastin ], 1, eastwest, master.neast, 2, master.commxy, &reqs.back());
+  }
+
+  if(northsouth != MPI_DATATYPE_NULL)
+  {
+    const long southin  = ik;
+    const long southout = ik + dims.jstart*dims.icells;
+    const long northin  = ik + dims.jend*dims.icells;
+    const long northout = ik + (dims.jend - dims.jgc)*dims.icells;
+
+    reqs.push_back(MPI_Request());
+    MPI_Isend(&data[northout], 1, northsouth, master.nnorth, 3, master.commxy, &reqs.back());
+    reqs.push_back(MPI_Request());
+    MPI_Irecv(&data[southin ], 1, northsouth, master.nsouth, 3, master.commxy, &reqs.back());
+    reqs.push_back(MPI_Request());
+    MPI_Isend(&data[southout], 1, northsouth, master.nsouth, 4, master.commxy, &reqs.back());
+    reqs.push_back(MPI_Request());
+    MPI_Irecv(&data[northin ], 1, northsouth, master.nnorth, 4, master.commxy, &reqs.back());
+  }
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::waitAll()
+{
+  MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+  reqs.clear();
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::exec(Field<TF,T> &field)
+{
+  TF *data = field.data.data();
+
+  // first east-west, then north-south including the east-west ghost cells
+  // and finally the complete vertical planes, so that the corners are filled
+  exchange(data, eastwestedge, MPI_DATATYPE_NULL, false);
+  waitAll();
+  exchange(data, MPI_DATATYPE_NULL, northsouthedge, false);
+  waitAll();
+  execVertical(data);
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::start(Field<TF,T> &field)
+{
+  TF *data = field.data.data();
+
+  execVertical(data);
+  exchange(data, eastwestface, northsouthface, true);
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::finish()
+{
+  waitAll();
+}
+#else
+template<class T, class TF>
+inline BoundaryCyclic<T,TF>::BoundaryCyclic(Grid<T> &gridin) :
+  grid(gridin)
+{
+  Master &master = Master::getInstance();
+  master.printMessage("Constructed BoundaryCyclic\n");
+}
+
+template<class T, class TF>
+inline BoundaryCyclic<T,TF>::~BoundaryCyclic()
+{
+  Master &master = Master::getInstance();
+  master.printMessage("Destructed BoundaryCyclic\n");
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::execEastWest(TF * const data, const long jstart, const long jend, const long kstart, const long kend)
+{
+  const GridDims &dims = grid.getDims();
+
+  for(long k=kstart; k<kend; ++k)
+    for(long j=jstart; j<jend; ++j)
+      for(long i=0; i<dims.igc; ++i)
+      {
+        const long ijk = i + j*dims.icells + k*dims.ijcells;
+        data[ijk+dims.istart-dims.igc] = data[ijk+dims.iend-dims.igc];
+        data[ijk+dims.iend           ] = data[ijk+dims.istart        ];
+      }
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::execNorthSouth(TF * const data, const long istart, const long iend, const long kstart, const long kend)
+{
+  const GridDims &dims = grid.getDims();
+
+  for(long k=kstart; k<kend; ++k)
+    for(long j=0; j<dims.jgc; ++j)
+      for(long i=istart; i<iend; ++i)
+      {
+        const long ijk = i + j*dims.icells + k*dims.ijcells;
+        data[ijk+(dims.jstart-dims.jgc)*dims.icells] = data[ijk+(dims.jend-dims.jgc)*dims.icells];
+        data[ijk+ dims.jend            *dims.icells] = data[ijk+ dims.jstart        *dims.icells];
+      }
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::exec(Field<TF,T> &field)
+{
+  const GridDims &dims = grid.getDims();
+  TF *data = field.data.data();
+
+  execEastWest(data, 0, dims.jcells, 0, dims.kcells);
+  execNorthSouth(data, 0, dims.icells, 0, dims.kcells);
+  execVertical(data);
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::start(Field<TF,T> &field)
+{
+  const GridDims &dims = grid.getDims();
+  TF *data = field.data.data();
+
+  // without MPI nothing is in flight, so the faces are filled directly
+  execVertical(data);
+  execEastWest(data, dims.jstart, dims.jend, dims.kstart, dims.kend);
+  execNorthSouth(data, dims.istart, dims.iend, dims.kstart, dims.kend);
+}
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::finish()
+{
+}
+#endif
+
+template<class T, class TF>
+inline void BoundaryCyclic<T,TF>::execVertical(TF * const data)
+{
+  const GridDims &dims = grid.getDims();
+
+  for(long k=0; k<dims.kgc; ++k)
+  {
+    copyvec(&data[(dims.kstart-dims.kgc+k)*dims.ijcells], &data[(dims.kend-dims.kgc+k)*dims.ijcells], dims.ijcells);
+    copyvec(&data[(dims.kend           +k)*dims.ijcells], &data[(dims.kstart       +k)*dims.ijcells], dims.ijcells);
+  }
+}
+#endif
@@ -0,0 +1,472 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CHUNKEDFILE
+#define CHUNKEDFILE
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldFile.h"
+#include "ThreadPool.h"
+
+enum ChunkCodec { CodecNone, CodecZlib };
+
+// Layout and compression of the chunks of a chunked file. The shuffle
+// filter stores byte n of all values of a chunk together, which groups the
+// exponents and leading bytes of the mantissas of smooth fields and makes
+// them compress much better. Level 1 of zlib is its fastest level.
+struct ChunkSettings
+{
+  long isize;
+  long jsize;
+  long ksize;
+  ChunkCodec codec;
+  int level;
+  bool shuffle;
+
+  ChunkSettings() : isize(64), jsize(64), ksize(64), codec(CodecZlib), level(1), shuffle(true) {}
+};
+
+// Compressed files of the interior of a Field, stored in bricks of chunks
+// that are compressed independently. The header is followed by an index
+// with the offset and the size of every chunk, such that a block of the
+// Field can be read from the chunks it overlaps only. The chunks are
+// compressed and decompressed in parallel with the ThreadPool. As with
+// Field files, every process has its own file when the grid is decomposed.
+struct ChunkedFileHeader
+{
+  char magic[8];
+  std::int64_t version;
+  std::int64_t typesize;
+  std::int64_t isfloat;
+
+  std::int64_t itot, jtot, ktot;
+  std::int64_t imax, jmax, kmax;
+  std::int64_t ioffset, joffset;
+
+  std::int64_t isize, jsize, ksize;
+  std::int64_t codec;
+  std::int64_t shuffle;
+};
+
+struct ChunkedFileIndex
+{
+  std::int64_t offset;
+  std::int64_t size;
+};
+
+template<class T, class TG>
+void saveChunkedField(const Field<T,TG> &, const std::string, const ChunkSettings &settings=ChunkSettings());
+
+// Read the interior of the Field, the ghost cells are not changed.
+template<class T, class TG>
+void loadChunkedField(Field<T,TG> &, const std::string);
+
+// Read the block [istart, iend) x [jstart, jend) x [kstart, kend) of the
+// interior of the subdomain, in indices that start at 0 at the first interior
+// point, into an array with i as the fastest index. Returns the number of
+// chunks that were read.
+template<class T, class TG>
+long loadChunkedBlock(std::vector<T> &, Grid<TG> &, const std::string,
+                      long, long, long, long, long, long);
+
+
+// IMPLEMENTATION BELOW
+namespace
+{
+  const char chunkedfilemagic[8] = {'B', 'D', 'G', 'C', 'H', 'U', 'N', 'K'};
+  const std::int64_t chunkedfileversion = 1;
+
+  // The chunk layout of a subdomain and the extent of each chunk.
+  struct ChunkLayout
+  {
+    long isize, jsize, ksize;
+    long nichunks, njchunks, nkchunks;
+
+    ChunkLayout(const ChunkedFileHeader &header) :
+      isize(header.isize), jsize(header.jsize), ksize(header.ksize),
+      nichunks((header.imax + isize - 1) / isize),
+      njchunks((header.jmax + jsize - 1) / jsize),
+      nkchunks((header.kmax + ksize - 1) / ksize) {}
+
+    long getNchunks() const { return nichunks*njchunks*nkchunks; }
+  };
+
+  // Copy a chunk out of or into the interior of a Field, or any other array
+  // with the given strides. The chunk is stored with i as the fastest index.
+  template<typename T>
+  inline void gatherChunk(T * const restrict chunk, const T * const restrict data,
+                          const long ni, const long nj, const long nk, const long jj, const long kk)
+  {
+    for(long k=0; k<nk; ++k)
+      for(long j=0; j<nj; ++j)
+        std::memcpy(&chunk[j*ni + k*ni*nj], &data[j*jj + k*kk], ni*sizeof(T));
+  }
+
+  template<typename T>
+  inline void scatterChunk(T * const restrict data, const T * const restrict chunk,
+                           const long ni, const long nj, const long nk, const long jj, const long kk)
+  {
+    for(long k=0; k<nk; ++k)
+      for(long j=0; j<nj; ++j)
+        std::memcpy(&data[j*jj + k*kk], &chunk[j*ni + k*ni*nj], ni*sizeof(T));
+  }
+
+  inline void shuffleBytes(char * const restrict out, const char * const restrict in, const long n, const long size)
+  {
+    for(long b=0; b<size; ++b)
+      for(long e=0; e<n; ++e)
+        out[b*n + e] = in[e*size + b];
+  }
+
+  inline void unshuffleBytes(char * const restrict out, const char * const restrict in, const long n, const long size)
+  {
+    for(long b=0; b<size; ++b)
+      for(long e=0; e<n; ++e)
+        out[e*size + b] = in[b*n + e];
+  }
+
+  template<typename T>
+  inline void compressChunk(std::vector<char> &out, const T * const chunk, const long n,
+                            const ChunkSettings &settings)
+  {
+    const long bytes = n*sizeof(T);
+    std::vector<char> shuffled;
+    const char *in = reinterpret_cast<const char *>(chunk);
+    if(settings.shuffle)
+    {
+      shuffled.resize(bytes);
+      shuffleBytes(shuffled.data(), in, n, sizeof(T));
+      in = shuffled.data();
+    }
+
+    if(settings.codec == CodecNone)
+    {
+      out.assign(in, in + bytes);
+      return;
+    }
+
+    uLongf size = compressBound(bytes);
+    out.resize(size);
+    if(compress2(reinterpret_cast<Bytef *>(out.data()), &size,
+                 reinterpret_cast<const Bytef *>(in), bytes, settings.level) != Z_OK)
+    {
+      Master::getInstance().printError("ERROR cannot compress chunk\n");
+      throw 1;
+    }
+    out.resize(size);
+  }
+
+  template<typename T>
+  inline void decompressChunk(T * const chunk, std::vector<char> &in, const long n,
+                              const ChunkedFileHeader &header, const std::string &name)
+  {
+    const long bytes = n*sizeof(T);
+    // a shuffled chunk is decompressed into a buffer and unshuffled into the chunk
+    std::vector<char> shuffled;
+    char *out = reinterpret_cast<char *>(chunk);
+    if(header.shuffle)
+    {
+      shuffled.resize(bytes);
+      out = shuffled.data();
+    }
+
+    bool success = true;
+    if(header.codec == CodecNone)
+    {
+      success = static_cast<long>(in.size()) == bytes;
+      if(success)
+        std::memcpy(out, in.data(), bytes);
+    }
+    else
+    {
+      uLongf size = bytes;
+      success = uncompress(reinterpret_cast<Bytef *>(out), &size,
+                           reinterpret_cast<const Bytef *>(in.data()), in.size()) == Z_OK &&
+                static_cast<long>(size) == bytes;
+    }
+
+    if(!success)
+    {
+      Master::getInstance().printError("ERROR corrupt chunk in " + name + "\n");
+      throw 1;
+    }
+
+    if(header.shuffle)
+      unshuffleBytes(reinterpret_cast<char *>(chunk), out, n, sizeof(T));
+  }
+
+  template<typename T>
+  ChunkedFileHeader createChunkedFileHeader(const GridDims &dims)
+  {
+    ChunkedFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, chunkedfilemagic, sizeof(header.magic));
+    header.version  = chunkedfileversion;
+    header.typesize = sizeof(T);
+    header.isfloat  = static_cast<T>(0.5) != static_cast<T>(0);
+
+    header.itot = dims.itot; header.jtot = dims.jtot; header.ktot = dims.ktot;
+    header.imax = dims.imax; header.jmax = dims.jmax; header.kmax = dims.kmax;
+    header.ioffset = dims.ioffset; header.joffset = dims.joffset;
+    return header;
+  }
+
+  // Open a chunked file of type T on the grid and read its header and index.
+  template<typename T>
+  int openChunkedFile(ChunkedFileHeader &header, std::vector<ChunkedFileIndex> &index,
+                      const GridDims &dims, const std::string &name)
+  {
+    Master &master = Master::getInstance();
+
+    const int fd = open(name.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+      master.printError("ERROR cannot open " + name + "\n");
+      throw 1;
+    }
+
+    try
+    {
+      readBytes(fd, reinterpret_cast<char *>(&header), sizeof(header), 0, name);
+
+      const ChunkedFileHeader ref = createChunkedFileHeader<T>(dims);
+      if(std::memcmp(header.magic, ref.magic, sizeof(ref.magic)) != 0 || header.version != ref.version)
+      {
+        master.printError("ERROR " + name + " is not a chunked Field file\n");
+        throw 1;
+      }
+
+      if(header.typesize != ref.typesize || header.isfloat != ref.isfloat)
+      {
+        master.printError("ERROR the type of the data in " + name + " does not match the Field\n");
+        throw 1;
+      }
+
+      if(std::memcmp(&header.itot, &ref.itot, offsetof(ChunkedFileHeader, isize) - offsetof(ChunkedFileHeader, itot)) != 0)
+      {
+        std::ostringstream message;
+        message << "ERROR the dimensions of " << name << " (" << header.itot << ", " << header.jtot << ", " << header.ktot
+                << ") do not match the grid\n";
+        master.printError(message.str());
+        throw 1;
+      }
+
+      index.resize(ChunkLayout(header).getNchunks());
+      readBytes(fd, reinterpret_cast<char *>(index.data()), index.size()*sizeof(ChunkedFileIndex), sizeof(header), name);
+    }
+    catch (...)
+    {
+      close(fd);
+      throw;
+    }
+
+    return fd;
+  }
+
+  // Read the chunks of the file that overlap the block and pass each with
+  // its offset in the subdomain to f, in parallel.
+  template<typename T, class F>
+  long readChunks(const GridDims &dims, const std::string &name,
+                  const long istart, const long iend, const long jstart, const long jend,
+                  const long kstart, const long kend, F f)
+  {
+    ChunkedFileHeader header;
+    std::vector<ChunkedFileIndex> index;
+    const int fd = openChunkedFile<T>(header, index, dims, name);
+    const ChunkLayout layout(header);
+
+    // the range of chunks that overlap the block
+    const long ci0 = istart / layout.isize, ci1 = (iend + layout.isize - 1) / layout.isize;
+    const long cj0 = jstart / layout.jsize, cj1 = (jend + layout.jsize - 1) / layout.jsize;
+    const long ck0 = kstart / layout.ksize, ck1 = (kend + layout.ksize - 1) / layout.ksize;
+    const long ni = ci1 - ci0, nj = cj1 - cj0, nk = ck1 - ck0;
+
+    try
+    {
+      ThreadPool &pool = ThreadPool::getInstance();
+      pool.parallelFor(0, ni*nj*nk, 1, [&](const long begin, const long end)
+      {
+        std::vector<char> compressed;
+        std::vector<T> chunk;
+        for(long n=begin; n<end; ++n)
+        {
+          const long ci = ci0 + n%ni;
+          const long cj = cj0 + (n/ni)%nj;
+          const long ck = ck0 + n/(ni*nj);
+          const ChunkedFileIndex &entry = index[ci + cj*layout.nichunks + ck*layout.nichunks*layout.njchunks];
+
+          const long i0 = ci*layout.isize, j0 = cj*layout.jsize, k0 = ck*layout.ksize;
+          const long cni = std::min(layout.isize, dims.imax - i0);
+          const long cnj = std::min(layout.jsize, dims.jmax - j0);
+          const long cnk = std::min(layout.ksize, dims.kmax - k0);
+
+          compressed.resize(entry.size);
+          readBytes(fd, compressed.data(), entry.size, entry.offset, name);
+          chunk.resize(cni*cnj*cnk);
+          decompressChunk(chunk.data(), compressed, chunk.size(), header, name);
+          f(chunk.data(), i0, j0, k0, cni, cnj, cnk);
+        }
+      });
+    }
+    catch (...)
+    {
+      close(fd);
+      throw;
+    }
+
+    close(fd);
+    return ni*nj*nk;
+  }
+}
+
+template<class T, class TG>
+inline void saveChunkedField(const Field<T,TG> &field, const std::string filename, const ChunkSettings &settings)
+{
+  Master &master = Master::getInstance();
+  const std::string name = getFieldFileName(filename);
+  const GridDims &dims = field.getGrid().getDims();
+
+  ChunkedFileHeader header = createChunkedFileHeader<T>(dims);
+  header.isize = std::max(settings.isize, 1L);
+  header.jsize = std::max(settings.jsize, 1L);
+  header.ksize = std::max(settings.ksize, 1L);
+  header.codec = settings.codec;
+  header.shuffle = settings.shuffle;
+
+  const ChunkLayout layout(header);
+  const long nchunks = layout.getNchunks();
+
+  // compress all chunks in parallel, then write them in order
+  std::vector<std::vector<char> > compressed(nchunks);
+  const T *data = field.data.data();
+
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, nchunks, 1, [&](const long begin, const long end)
+  {
+    std::vector<T> chunk;
+    for(long n=begin; n<end; ++n)
+    {
+      const long i0 = (n%layout.nichunks)*layout.isize;
+      const long j0 = ((n/layout.nichunks)%layout.njchunks)*layout.jsize;
+      const long k0 = (n/(layout.nichunks*layout.njchunks))*layout.ksize;
+      const long ni = std::min(layout.isize, dims.imax - i0);
+      const long nj = std::min(layout.jsize, dims.jmax - j0);
+      const long nk = std::min(layout.ksize, dims.kmax - k0);
+
+      chunk.resize(ni*nj*nk);
+      gatherChunk(chunk.data(), &data[dims.istart+i0 + (dims.jstart+j0)*dims.icells + (dims.kstart+k0)*dims.ijcells],
+                  ni, nj, nk, dims.icells, dims.ijcells);
+      compressChunk(compressed[n], chunk.data(), chunk.size(), settings);
+    }
+  });
+
+  std::vector<ChunkedFileIndex> index(nchunks);
+  std::int64_t offset = sizeof(header) + nchunks*sizeof(ChunkedFileIndex);
+  for(long n=0; n<nchunks; ++n)
+  {
+    index[n].offset = offset;
+    index[n].size = compressed[n].size();
+    offset += index[n].size;
+  }
+
+  std::FILE *file = std::fopen(name.c_str(), "wb");
+  if(!file)
+  {
+    master.printError("ERROR cannot create " + name + "\n");
+    throw 1;
+  }
+
+  bool success =
+    std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+    std::fwrite(index.data(), sizeof(ChunkedFileIndex), nchunks, file) == static_cast<size_t>(nchunks);
+  for(long n=0; n<nchunks && success; ++n)
+    success = std::fwrite(compressed[n].data(), 1, compressed[n].size(), file) == compressed[n].size();
+
+  if(std::fclose(file) != 0 || !success)
+  {
+    master.printError("ERROR cannot write " + name + "\n");
+    throw 1;
+  }
+}
+
+template<class T, class TG>
+inline void loadChunkedField(Field<T,TG> &field, const std::string filename)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  T *data = field.data.data();
+
+  readChunks<T>(dims, getFieldFileName(filename), 0, dims.imax, 0, dims.jmax, 0, dims.kmax,
+      [&](const T *chunk, const long i0, const long j0, const long k0, const long ni, const long nj, const long nk)
+      {
+        scatterChunk(&data[dims.istart+i0 + (dims.jstart+j0)*dims.icells + (dims.kstart+k0)*dims.ijcells],
+                     chunk, ni, nj, nk, dims.icells, dims.ijcells);
+      });
+}
+
+template<class T, class TG>
+inline long loadChunkedBlock(std::vector<T> &block, Grid<TG> &grid, const std::string filename,
+                             const long istart, const long iend, const long jstart, const long jend,
+                             const long kstart, const long kend)
+{
+  const GridDims &dims = grid.getDims();
+
+  if(istart < 0 || iend > dims.imax || jstart < 0 || jend > dims.jmax || kstart < 0 || kend > dims.kmax ||
+     istart >= iend || jstart >= jend || kstart >= kend)
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR the block is not inside the subdomain\n");
+    throw 1;
+  }
+
+  const long bi = iend - istart;
+  const long bj = jend - jstart;
+  block.resize(bi*bj*(kend - kstart));
+
+  // copy the part of every chunk that overlaps the block
+  return readChunks<T>(dims, getFieldFileName(filename), istart, iend, jstart, jend, kstart, kend,
+      [&](const T *chunk, const long i0, const long j0, const long k0, const long ni, const long nj, const long nk)
+      {
+        const long is = std::max(istart, i0), ie = std::min(iend, i0 + ni);
+        const long js = std::max(jstart, j0), je = std::min(jend, j0 + nj);
+        const long ks = std::max(kstart, k0), ke = std::min(kend, k0 + nk);
+        for(long k=ks; k<ke; ++k)
+          for(long j=js; j<je; ++j)
+            std::memcpy(&block[(is-istart) + (j-jstart)*bi + (k-kstart)*bi*bj],
+                        &chunk[(is-i0) + (j-j0)*ni + (k-k0)*ni*nj], (ie-is)*sizeof(T));
+      });
+}
+#endif
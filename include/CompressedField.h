@@ -0,0 +1,595 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef COMPRESSEDFIELD
+#define COMPRESSEDFIELD
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+
+enum ErrorBound { ErrorAbsolute, ErrorRelative };
+
+// Lossy compression of the interior of a Field with a guaranteed maximum
+// error. The values are quantized to integer multiples of twice the error
+// bound, so that no value moves by more than the bound. The step is reduced
+// by the rounding of the reconstructed values to T, which is why the bound
+// cannot be below the precision of T at the largest value. The interior is
+// compressed in independent blocks of 8^3 points. Within a block, every
+// quantized value is predicted from its neighbours at i-1, j-1 and k-1
+// (the Lorenzo predictor), and the differences are stored with the
+// number of bits that the largest one of the block needs. Smooth fields
+// leave small differences that need few bits. A relative error bound is
+// relative to the range (max - min) of the Field, or to the largest absolute
+// value of a constant Field, which has no range. A Field of zeros is stored
+// exactly.
+//
+// The blocks are decompressed on access. The reductions and element-wise
+// operations decompress one block at a time per thread and never
+// decompress the whole Field.
+template<class T, class TG>
+class CompressedField
+{
+  public:
+    CompressedField(const Field<T,TG> &, double, ErrorBound=ErrorAbsolute);
+    ~CompressedField();
+
+    CompressedField(CompressedField &&) = default;
+
+    Grid<TG>& getGrid() const { return grid; }
+    const std::string& getName() const { return name; }
+
+    // the absolute error bound
+    double getErrorBound() const { return errorbound; }
+    // the size of the compressed data in bytes and the compression ratio
+    // with respect to the interior of the Field
+    long getSize() const;
+    double getRatio() const;
+
+    // The value at i, j, k of the Field, in indices with ghost cells.
+    // Every access decompresses the block of the value, so use
+    // forEachBlock to process many values.
+    T operator()(long, long, long) const;
+
+    // Decompress into the interior of a Field.
+    void decompress(Field<T,TG> &) const;
+
+    // Call f(values, istart, jstart, kstart, ni, nj, nk) in parallel for every
+    // decompressed block, of which the values are stored with i as the
+    // fastest index and the start indices start at 0 at the first interior point.
+    template<class F>
+    void forEachBlock(F) const;
+
+    // A new CompressedField of f(a) or f(a, b) for every value, with the same
+    // absolute error bound. The error of the result is the error of f on the
+    // decompressed values plus the bound. A result of which the values are too
+    // large for the bound at the precision of T is refused.
+    template<class F>
+    CompressedField<T,TG> transform(F) const;
+    template<class F>
+    CompressedField<T,TG> transform(const CompressedField &, F) const;
+
+    // Reductions over the interior on all processes, see Field.h.
+    double sum() const;
+    double mean() const;
+    T min() const;
+    T max() const;
+    double variance() const;
+
+  private:
+    Grid<TG> &grid;
+    std::string name;
+
+    double errorbound;
+    double magnitude;
+    double step;
+
+    long nbi, nbj, nbk;
+
+    // per block the quantized value of its first point, the number of bits
+    // of its differences and the offset of its bits in the stream
+    std::vector<std::int64_t> bases;
+    std::vector<unsigned char> nbits;
+    std::vector<long> offsets;
+    std::vector<std::uint64_t> stream;
+
+    CompressedField(Grid<TG> &, const std::string, double, double);
+
+    void getBlock(long, long &, long &, long &, long &, long &, long &) const;
+    void decompressBlock(long, T *) const;
+
+    template<class S>
+    void compress(S);
+
+    template<class R, class F, class M>
+    R reduceBlocks(R, F, M) const;
+};
+
+
+// IMPLEMENTATION BELOW
+namespace
+{
+  const long compressedblocksize = 8;
+  const long compressedblockcells = compressedblocksize*compressedblocksize*compressedblocksize;
+
+  inline std::uint64_t encodeZigZag(const std::int64_t v)
+  {
+    return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+  }
+
+  inline std::int64_t decodeZigZag(const std::uint64_t u)
+  {
+    return static_cast<std::int64_t>(u >> 1) ^ -static_cast<std::int64_t>(u & 1);
+  }
+
+  // the largest absolute value of the Field
+  template<class T, class TG>
+  inline double getMagnitude(const Field<T,TG> &field)
+  {
+    return std::max(std::abs(static_cast<double>(field.min())), std::abs(static_cast<double>(field.max())));
+  }
+
+  // the absolute error bound of a bound relative to the range of the Field
+  template<class T, class TG>
+  inline double getRelativeBound(const Field<T,TG> &field, const double bound)
+  {
+    const double fieldmin = static_cast<double>(field.min());
+    const double fieldmax = static_cast<double>(field.max());
+    if(fieldmax > fieldmin)
+      return bound*(fieldmax - fieldmin);
+
+    const double magnitude = std::max(std::abs(fieldmin), std::abs(fieldmax));
+    return magnitude > 0. ? bound*magnitude : std::numeric_limits<double>::min();
+  }
+
+  // the Lorenzo prediction of q at i, j, k from the points before it in the block
+  inline std::int64_t predictLorenzo(const std::int64_t * const q, const long i, const long j, const long k,
+                                     const long jj, const long kk)
+  {
+    const long ijk = i + j*jj + k*kk;
+    const std::int64_t a   = i > 0 ? q[ijk-1] : 0;
+    const std::int64_t b   = j > 0 ? q[ijk-jj] : 0;
+    const std::int64_t c   = k > 0 ? q[ijk-kk] : 0;
+    const std::int64_t ab  = i > 0 && j > 0 ? q[ijk-1-jj] : 0;
+    const std::int64_t ac  = i > 0 && k > 0 ? q[ijk-1-kk] : 0;
+    const std::int64_t bc  = j > 0 && k > 0 ? q[ijk-jj-kk] : 0;
+    const std::int64_t abc = i > 0 && j > 0 && k > 0 ? q[ijk-1-jj-kk] : 0;
+    return a + b + c - ab - ac - bc + abc;
+  }
+}
+
+template<class T, class TG>
+inline CompressedField<T,TG>::CompressedField(Grid<TG> &gridin, const std::string namein, const double errorboundin,
+                                              const double magnitudein) :
+  grid(gridin),
+  name(namein),
+  errorbound(errorboundin),
+  magnitude(magnitudein)
+{
+  Master &master = Master::getInstance();
+  const GridDims &dims = grid.getDims();
+
+  if(!(errorbound > 0.))
+  {
+    master.printError("ERROR the error bound of CompressedField " + name + " has to be positive\n");
+    throw 1;
+  }
+
+  // the reconstructed values are rounded to T, by at most half its epsilon
+  // relative to their magnitude, which is at most the largest value plus the bound
+  const double epsilon = static_cast<double>(std::numeric_limits<T>::epsilon());
+  if(errorbound < epsilon*magnitude)
+  {
+    master.printError("ERROR the error bound of CompressedField " + name + " is below the precision of its type\n");
+    throw 1;
+  }
+  const double rounding = 0.5*epsilon*(magnitude + errorbound);
+
+  // a step slightly below twice the remainder of the bound absorbs the rounding
+  // of the quantization and the reconstruction in double
+  step = 2.*(errorbound - rounding)*(1. - 1.e-6);
+
+  nbi = (dims.imax + compressedblocksize - 1) / compressedblocksize;
+  nbj = (dims.jmax + compressedblocksize - 1) / compressedblocksize;
+  nbk = (dims.kmax + compressedblocksize - 1) / compressedblocksize;
+}
+
+template<class T, class TG>
+inline CompressedField<T,TG>::CompressedField(const Field<T,TG> &field, const double bound, const ErrorBound type) :
+  CompressedField(field.getGrid(), field.getName(), type == ErrorRelative ? getRelativeBound(field, bound) : bound,
+                  getMagnitude(field))
+{
+  const GridDims &dims = grid.getDims();
+  const T *data = field.data.data();
+
+  compress([&](T *values, const long i0, const long j0, const long k0, const long ni, const long nj, const long nk)
+  {
+    for(long k=0; k<nk; ++k)
+      for(long j=0; j<nj; ++j)
+        for(long i=0; i<ni; ++i)
+          values[i + j*ni + k*ni*nj] =
+            data[dims.istart+i0+i + (dims.jstart+j0+j)*dims.icells + (dims.kstart+k0+k)*dims.ijcells];
+  });
+
+  Master &master = Master::getInstance();
+  std::ostringstream message;
+  message << "Constructed CompressedField " << name << " with ratio " << getRatio() << "\n";
+  master.printMessage(message.str());
+}
+
+template<class T, class TG>
+inline CompressedField<T,TG>::~CompressedField()
+{
+  // the data of this CompressedField has been moved to another one
+  if(offsets.empty())
+    return;
+
+  Master &master = Master::getInstance();
+  master.printMessage("Destructed CompressedField " + name + "\n");
+}
+
+template<class T, class TG>
+inline long CompressedField<T,TG>::getSize() const
+{
+  return bases.size()*sizeof(std::int64_t) + nbits.size() + offsets.size()*sizeof(long) +
+         stream.size()*sizeof(std::uint64_t);
+}
+
+template<class T, class TG>
+inline double CompressedField<T,TG>::getRatio() const
+{
+  return static_cast<double>(grid.getDims().nmax*sizeof(T)) / getSize();
+}
+
+template<class T, class TG>
+inline void CompressedField<T,TG>::getBlock(const long n, long &i0, long &j0, long &k0,
+                                            long &ni, long &nj, long &nk) const
+{
+  const GridDims &dims = grid.getDims();
+  i0 = (n%nbi)*compressedblocksize;
+  j0 = ((n/nbi)%nbj)*compressedblocksize;
+  k0 = (n/(nbi*nbj))*compressedblocksize;
+  ni = std::min(compressedblocksize, dims.imax - i0);
+  nj = std::min(compressedblocksize, dims.jmax - j0);
+  nk = std::min(compressedblocksize, dims.kmax - k0);
+}
+
+// Compress the blocks of which source(values, istart, jstart, kstart, ni, nj, nk) returns the values.
+template<class T, class TG>
+template<class S>
+inline void CompressedField<T,TG>::compress(S source)
+{
+  const long nblocks = nbi*nbj*nbk;
+  bases.resize(nblocks);
+  nbits.resize(nblocks);
+  offsets.resize(nblocks+1);
+
+  // the quantized values have to fit with their differences in 64 bits
+  const double qmax = std::ldexp(1., 58);
+  std::atomic<bool> overflow(false);
+  std::atomic<bool> imprecise(false);
+
+  // the blocks are compressed into separate streams in parallel and concatenated
+  std::vector<std::vector<std::uint64_t> > blockstreams(nblocks);
+
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, nblocks, 1, [&](const long begin, const long end)
+  {
+    T values[compressedblockcells];
+    std::int64_t q[compressedblockcells];
+    std::uint64_t r[compressedblockcells];
+
+    for(long n=begin; n<end; ++n)
+    {
+      long i0, j0, k0, ni, nj, nk;
+      getBlock(n, i0, j0, k0, ni, nj, nk);
+      source(values, i0, j0, k0, ni, nj, nk);
+
+      const long size = ni*nj*nk;
+      for(long m=0; m<size; ++m)
+      {
+        const double scaled = values[m] / step;
+        if(!(std::abs(scaled) < qmax))
+          overflow = true;
+        q[m] = std::llround(scaled);
+
+        // the values of a transform can exceed the magnitude of the step
+        if(std::abs(static_cast<double>(static_cast<T>(q[m] * step)) - static_cast<double>(values[m])) > errorbound)
+          imprecise = true;
+      }
+
+      bases[n] = q[0];
+      for(long m=0; m<size; ++m)
+        q[m] -= bases[n];
+
+      std::uint64_t rmax = 0;
+      for(long k=0; k<nk; ++k)
+        for(long j=0; j<nj; ++j)
+          for(long i=0; i<ni; ++i)
+          {
+            const long ijk = i + j*ni + k*ni*nj;
+            r[ijk] = encodeZigZag(q[ijk] - predictLorenzo(q, i, j, k, ni, ni*nj));
+            rmax |= r[ijk];
+          }
+
+      int bits = 0;
+      while(bits < 64 && (rmax >> bits) != 0)
+        ++bits;
+      nbits[n] = bits;
+
+      std::vector<std::uint64_t> &words = blockstreams[n];
+      words.assign((size*bits + 63) / 64, 0);
+      for(long m=0; m<size && bits>0; ++m)
+      {
+        const long pos = m*bits;
+        const long word = pos/64;
+        const int shift = pos%64;
+        words[word] |= r[m] << shift;
+        if(shift + bits > 64)
+          words[word+1] |= r[m] >> (64 - shift);
+      }
+    }
+  });
+
+  if(overflow)
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR the error bound of CompressedField " + name + " is too small for its values\n");
+    throw 1;
+  }
+
+  if(imprecise)
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR the error bound of CompressedField " + name + " is below the precision of its values\n");
+    throw 1;
+  }
+
+  offsets[0] = 0;
+  for(long n=0; n<nblocks; ++n)
+    offsets[n+1] = offsets[n] + blockstreams[n].size();
+
+  stream.resize(offsets[nblocks]);
+  for(long n=0; n<nblocks; ++n)
+    std::copy(blockstreams[n].begin(), blockstreams[n].end(), stream.begin() + offsets[n]);
+}
+
+template<class T, class TG>
+inline void CompressedField<T,TG>::decompressBlock(const long n, T * const values) const
+{
+  long i0, j0, k0, ni, nj, nk;
+  getBlock(n, i0, j0, k0, ni, nj, nk);
+
+  const int bits = nbits[n];
+  const std::uint64_t mask = bits == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << bits) - 1;
+  const std::uint64_t *words = &stream[offsets[n]];
+
+  std::int64_t q[compressedblockcells];
+  for(long k=0; k<nk; ++k)
+    for(long j=0; j<nj; ++j)
+      for(long i=0; i<ni; ++i)
+      {
+        const long ijk = i + j*ni + k*ni*nj;
+
+        std::uint64_t r = 0;
+        if(bits > 0)
+        {
+          const long pos = ijk*bits;
+          const long word = pos/64;
+          const int shift = pos%64;
+          r = words[word] >> shift;
+          if(shift + bits > 64)
+            r |= words[word+1] << (64 - shift);
+          r &= mask;
+        }
+
+        q[ijk] = decodeZigZag(r) + predictLorenzo(q, i, j, k, ni, ni*nj);
+        values[ijk] = static_cast<T>((q[ijk] + bases[n]) * step);
+      }
+}
+
+template<class T, class TG>
+inline T CompressedField<T,TG>::operator()(const long i, const long j, const long k) const
+{
+  const GridDims &dims = grid.getDims();
+  const long ii = i - dims.istart;
+  const long jj = j - dims.jstart;
+  const long kk = k - dims.kstart;
+  const long n = ii/compressedblocksize + (jj/compressedblocksize)*nbi + (kk/compressedblocksize)*nbi*nbj;
+
+  long i0, j0, k0, ni, nj, nk;
+  getBlock(n, i0, j0, k0, ni, nj, nk);
+
+  T values[compressedblockcells];
+  decompressBlock(n, values);
+  return values[(ii-i0) + (jj-j0)*ni + (kk-k0)*ni*nj];
+}
+
+template<class T, class TG>
+template<class F>
+inline void CompressedField<T,TG>::forEachBlock(F f) const
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, nbi*nbj*nbk, 1, [&](const long begin, const long end)
+  {
+    T values[compressedblockcells];
+    for(long n=begin; n<end; ++n)
+    {
+      long i0, j0, k0, ni, nj, nk;
+      getBlock(n, i0, j0, k0, ni, nj, nk);
+      decompressBlock(n, values);
+      f(static_cast<const T *>(values), i0, j0, k0, ni, nj, nk);
+    }
+  });
+}
+
+template<class T, class TG>
+inline void CompressedField<T,TG>::decompress(Field<T,TG> &field) const
+{
+  const GridDims &dims = grid.getDims();
+  T *data = field.data.data();
+
+  forEachBlock([&](const T *values, const long i0, const long j0, const long k0,
+                   const long ni, const long nj, const long nk)
+  {
+    for(long k=0; k<nk; ++k)
+      for(long j=0; j<nj; ++j)
+        for(long i=0; i<ni; ++i)
+          data[dims.istart+i0+i + (dims.jstart+j0+j)*dims.icells + (dims.kstart+k0+k)*dims.ijcells] =
+            values[i + j*ni + k*ni*nj];
+  });
+}
+
+template<class T, class TG>
+template<class F>
+inline CompressedField<T,TG> CompressedField<T,TG>::transform(F f) const
+{
+  CompressedField<T,TG> result(grid, name, errorbound, magnitude);
+  result.compress([&](T *values, const long i0, const long j0, const long k0,
+                      const long ni, const long nj, const long nk)
+  {
+    const long n = i0/compressedblocksize + (j0/compressedblocksize)*nbi + (k0/compressedblocksize)*nbi*nbj;
+    decompressBlock(n, values);
+    for(long m=0; m<ni*nj*nk; ++m)
+      values[m] = f(values[m]);
+  });
+  return result;
+}
+
+template<class T, class TG>
+template<class F>
+inline CompressedField<T,TG> CompressedField<T,TG>::transform(const CompressedField &b, F f) const
+{
+  const GridDims &dims = grid.getDims();
+  const GridDims &dimsb = b.grid.getDims();
+  if(dims.imax != dimsb.imax || dims.jmax != dimsb.jmax || dims.kmax != dimsb.kmax)
+  {
+    Master &master = Master::getInstance();
+    master.printError("CompressedField " + b.name + " does not match the shape of CompressedField " + name + "\n");
+    throw 1;
+  }
+
+  CompressedField<T,TG> result(grid, name, errorbound, magnitude);
+  result.compress([&](T *values, const long i0, const long j0, const long k0,
+                      const long ni, const long nj, const long nk)
+  {
+    const long n = i0/compressedblocksize + (j0/compressedblocksize)*nbi + (k0/compressedblocksize)*nbi*nbj;
+    T valuesb[compressedblockcells];
+    decompressBlock(n, values);
+    b.decompressBlock(n, valuesb);
+    for(long m=0; m<ni*nj*nk; ++m)
+      values[m] = f(values[m], valuesb[m]);
+  });
+  return result;
+}
+
+// Merge f(values, size) over all blocks. Every chunk of the thread pool is
+// one layer of blocks, so the order of the merges does not depend on the
+// number of threads.
+template<class T, class TG>
+template<class R, class F, class M>
+inline R CompressedField<T,TG>::reduceBlocks(const R init, F f, M merge) const
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  return pool.parallelReduce(0, nbi*nbj*nbk, nbi*nbj, init, [&](const long begin, const long end)
+  {
+    T values[compressedblockcells];
+    R result = init;
+    for(long n=begin; n<end; ++n)
+    {
+      long i0, j0, k0, ni, nj, nk;
+      getBlock(n, i0, j0, k0, ni, nj, nk);
+      decompressBlock(n, values);
+      result = merge(result, f(static_cast<const T *>(values), ni*nj*nk));
+    }
+    return result;
+  }, merge);
+}
+
+template<class T, class TG>
+inline double CompressedField<T,TG>::sum() const
+{
+  double result = reduceBlocks(0.,
+      [](const T *values, const long n) { return simdSum(values, n); },
+      [](const double a, const double b) { return a + b; });
+
+  Master &master = Master::getInstance();
+  master.sum(&result, 1);
+  return result;
+}
+
+template<class T, class TG>
+inline double CompressedField<T,TG>::mean() const
+{
+  return sum() / grid.getDims().ntot;
+}
+
+template<class T, class TG>
+inline T CompressedField<T,TG>::min() const
+{
+  double result = reduceBlocks(std::numeric_limits<T>::max(),
+      [](const T *values, const long n) { return simdMin(values, n); },
+      [](const T a, const T b) { return std::min(a, b); });
+
+  Master &master = Master::getInstance();
+  master.min(&result, 1);
+  return static_cast<T>(result);
+}
+
+template<class T, class TG>
+inline T CompressedField<T,TG>::max() const
+{
+  double result = reduceBlocks(std::numeric_limits<T>::lowest(),
+      [](const T *values, const long n) { return simdMax(values, n); },
+      [](const T a, const T b) { return std::max(a, b); });
+
+  Master &master = Master::getInstance();
+  master.max(&result, 1);
+  return static_cast<T>(result);
+}
+
+template<class T, class TG>
+inline double CompressedField<T,TG>::variance() const
+{
+  const T shift = static_cast<T>(mean());
+
+  double result = reduceBlocks(0.,
+      [=](const T *values, const long n) { return simdSumSquares(values, shift, n); },
+      [](const double a, const double b) { return a + b; });
+
+  Master &master = Master::getInstance();
+  master.sum(&result, 1);
+  return result / grid.getDims().ntot;
+}
+#endif
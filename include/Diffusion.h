@@ -24,12 +24,21 @@
 #ifndef DIFFUSION
 #define DIFFUSION
 
-#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
 #include "Master.h"
 #include "Field.h"
 #include "Grid.h"
+#include "ThreadPool.h"
+#include "BoundaryCyclic.h"
+#include "Stencil.h"
+#include "FieldStream.h"
 
-template<class T, class TF>
+// The stencil computes in TC, which is the ComputeType of TF, see Half.h, or
+// double. With Diffusion<double,float,double> the Fields are stored in float,
+// and the stencil loads them as float and accumulates in double.
+template<class T, class TF, class TC = typename ComputeType<TF>::type>
 class Diffusion
 {
   public:
@@ -38,81 +47,236 @@ class Diffusion
 
     virtual void exec(Field<TF,T>&, const Field<TF,T>&, bool);
 
+    // Fill the ghost cells of a with the boundary and compute the interior
+    // while the halos are in flight, then finish the boundary strips.
+    virtual void exec(Field<TF,T>&, Field<TF,T>&, BoundaryCyclic<T,TF>&, bool);
+
+    // Out-of-core variant, which streams the slabs of the files of at and a,
+    // see FieldStream.h. The stream of at needs to be StreamReadWrite.
+    virtual void exec(FieldStream<TF,T>&, FieldStream<TF,T>&, bool);
+
+    // Sweep the domain in i-j tiles that are processed over the full height,
+    // so that the k-planes the stencil reads stay resident in the cache.
+    virtual void execTiled(Field<TF,T>&, const Field<TF,T>&, bool);
+
+    // Set the tile size of execTiled, by default it is derived from the L2 cache size.
+    void setTileSize(long, long);
+    long getTileSizeI() const { return itile; }
+    long getTileSizeJ() const { return jtile; }
+
+    // Advance a over nsteps forward Euler steps, using at as work space. Every
+    // step is boundary.exec(a); at = 0; exec(at, a); a += dt*at.
+    void advance(Field<TF,T>&, Field<TF,T>&, BoundaryCyclic<T,TF>&, TF, int, bool);
+
+    // number of ghost cells the stencil reads in each direction
+    static const long stencilWidth = DiffusionStencil::width;
+
   protected:
     Grid<T> &grid;
 
   private:
-    void execDiffusion(TF* const restrict, const TF* const restrict, const GridDims, long, long);
+    long itile;
+    long jtile;
+
+    void execDiffusion(TF* const restrict, const TF* const restrict, const GridDims,
+                       long, long, long, long, long, long);
+    void execRange(Field<TF,T>&, const Field<TF,T>&, long, long, long, long, bool);
 };
 
 // IMPLEMENTATION BELOW
-template<class T, class TF>
-inline Diffusion<T,TF>::Diffusion(Grid<T> &gridin) :
+template<class T, class TF, class TC>
+const long Diffusion<T,TF,TC>::stencilWidth;
+
+template<class T, class TF, class TC>
+inline Diffusion<T,TF,TC>::Diffusion(Grid<T> &gridin) :
   grid(gridin)
 {
   Master &master = Master::getInstance();
+
+  const GridDims &dims = grid.getDims();
+  if(dims.igc < stencilWidth || dims.jgc < stencilWidth || dims.kgc < stencilWidth)
+  {
+    master.printError("Diffusion requires at least 3 ghost cells\n");
+    throw 1;
+  }
+
+  // The tiles are swept over k, which keeps 7 planes of a and one of at in
+  // use. Size the tiles such that these fill about half of the L2 cache and
+  // prefer full rows, as these give the longest vectorizable loops.
+  long cachesize = 256*1024;
+  #ifdef _SC_LEVEL2_CACHE_SIZE
+  if(sysconf(_SC_LEVEL2_CACHE_SIZE) > 0)
+    cachesize = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  #endif
+
+  const long w = stencilWidth;
+  const long budget = cachesize / (2*8*sizeof(TF));
+
+  long itilein = dims.imax;
+  long jtilein = budget / (itilein + 2*w) - 2*w;
+  if(jtilein < 8)
+  {
+    itilein = std::max(16L, (static_cast<long>(std::sqrt(static_cast<double>(budget))) - 2*w) / 8 * 8);
+    jtilein = budget / (itilein + 2*w) - 2*w;
+  }
+  setTileSize(itilein, jtilein);
+
   master.printMessage("Constructed Diffusion\n");
 }
 
-template<class T, class TF>
-inline void Diffusion<T,TF>::execDiffusion(TF * const restrict at, const TF * const restrict a, const GridDims dims, const long kstart, const long kend)
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::setTileSize(const long itilein, const long jtilein)
 {
-  const long ii1 = 1;
-  const long ii2 = 2;
-  const long ii3 = 3;
-  const long jj1 = 1*dims.icells;
-  const long jj2 = 2*dims.icells;
-  const long jj3 = 3*dims.icells;
-  const long kk1 = 1*dims.ijcells;
-  const long kk2 = 2*dims.ijcells;
-  const long kk3 = 3*dims.ijcells;
-
-  const T c0 = -1460./576.;
-  const T c1 =   783./576.;
-  const T c2 =   -54./576.;
-  const T c3 =     1./576.;
-
-  for(long k=kstart; k<kend; ++k)
-    for(long j=dims.jstart; j<dims.jend; ++j)
-      for(long i=dims.istart; i<dims.iend; ++i)
-      {
-        const long ijk = i + j*jj1 + k*kk1;
-        at[ijk] += c3*a[ijk-ii3] + c2*a[ijk-ii2] + c1*a[ijk-ii1] + c0*a[ijk] 
-                 + c3*a[ijk+ii1] + c2*a[ijk+ii2] + c1*a[ijk+ii3]
-                 + c3*a[ijk-jj3] + c2*a[ijk-jj2] + c1*a[ijk-jj1] + c0*a[ijk] 
-                 + c3*a[ijk+jj1] + c2*a[ijk+jj2] + c1*a[ijk+jj3]
-                 + c3*a[ijk-kk3] + c2*a[ijk-kk2] + c1*a[ijk-kk1] + c0*a[ijk] 
-                 + c3*a[ijk+kk1] + c2*a[ijk+kk2] + c1*a[ijk+kk3];
-      }
+  const GridDims &dims = grid.getDims();
+  itile = std::min(std::max(itilein, 1L), dims.imax);
+  jtile = std::min(std::max(jtilein, 1L), dims.jmax);
+}
+
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::execDiffusion(TF * const restrict at, const TF * const restrict a, const GridDims dims,
+                                              const long istart, const long iend,
+                                              const long jstart, const long jend,
+                                              const long kstart, const long kend)
+{
+  const long ijk = istart + jstart*dims.icells + kstart*dims.ijcells;
+
+  const TF *in[1] = {a + ijk};
+  const TC scale[1] = {1};
+
+  // at += the diffusion stencil of a, see Stencil.h
+  execStencil<StencilAdd, StencilOperator<DiffusionStencil> >(
+      at + ijk, in, scale, iend-istart, jend-jstart, kend-kstart,
+      dims.icells, dims.ijcells, dims.icells, dims.ijcells);
 }
 
-template<class T, class TF>
-inline void Diffusion<T,TF>::exec(Field<TF,T>& at, const Field<TF,T>& a, const bool threaded)
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::execRange(Field<TF,T>& at, const Field<TF,T>& a,
+                                          const long istart, const long iend,
+                                          const long jstart, const long jend, const bool threaded)
 {
   const GridDims& dims = grid.getDims();
+  if(istart >= iend || jstart >= jend)
+    return;
+
   if (threaded)
   {
-    const int nthreads = 2;
-    const int kstep = dims.ktot / nthreads;
+    // distribute the k-slabs over the thread pool, one level per chunk
+    ThreadPool &pool = ThreadPool::getInstance();
+    pool.parallelFor(dims.kstart, dims.kend, 1, [&](const long kstart, const long kend)
+    {
+      execDiffusion(&at.data[0], &a.data[0], dims, istart, iend, jstart, jend, kstart, kend);
+    });
+  }
+  else
+    execDiffusion(&at.data[0], &a.data[0], dims, istart, iend, jstart, jend, dims.kstart, dims.kend);
+}
+
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::exec(Field<TF,T>& at, const Field<TF,T>& a, const bool threaded)
+{
+  const GridDims& dims = grid.getDims();
+  execRange(at, a, dims.istart, dims.iend, dims.jstart, dims.jend, threaded);
+}
+
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::exec(Field<TF,T>& at, Field<TF,T>& a, BoundaryCyclic<T,TF>& boundary, const bool threaded)
+{
+  const GridDims& dims = grid.getDims();
+
+  // the interior does not read any ghost cells in the horizontal directions
+  const long ilo = std::min(dims.istart + stencilWidth, dims.iend);
+  const long ihi = std::max(dims.iend   - stencilWidth, ilo);
+  const long jlo = std::min(dims.jstart + stencilWidth, dims.jend);
+  const long jhi = std::max(dims.jend   - stencilWidth, jlo);
+
+  boundary.start(a);
+  execRange(at, a, ilo, ihi, jlo, jhi, threaded);
+  boundary.finish();
+
+  // south and north strips over the full width, then west and east strips
+  execRange(at, a, dims.istart, dims.iend, dims.jstart, jlo, threaded);
+  execRange(at, a, dims.istart, dims.iend, jhi, dims.jend, threaded);
+  execRange(at, a, dims.istart, ilo, jlo, jhi, threaded);
+  execRange(at, a, ihi, dims.iend, jlo, jhi, threaded);
+}
+
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::exec(FieldStream<TF,T>& at, FieldStream<TF,T>& a, const bool threaded)
+{
+  if(&at.getGrid() != &grid || &a.getGrid() != &grid)
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR the FieldStreams of Diffusion are not on its Grid\n");
+    throw 1;
+  }
 
-    std::vector<std::thread> threads;
+  // the slabs have the ghost cells of the full grid, so the stencil is the same
+  const GridDims& dims = a.getSlabGrid().getDims();
 
-    for (int n=0; n<nthreads; ++n)
+  streamSlabs([&](const long, Field<TF,T>& atslab, Field<TF,T>& aslab)
+  {
+    TF* const out = atslab.data.data();
+    const TF* const in = aslab.data.data();
+    if (threaded)
     {
-      const long kstart = dims.kstart + n*kstep;
-      const long kend   = dims.kstart + (n+1)*kstep;
-      threads.push_back( std::thread(&Diffusion<T,TF>::execDiffusion, this, &at.data[0], &a.data[0], dims, kstart, kend) );
+      ThreadPool &pool = ThreadPool::getInstance();
+      pool.parallelFor(dims.kstart, dims.kend, 1, [&](const long kstart, const long kend)
+      {
+        execDiffusion(out, in, dims, dims.istart, dims.iend, dims.jstart, dims.jend, kstart, kend);
+      });
     }
+    else
+      execDiffusion(out, in, dims, dims.istart, dims.iend, dims.jstart, dims.jend, dims.kstart, dims.kend);
+  }, at, a);
+}
 
-    for (std::thread& t : threads)
-      t.join();
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::execTiled(Field<TF,T>& at, const Field<TF,T>& a, const bool threaded)
+{
+  const GridDims& dims = grid.getDims();
+
+  const long nitiles = (dims.imax + itile - 1) / itile;
+  const long njtiles = (dims.jmax + jtile - 1) / jtile;
+
+  auto exectiles = [&](const long begin, const long end)
+  {
+    for(long n=begin; n<end; ++n)
+    {
+      const long istart = dims.istart + (n%nitiles)*itile;
+      const long jstart = dims.jstart + (n/nitiles)*jtile;
+      const long iend   = std::min(istart + itile, dims.iend);
+      const long jend   = std::min(jstart + jtile, dims.jend);
+      execDiffusion(&at.data[0], &a.data[0], dims, istart, iend, jstart, jend, dims.kstart, dims.kend);
+    }
+  };
+
+  if (threaded)
+  {
+    // distribute the tiles over the thread pool, one tile per chunk
+    ThreadPool &pool = ThreadPool::getInstance();
+    pool.parallelFor(0, nitiles*njtiles, 1, exectiles);
   }
   else
-    execDiffusion(&at.data[0], &a.data[0], dims, dims.kstart, dims.kend);
+    exectiles(0, nitiles*njtiles);
+}
+
+template<class T, class TF, class TC>
+inline void Diffusion<T,TF,TC>::advance(Field<TF,T>& a, Field<TF,T>& at, BoundaryCyclic<T,TF>& boundary,
+                                        const TF dt, const int nsteps, const bool threaded)
+{
+  for(int n=0; n<nsteps; ++n)
+  {
+    boundary.exec(a);
+    at = static_cast<TF>(0);
+    exec(at, a, threaded);
+    a += dt*at;
+  }
+
+  boundary.exec(a);
 }
 
-template<class T, class TF>
-inline Diffusion<T,TF>::~Diffusion()
+template<class T, class TF, class TC>
+inline Diffusion<T,TF,TC>::~Diffusion()
 {
   Master &master = Master::getInstance();
   master.printMessage("Destructed Diffusion\n");
@@ -26,6 +26,7 @@
 
 #include "Field.h"
 #include "Grid.h"
+#include "Stencil.h"
 
 template<class T, class TF>
 class DiffusionGPU
@@ -63,36 +64,22 @@ inline DiffusionGPU<TGrid,TField>::~DiffusionGPU()
 template<class TField>
 __global__ void execDiffusion(TField * __restrict__ at, TField * __restrict__ a, const GridDims dims)
 {
-  const TField c0 = -1460./576.;
-  const TField c1 =   783./576.;
-  const TField c2 =   -54./576.;
-  const TField c3 =     1./576.;
-
-  long ijk,ii1,ii2,ii3,jj1,jj2,jj3,kk1,kk2,kk3;
-  long i = blockIdx.x*blockDim.x + threadIdx.x + dims.istart;
-  long j = blockIdx.y*blockDim.y + threadIdx.y + dims.jstart;
-  long k = blockIdx.z + dims.kstart;
-
-  ii1 = 1;
-  ii2 = 2;
-  ii3 = 3;
-  jj1 = 1*dims.icells;
-  jj2 = 2*dims.icells;
-  jj3 = 3*dims.icells;
-  kk1 = 1*dims.ijcells;
-  kk2 = 2*dims.ijcells;
-  kk3 = 3*dims.ijcells;
+  const long i = blockIdx.x*blockDim.x + threadIdx.x + dims.istart;
+  const long j = blockIdx.y*blockDim.y + threadIdx.y + dims.jstart;
+  const long k = blockIdx.z + dims.kstart;
+
+  const long jj1 = 1*dims.icells;
+  const long kk1 = 1*dims.ijcells;
 
   // only perform the kernel if the coordinate is in the 3d field
   if(i < dims.iend && j < dims.jend && k < dims.kend)
   {
-    ijk = i + j*jj1 + k*kk1;
-    at[ijk] += c3*a[ijk-ii3] + c2*a[ijk-ii2] + c1*a[ijk-ii1] + c0*a[ijk] 
-             + c3*a[ijk+ii1] + c2*a[ijk+ii2] + c1*a[ijk+ii3]
-             + c3*a[ijk-jj3] + c2*a[ijk-jj2] + c1*a[ijk-jj1] + c0*a[ijk] 
-             + c3*a[ijk+jj1] + c2*a[ijk+jj2] + c1*a[ijk+jj3]
-             + c3*a[ijk-kk3] + c2*a[ijk-kk2] + c1*a[ijk-kk1] + c0*a[ijk] 
-             + c3*a[ijk+kk1] + c2*a[ijk+kk2] + c1*a[ijk+kk3];
+    const long ijk = i + j*jj1 + k*kk1;
+
+    // the same stencil as the CPU version, see Stencil.h
+    TField sum;
+    DiffusionStencil::apply(sum, a, ijk, jj1, kk1);
+    at[ijk] += sum;
   }
 }
 
@@ -105,10 +92,10 @@ inline void DiffusionGPU<TGrid,TField>::exec(thrust::device_vector<TField> &at_g
 
   const int blocki = 128;
   const int blockj = 2;
-  const int gridi = dims.itot/blocki + (dims.itot%blocki > 0);
-  const int gridj = dims.jtot/blockj + (dims.jtot%blockj > 0);
+  const int gridi = dims.imax/blocki + (dims.imax%blocki > 0);
+  const int gridj = dims.jmax/blockj + (dims.jmax%blockj > 0);
 
-  dim3 grid (gridi, gridj, dims.ktot);
+  dim3 grid (gridi, gridj, dims.kmax);
   dim3 block(blocki, blockj, 1);
 
   execDiffusion<<<grid, block>>>(at, a, dims);
@@ -25,7 +25,15 @@
 #define FIELD
 
 #include <vector>
+#include <string>
+#include <utility>
+#include <cmath>
 #include "Grid.h"
+#include "FieldExpression.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+#include "FieldStorage.h"
+#include "Random.h"
 
 #define restrict RESTRICTKEYWORD
 
@@ -34,29 +42,79 @@ class Field
 {
   public:
     Field(Grid<TG> &, const std::string);
+    // a Field of existing data, for instance a map of a file, see FieldFile.h
+    Field(Grid<TG> &, const std::string, FieldStorage<T> &&);
     virtual ~Field();
 
+    // Copies duplicate the data, moves take over the data of the other
+    // Field, which is left without data. Both require Fields of the same shape.
+    // A Field without data is given data of the shape of its Grid again when
+    // a Field, an expression or a value is assigned to it.
     Field(const Field &);
+    Field(Field &&);
     Field<T,TG>& operator= (const Field &);
+    Field<T,TG>& operator= (Field &&);
     Field<T,TG>& operator+=(const Field &);
+    Field<T,TG>& operator= (const T);
+
+    // construct and assign from expressions, see FieldExpression.h
+    template<class E> Field(const FieldExpression<E> &);
+    template<class E> Field<T,TG>& operator= (const FieldExpression<E> &);
+    // compound operators, E is a Field, an expression or a scalar
+    template<class E> Field<T,TG>& operator+=(const E &);
+    template<class E> Field<T,TG>& operator-=(const E &);
+    template<class E> Field<T,TG>& operator*=(const E &);
+    template<class E> Field<T,TG>& operator/=(const E &);
 
     T  operator()(long, long, long) const;
     T& operator()(long, long, long);
 
-    Field operator+ (const Field &) const;
+    Grid<TG>& getGrid() const { return grid; }
+    const std::string& getName() const { return name; }
+
+    // true if the Fields have the same dimensions, they may belong to different Grids
+    bool hasSameShape(const Field &) const;
+
+    // random integers in [0, base) in the interior, see Random.h for other distributions
+    void randomize(long, std::uint64_t seed=0);
 
-    void randomize(long);
+    // Reductions over the interior of the Field on all processes. The rows
+    // are reduced with the vector kernels of Simd.h and the partial results
+    // are accumulated in double, also for a Field of floats.
+    double sum() const;
+    double mean() const;
+    T min() const;
+    T max() const;
+    double variance() const;
+    double norm() const;
 
-    std::vector<T> data;
+    // allocated aligned and not initialized, or mapped from a file, see FieldStorage.h
+    typedef FieldStorage<T> Data;
+    Data data;
 
   protected:
     Grid<TG> &grid;
     std::string name;
+
+  private:
+    // the slabs of a FieldStream are reduced as the Field, see FieldStream.h
+    template<class, class> friend class FieldStream;
+
+    void allocate();
+    void checkShape(const Field &) const;
+
+    template<class R, class F, class M>
+    R reduceRows(R, F, M) const;
 };
 
 template<class T, class TG>
 Field<T,TG> createField(Grid<TG> &, const std::string);
 
+// out = in converted to the type of out, for instance to store a Field of
+// doubles as a Field of Half, see Half.h
+template<class TO, class TI, class TG>
+void convertField(Field<TO,TG> &, const Field<TI,TG> &);
+
 
 // IMPLEMENTATION BELOW
 template<class T, class TG>
@@ -66,30 +124,85 @@ inline Field<T,TG>::Field(Grid<TG> &gridin, const std::string namein)
   name = namein;
   Master &master = Master::getInstance();
 
+  allocate();
+
+  // first touch in parallel, such that the pages are placed with the threads
+  *this = static_cast<T>(0);
+
+  std::ostringstream message;
+  message << "Constructing Field " << name << "\n";
+  master.printMessage(message.str());
+}
+
+template<class T, class TG>
+inline Field<T,TG>::Field(Grid<TG> &gridin, const std::string namein, FieldStorage<T> &&datain)
+  : data(std::move(datain)), grid(gridin)
+{
+  name = namein;
+  Master &master = Master::getInstance();
+
+  if(static_cast<long>(data.size()) != grid.getncells())
+  {
+    master.printError("The data of Field " + name + " does not match the size of the Grid\n");
+    throw 1;
+  }
+
+  std::ostringstream message;
+  message << "Constructing Field " << name << "\n";
+  master.printMessage(message.str());
+}
+
+// Allocate the data without initializing it, the constructors fill it in parallel.
+template<class T, class TG>
+inline void Field<T,TG>::allocate()
+{
   try
   {
     data.resize(grid.getncells());
   }
   catch (...)
   {
+    Master &master = Master::getInstance();
     master.printError("Bad allocation\n");
     throw 1;
   }
-
-  std::ostringstream message;
-  message << "Constructing Field " << name << "\n";
-  master.printMessage(message.str());
 }
 
 template<class T, class TG>
 inline Field<T,TG>::~Field()
 {
+  // the data of this Field has been moved to another one
+  if(data.empty())
+    return;
+
   Master &master = Master::getInstance();
   std::ostringstream message;
   message << "Destructed Field " << name << "\n";
   master.printMessage(message.str());
 }
 
+template<class T, class TG>
+inline bool Field<T,TG>::hasSameShape(const Field &fieldin) const
+{
+  if(&grid == &fieldin.grid)
+    return data.size() == fieldin.data.size();
+
+  return data.size() == fieldin.data.size() && ::hasSameShape(grid.getDims(), fieldin.grid.getDims());
+}
+
+template<class T, class TG>
+inline void Field<T,TG>::checkShape(const Field &fieldin) const
+{
+  if(!hasSameShape(fieldin))
+  {
+    Master &master = Master::getInstance();
+    std::ostringstream message;
+    message << "Field " << fieldin.name << " does not match the shape of Field " << name << "\n";
+    master.printError(message.str());
+    throw 1;
+  }
+}
+
 // overloaded operators
 template<class T, class TG>
 inline Field<T,TG>::Field(const Field &fieldin)
@@ -98,31 +211,76 @@ inline Field<T,TG>::Field(const Field &fieldin)
   Master &master = Master::getInstance();
   name = "copy of " + fieldin.name;
 
-  data = fieldin.data;
+  allocate();
+  *this = fieldin;
 
   std::ostringstream message;
   message << "Constructing Field " << name << "\n";
   master.printMessage(message.str());
 }
 
+template<class T, class TG>
+inline Field<T,TG>::Field(Field &&fieldin)
+  : data(std::move(fieldin.data)), grid(fieldin.grid), name(fieldin.name)
+{
+}
+
 namespace
 {
+  // Element-wise loops are distributed over the ThreadPool in chunks of
+  // this many elements, smaller fields are processed by the calling thread.
+  const long fieldchunk = 1 << 16;
+
+  // the hand-vectorized variant is selected at runtime, see Simd.h
   template<typename T>
-  inline void copyvec(T * const restrict out, const T * const restrict in, const int size)
+  inline void copyvec(T * const restrict out, const T * const restrict in, const long size)
   {
-    for(int i=0; i<size; ++i)
-      out[i] = in[i];
+    simdCopyVec(out, in, size);
   }
 }
 
 template<class T, class TG>
 inline Field<T,TG>& Field<T,TG>::operator= (const Field &fieldin)
 {
+  if(this == &fieldin)
+    return *this;
+
+  if(data.empty())
+    allocate();
+
+  checkShape(fieldin);
+
   // non-vectorized copy
   // this->data = fieldin.data;
 
   // vectorized copy
-  copyvec(&data[0], &fieldin.data[0], data.size());
+  T *out = data.data();
+  const T *in = fieldin.data.data();
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, data.size(), fieldchunk, [=](const long begin, const long end)
+  {
+    copyvec(out+begin, in+begin, end-begin);
+  });
+
+  return *this;
+}
+
+// The name and the Grid of this Field are kept, only the data is taken over.
+template<class T, class TG>
+inline Field<T,TG>& Field<T,TG>::operator= (Field &&fieldin)
+{
+  if(this == &fieldin)
+    return *this;
+
+  // a Field without data takes over data of the shape of its Grid
+  const bool adopt = data.empty() && static_cast<long>(fieldin.data.size()) == grid.getncells() &&
+                     ::hasSameShape(grid.getDims(), fieldin.grid.getDims());
+  if(!adopt)
+    checkShape(fieldin);
+
+  // release the old data of this Field together with the moved-from vector
+  data.swap(fieldin.data);
+  Data().swap(fieldin.data);
 
   return *this;
 }
@@ -130,20 +288,27 @@ inline Field<T,TG>& Field<T,TG>::operator= (const Field &fieldin)
 namespace
 {
   template<typename T>
-  inline void copyaddvec(T * const restrict out, const T * const restrict in, const int size)
+  inline void copyaddvec(T * const restrict out, const T * const restrict in, const long size)
   {
-    for(int i=0; i<size; ++i)
-      out[i] += in[i];
+    simdCopyAddVec(out, in, size);
   }
 }
 
 template<class T, class TG>
 inline Field<T,TG>& Field<T,TG>::operator+=(const Field &fieldin)
 {
+  checkShape(fieldin);
+
   // for(int i=0; i<this->data.size(); ++i)
   //   this->data[i] += fieldin.data[i];
 
-  copyaddvec(&data[0], &fieldin.data[0], data.size());
+  T *out = data.data();
+  const T *in = fieldin.data.data();
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, data.size(), fieldchunk, [=](const long begin, const long end)
+  {
+    copyaddvec(out+begin, in+begin, end-begin);
+  });
 
   return *this;
 }
@@ -162,45 +327,239 @@ inline T& Field<T,TG>::operator()(const long i, const long j, const long k)
   return data[i + j*dims.icells + k*dims.ijcells];
 }
 
+template<class T, class TG>
+inline Field<T,TG>& Field<T,TG>::operator= (const T value)
+{
+  if(data.empty())
+    allocate();
+
+  T *out = data.data();
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, data.size(), fieldchunk, [=](const long begin, const long end)
+  {
+    for(long n=begin; n<end; ++n)
+      out[n] = value;
+  });
+
+  return *this;
+}
+
+// expression evaluation, of which the compound assignments are written out for
+// Half and BFloat16, which compute in float, see Half.h
 namespace
 {
-  template<typename T>
-  inline void addvecs(T * const restrict out, const T * const restrict a, const T * const restrict b, int size)
+  struct AssignSet      { template<class A, class B> static void apply(A &a, const B b) { a = b; } };
+  struct AssignAdd      { template<class A, class B> static void apply(A &a, const B b) { a = a + b; } };
+  struct AssignSubtract { template<class A, class B> static void apply(A &a, const B b) { a = a - b; } };
+  struct AssignMultiply { template<class A, class B> static void apply(A &a, const B b) { a = a * b; } };
+  struct AssignDivide   { template<class A, class B> static void apply(A &a, const B b) { a = a / b; } };
+
+  // The whole right hand side is evaluated in this single loop. The output
+  // is allowed to alias the operands, as every element only depends on the
+  // elements of the operands at the same index.
+  template<class Assign, typename T, class E>
+  inline void evalexpr(T * const out, const E &e, const long begin, const long end)
+  {
+    for(long n=begin; n<end; ++n)
+      Assign::apply(out[n], e.eval(n));
+  }
+
+  // The sum of two Fields is assigned with the hand-vectorized kernel.
+  template<class Assign, typename T, typename TG>
+  inline void evalexpr(T * const out, const FieldBinaryExpression<OpAdd, FieldTerm<T,TG>, FieldTerm<T,TG> > &e,
+                       const long begin, const long end)
+  {
+    if(std::is_same<Assign, AssignSet>::value)
+      simdAddVecs(out+begin, e.getLeft().getData()+begin, e.getRight().getData()+begin, end-begin);
+    else
+      for(long n=begin; n<end; ++n)
+        Assign::apply(out[n], e.eval(n));
+  }
+
+  template<class Assign, typename T, class E>
+  inline void assignexpr(FieldStorage<T> &data, const E &e)
   {
-    for(int i=0; i<size; ++i)
-      out[i] = a[i] + b[i];
+    // a scalar has no size and applies to every element
+    if(e.getSize() >= 0 && e.getSize() != static_cast<long>(data.size()))
+    {
+      Master &master = Master::getInstance();
+      master.printError("Field expression does not match the size of the Field\n");
+      throw 1;
+    }
+
+    T *out = data.data();
+    ThreadPool &pool = ThreadPool::getInstance();
+    pool.parallelFor(0, data.size(), fieldchunk, [&](const long begin, const long end)
+    {
+      evalexpr<Assign>(out, e, begin, end);
+    });
   }
 }
 
 template<class T, class TG>
-inline Field<T,TG> Field<T,TG>::operator+ (const Field<T,TG> &fieldin) const
+template<class E>
+inline Field<T,TG>::Field(const FieldExpression<E> &expression)
+  : grid(*expression.self().getGrid())
+{
+  Master &master = Master::getInstance();
+  name = "expression";
+
+  allocate();
+  assignexpr<AssignSet>(data, expression.self());
+
+  std::ostringstream message;
+  message << "Constructing Field " << name << "\n";
+  master.printMessage(message.str());
+}
+
+template<class T, class TG>
+template<class E>
+inline Field<T,TG>& Field<T,TG>::operator= (const FieldExpression<E> &expression)
+{
+  if(data.empty())
+    allocate();
+
+  assignexpr<AssignSet>(data, expression.self());
+  return *this;
+}
+
+template<class T, class TG>
+template<class E>
+inline Field<T,TG>& Field<T,TG>::operator+=(const E &expression)
+{
+  assignexpr<AssignAdd>(data, Operand<E, Field<T,TG> >::make(expression));
+  return *this;
+}
+
+template<class T, class TG>
+template<class E>
+inline Field<T,TG>& Field<T,TG>::operator-=(const E &expression)
+{
+  assignexpr<AssignSubtract>(data, Operand<E, Field<T,TG> >::make(expression));
+  return *this;
+}
+
+template<class T, class TG>
+template<class E>
+inline Field<T,TG>& Field<T,TG>::operator*=(const E &expression)
+{
+  assignexpr<AssignMultiply>(data, Operand<E, Field<T,TG> >::make(expression));
+  return *this;
+}
+
+template<class T, class TG>
+template<class E>
+inline Field<T,TG>& Field<T,TG>::operator/=(const E &expression)
+{
+  assignexpr<AssignDivide>(data, Operand<E, Field<T,TG> >::make(expression));
+  return *this;
+}
+
+// Merge f(row, imax) over all rows of the interior. Every chunk of the thread
+// pool is one plane, so the order of the merges does not depend on the number
+// of threads.
+template<class T, class TG>
+template<class R, class F, class M>
+inline R Field<T,TG>::reduceRows(const R init, F f, M merge) const
+{
+  const GridDims &dims = grid.getDims();
+  const T *in = data.data();
+
+  ThreadPool &pool = ThreadPool::getInstance();
+  return pool.parallelReduce(0, dims.jmax*dims.kmax, dims.jmax, init, [&](const long begin, const long end)
+  {
+    R result = init;
+    for(long n=begin; n<end; ++n)
+    {
+      const long j = dims.jstart + n%dims.jmax;
+      const long k = dims.kstart + n/dims.jmax;
+      result = merge(result, f(&in[dims.istart + j*dims.icells + k*dims.ijcells], dims.imax));
+    }
+    return result;
+  }, merge);
+}
+
+template<class T, class TG>
+inline double Field<T,TG>::sum() const
+{
+  double result = reduceRows(0.,
+      [](const T *row, const long n) { return simdSum(row, n); },
+      [](const double a, const double b) { return a + b; });
+
+  Master &master = Master::getInstance();
+  master.sum(&result, 1);
+  return result;
+}
+
+template<class T, class TG>
+inline double Field<T,TG>::mean() const
+{
+  return sum() / grid.getDims().ntot;
+}
+
+template<class T, class TG>
+inline T Field<T,TG>::min() const
+{
+  const GridDims &dims = grid.getDims();
+  const T first = (*this)(dims.istart, dims.jstart, dims.kstart);
+
+  double result = reduceRows(first,
+      [](const T *row, const long n) { return simdMin(row, n); },
+      [](const T a, const T b) { return std::min(a, b); });
+
+  Master &master = Master::getInstance();
+  master.min(&result, 1);
+  return static_cast<T>(result);
+}
+
+template<class T, class TG>
+inline T Field<T,TG>::max() const
 {
-  // copy the field
-  Field<T,TG> fieldout(*this);
+  const GridDims &dims = grid.getDims();
+  const T first = (*this)(dims.istart, dims.jstart, dims.kstart);
 
-  // use non-vectorized addition
-  // for(int i=0; i<data.size(); ++i)
-  //   fieldout.data[i] = data[i] + fieldin.data[i];
+  double result = reduceRows(first,
+      [](const T *row, const long n) { return simdMax(row, n); },
+      [](const T a, const T b) { return std::max(a, b); });
 
-  // use vectorized addition
-  addvecs(&fieldout.data[0], &data[0], &fieldin.data[0], data.size());
+  Master &master = Master::getInstance();
+  master.max(&result, 1);
+  return static_cast<T>(result);
+}
+
+// The variance of the whole domain, computed in two passes, as the deviations
+// from the mean do not suffer from the cancellation of sum(a^2) - sum(a)^2.
+template<class T, class TG>
+inline double Field<T,TG>::variance() const
+{
+  const T shift = static_cast<T>(mean());
 
-  return fieldout;
+  double result = reduceRows(0.,
+      [=](const T *row, const long n) { return simdSumSquares(row, shift, n); },
+      [](const double a, const double b) { return a + b; });
+
+  Master &master = Master::getInstance();
+  master.sum(&result, 1);
+  return result / grid.getDims().ntot;
 }
 
+// the L2 norm, sqrt(sum(a^2))
 template<class T, class TG>
-inline void Field<T,TG>::randomize(long base)
+inline double Field<T,TG>::norm() const
 {
-  const GridDims dims = grid.getDims();
+  double result = reduceRows(0.,
+      [](const T *row, const long n) { return simdSumSquares(row, static_cast<T>(0), n); },
+      [](const double a, const double b) { return a + b; });
+
+  Master &master = Master::getInstance();
+  master.sum(&result, 1);
+  return std::sqrt(result);
+}
 
-  // fill field with random numbers
-  for(long k=dims.kstart; k<dims.kend; ++k)
-    for(long j=dims.jstart; j<dims.jend; ++j)
-      for(long i=dims.istart; i<dims.iend; ++i)
-      {
-        long ijk = i + j*dims.icells + k*dims.ijcells;
-        data[ijk] = std::rand() % base;
-      }
+template<class T, class TG>
+inline void Field<T,TG>::randomize(const long base, const std::uint64_t seed)
+{
+  randomizeInteger(*this, Philox(seed), 0, base-1);
 }
 
 // out of class definitions
@@ -209,4 +568,23 @@ inline Field<T,TG> createField(Grid<TG> &gridin, const std::string namein)
 {
   return Field<T,TG>(gridin, namein);
 }
+
+template<class TO, class TI, class TG>
+inline void convertField(Field<TO,TG> &out, const Field<TI,TG> &in)
+{
+  if(out.data.size() != in.data.size())
+  {
+    Master &master = Master::getInstance();
+    master.printError("Field " + in.getName() + " cannot be converted into Field " + out.getName() + " of another shape\n");
+    throw 1;
+  }
+
+  TO *outptr = out.data.data();
+  const TI *inptr = in.data.data();
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, out.data.size(), fieldchunk, [=](const long begin, const long end)
+  {
+    simdConvertVec(outptr+begin, inptr+begin, end-begin);
+  });
+}
 #endif
@@ -0,0 +1,385 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIELDEXPRESSION
+#define FIELDEXPRESSION
+
+#include <cmath>
+#include <utility>
+#include <type_traits>
+#include "Grid.h"
+
+// The arithmetic operators on Fields do not compute anything themselves, but
+// build a light-weight expression tree that only holds pointers to the data
+// of the Fields involved. The tree is evaluated element by element in a single
+// loop once it is assigned to a Field, so d = a + b + c reads a, b and c once,
+// writes d once and does not allocate any temporary Field.
+
+template<class T, class TG>
+class Field;
+
+// Base class of all nodes in the expression tree.
+template<class E>
+struct FieldExpression
+{
+  const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// Leaf node that refers to the data of a Field.
+template<class T, class TG>
+class FieldTerm : public FieldExpression<FieldTerm<T,TG> >
+{
+  public:
+    typedef T  value_type;
+    typedef TG grid_type;
+
+    FieldTerm(const T *datain, Grid<TG> *gridin, const long sizein) :
+      data(datain), grid(gridin), size(sizein) {}
+
+    T eval(const long n) const { return data[n]; }
+
+    const T* getData() const { return data; }
+    Grid<TG>* getGrid() const { return grid; }
+    long getSize() const { return size; }
+
+  private:
+    const T *data;
+    Grid<TG> *grid;
+    long size;
+};
+
+// Leaf node that holds a scalar, it has no grid and no size.
+template<class T>
+class ScalarTerm : public FieldExpression<ScalarTerm<T> >
+{
+  public:
+    typedef T    value_type;
+    typedef void grid_type;
+
+    explicit ScalarTerm(const T valuein) : value(valuein) {}
+
+    T eval(const long) const { return value; }
+
+    Grid<void>* getGrid() const { return 0; }
+    long getSize() const { return -1; }
+
+  private:
+    T value;
+};
+
+// Element-wise operations.
+struct OpAdd
+{
+  template<class A, class B>
+  static auto apply(const A a, const B b) -> decltype(a+b) { return a+b; }
+};
+
+struct OpSubtract
+{
+  template<class A, class B>
+  static auto apply(const A a, const B b) -> decltype(a-b) { return a-b; }
+};
+
+struct OpMultiply
+{
+  template<class A, class B>
+  static auto apply(const A a, const B b) -> decltype(a*b) { return a*b; }
+};
+
+struct OpDivide
+{
+  template<class A, class B>
+  static auto apply(const A a, const B b) -> decltype(a/b) { return a/b; }
+};
+
+struct OpPow
+{
+  template<class A, class B>
+  static A apply(const A a, const B b) { return std::pow(a, b); }
+};
+
+struct OpNegate
+{
+  template<class A>
+  static A apply(const A a) { return -a; }
+};
+
+struct OpAbs
+{
+  template<class A>
+  static A apply(const A a) { return std::abs(a); }
+};
+
+struct OpSqrt
+{
+  template<class A>
+  static A apply(const A a) { return std::sqrt(a); }
+};
+
+struct OpExp
+{
+  template<class A>
+  static A apply(const A a) { return std::exp(a); }
+};
+
+struct OpLog
+{
+  template<class A>
+  static A apply(const A a) { return std::log(a); }
+};
+
+struct OpSin
+{
+  template<class A>
+  static A apply(const A a) { return std::sin(a); }
+};
+
+struct OpCos
+{
+  template<class A>
+  static A apply(const A a) { return std::cos(a); }
+};
+
+struct OpTanh
+{
+  template<class A>
+  static A apply(const A a) { return std::tanh(a); }
+};
+
+namespace
+{
+  // Select the grid and size of the first operand that is not a scalar.
+  template<class L, class R, bool leftIsScalar = std::is_void<typename L::grid_type>::value>
+  struct OperandShape
+  {
+    typedef typename L::grid_type grid_type;
+    static Grid<grid_type>* getGrid(const L &l, const R &) { return l.getGrid(); }
+    static long getSize(const L &l, const R &) { return l.getSize(); }
+  };
+
+  template<class L, class R>
+  struct OperandShape<L, R, true>
+  {
+    typedef typename R::grid_type grid_type;
+    static Grid<grid_type>* getGrid(const L &, const R &r) { return r.getGrid(); }
+    static long getSize(const L &, const R &r) { return r.getSize(); }
+  };
+
+  // Operands that are not scalars have to be of the same shape, otherwise
+  // the evaluation reads beyond the end of the smaller one.
+  template<class L, class R, bool hasScalar = std::is_void<typename L::grid_type>::value ||
+                                              std::is_void<typename R::grid_type>::value>
+  struct OperandCheck
+  {
+    static void check(const L &l, const R &r)
+    {
+      if(l.getSize() != r.getSize() ||
+         (static_cast<const void*>(l.getGrid()) != static_cast<const void*>(r.getGrid()) &&
+          !hasSameShape(l.getGrid()->getDims(), r.getGrid()->getDims())))
+      {
+        Master &master = Master::getInstance();
+        master.printError("The operands of a Field expression do not match in shape\n");
+        throw 1;
+      }
+    }
+  };
+
+  template<class L, class R>
+  struct OperandCheck<L, R, true>
+  {
+    static void check(const L &, const R &) {}
+  };
+}
+
+// Node that combines two operands element-wise.
+template<class Op, class L, class R>
+class FieldBinaryExpression : public FieldExpression<FieldBinaryExpression<Op,L,R> >
+{
+  public:
+    typedef decltype(Op::apply(std::declval<typename L::value_type>(),
+                               std::declval<typename R::value_type>())) value_type;
+    typedef typename OperandShape<L,R>::grid_type grid_type;
+
+    FieldBinaryExpression(const L &lin, const R &rin) : l(lin), r(rin) { OperandCheck<L,R>::check(l, r); }
+
+    value_type eval(const long n) const { return Op::apply(l.eval(n), r.eval(n)); }
+
+    const L& getLeft() const { return l; }
+    const R& getRight() const { return r; }
+
+    Grid<grid_type>* getGrid() const { return OperandShape<L,R>::getGrid(l, r); }
+    long getSize() const { return OperandShape<L,R>::getSize(l, r); }
+
+  private:
+    const L l;
+    const R r;
+};
+
+// Node that applies a function element-wise to a single operand.
+template<class Op, class E>
+class FieldUnaryExpression : public FieldExpression<FieldUnaryExpression<Op,E> >
+{
+  public:
+    typedef typename E::value_type value_type;
+    typedef typename E::grid_type  grid_type;
+
+    explicit FieldUnaryExpression(const E &ein) : e(ein) {}
+
+    value_type eval(const long n) const { return Op::apply(e.eval(n)); }
+
+    Grid<grid_type>* getGrid() const { return e.getGrid(); }
+    long getSize() const { return e.getSize(); }
+
+  private:
+    const E e;
+};
+
+// Traits that turn Fields and expressions into nodes of the tree.
+template<class X, class Enable = void>
+struct ExpressionTraits
+{
+  static const bool isExpression = false;
+};
+
+template<class T, class TG>
+struct ExpressionTraits<Field<T,TG> >
+{
+  static const bool isExpression = true;
+  typedef FieldTerm<T,TG> type;
+  static type make(const Field<T,TG> &field)
+  {
+    return type(field.data.data(), &field.getGrid(), field.data.size());
+  }
+};
+
+template<class E>
+struct ExpressionTraits<E, typename std::enable_if<std::is_base_of<FieldExpression<E>, E>::value>::type>
+{
+  static const bool isExpression = true;
+  typedef E type;
+  static const E& make(const E &e) { return e; }
+};
+
+namespace
+{
+  // An operand is either an expression, or a scalar that takes the value
+  // type of the expression it is combined with.
+  template<class X, class Other, bool isScalar = std::is_arithmetic<X>::value>
+  struct Operand
+  {
+    typedef typename ExpressionTraits<X>::type type;
+    static type make(const X &x) { return ExpressionTraits<X>::make(x); }
+  };
+
+  template<class X, class Other>
+  struct Operand<X, Other, true>
+  {
+    typedef typename ExpressionTraits<Other>::type::value_type value_type;
+    typedef ScalarTerm<value_type> type;
+    static type make(const X &x) { return type(static_cast<value_type>(x)); }
+  };
+
+  template<class Op, class L, class R, class Enable = void>
+  struct BinaryResult {};
+
+  template<class Op, class L, class R>
+  struct BinaryResult<Op, L, R,
+    typename std::enable_if<
+      (ExpressionTraits<L>::isExpression && (ExpressionTraits<R>::isExpression || std::is_arithmetic<R>::value)) ||
+      (ExpressionTraits<R>::isExpression && std::is_arithmetic<L>::value)>::type>
+  {
+    typedef FieldBinaryExpression<Op, typename Operand<L,R>::type, typename Operand<R,L>::type> type;
+    static type make(const L &l, const R &r) { return type(Operand<L,R>::make(l), Operand<R,L>::make(r)); }
+  };
+
+  template<class Op, class E, class Enable = void>
+  struct UnaryResult {};
+
+  template<class Op, class E>
+  struct UnaryResult<Op, E, typename std::enable_if<ExpressionTraits<E>::isExpression>::type>
+  {
+    typedef FieldUnaryExpression<Op, typename ExpressionTraits<E>::type> type;
+    static type make(const E &e) { return type(ExpressionTraits<E>::make(e)); }
+  };
+}
+
+// Arithmetic operators, valid for any combination of Fields, expressions and scalars.
+template<class L, class R>
+inline typename BinaryResult<OpAdd,L,R>::type operator+(const L &l, const R &r)
+{
+  return BinaryResult<OpAdd,L,R>::make(l, r);
+}
+
+template<class L, class R>
+inline typename BinaryResult<OpSubtract,L,R>::type operator-(const L &l, const R &r)
+{
+  return BinaryResult<OpSubtract,L,R>::make(l, r);
+}
+
+template<class L, class R>
+inline typename BinaryResult<OpMultiply,L,R>::type operator*(const L &l, const R &r)
+{
+  return BinaryResult<OpMultiply,L,R>::make(l, r);
+}
+
+template<class L, class R>
+inline typename BinaryResult<OpDivide,L,R>::type operator/(const L &l, const R &r)
+{
+  return BinaryResult<OpDivide,L,R>::make(l, r);
+}
+
+template<class E>
+inline typename UnaryResult<OpNegate,E>::type operator-(const E &e)
+{
+  return UnaryResult<OpNegate,E>::make(e);
+}
+
+// Element-wise math functions.
+template<class E, class S>
+inline typename std::enable_if<std::is_arithmetic<S>::value, typename BinaryResult<OpPow,E,S>::type>::type
+pow(const E &e, const S s)
+{
+  return BinaryResult<OpPow,E,S>::make(e, s);
+}
+
+template<class E>
+inline typename UnaryResult<OpAbs,E>::type abs(const E &e) { return UnaryResult<OpAbs,E>::make(e); }
+
+template<class E>
+inline typename UnaryResult<OpSqrt,E>::type sqrt(const E &e) { return UnaryResult<OpSqrt,E>::make(e); }
+
+template<class E>
+inline typename UnaryResult<OpExp,E>::type exp(const E &e) { return UnaryResult<OpExp,E>::make(e); }
+
+template<class E>
+inline typename UnaryResult<OpLog,E>::type log(const E &e) { return UnaryResult<OpLog,E>::make(e); }
+
+template<class E>
+inline typename UnaryResult<OpSin,E>::type sin(const E &e) { return UnaryResult<OpSin,E>::make(e); }
+
+template<class E>
+inline typename UnaryResult<OpCos,E>::type cos(const E &e) { return UnaryResult<OpCos,E>::make(e); }
+
+template<class E>
+inline typename UnaryResult<OpTanh,E>::type tanh(const E &e) { return UnaryResult<OpTanh,E>::make(e); }
+#endif
@@ -0,0 +1,276 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FIELDFILE
+#define FIELDFILE
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <utility>
+#include <unistd.h>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldStorage.h"
+
+// Binary files of Fields that are stored in the memory layout of the Field,
+// including the ghost cells, so that they can be mapped into memory without
+// copying, see FieldStorage.h. The file starts with a header of one page that
+// describes the type and the dimensions of the data, followed by the data.
+// When the grid is decomposed every process has its own file, of which the
+// name ends in the rank of the process. Fields on a Grid of createLocalGrid
+// are read and written with Master::setLocal, see TimeParallel.h, and are
+// whole snapshots in a single file that every process can map.
+//
+// Raw binary files without a header, as written by MicroHH, contain the
+// interior of the whole domain only. These can be mapped onto a Grid without
+// ghost cells in a run on a single process.
+struct FieldFileHeader
+{
+  char magic[8];
+  std::int64_t version;
+  std::int64_t typesize;
+  std::int64_t isfloat;
+
+  std::int64_t itot, jtot, ktot;
+  std::int64_t imax, jmax, kmax;
+  std::int64_t ioffset, joffset;
+  std::int64_t igc, jgc, kgc;
+};
+
+template<class T, class TG>
+void saveField(const Field<T,TG> &, const std::string);
+
+// Create a Field file of zeros on the grid without allocating the Field, for
+// instance as the output of a FieldStream, see FieldStream.h.
+template<class T, class TG>
+void createFieldFile(Grid<TG> &, const std::string);
+
+template<class T, class TG>
+Field<T,TG> mapField(Grid<TG> &, const std::string, MapMode=MapPrivate);
+
+template<class T, class TG>
+Field<T,TG> mapRawField(Grid<TG> &, const std::string, MapMode=MapPrivate);
+
+
+// IMPLEMENTATION BELOW
+namespace
+{
+  const char fieldfilemagic[8] = {'B', 'D', 'G', 'F', 'I', 'E', 'L', 'D'};
+  const std::int64_t fieldfileversion = 1;
+
+  // the data starts at a page boundary and at a cache line
+  const std::size_t fieldfileheadersize = 4096;
+
+  std::string getFieldFileName(const std::string filename)
+  {
+    Master &master = Master::getInstance();
+    if(master.getNprocs() == 1 || Master::isLocal())
+      return filename;
+
+    std::ostringstream name;
+    name << filename << "." << master.mpiid;
+    return name.str();
+  }
+
+  template<typename T>
+  FieldFileHeader createFieldFileHeader(const GridDims &dims)
+  {
+    FieldFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, fieldfilemagic, sizeof(header.magic));
+    header.version  = fieldfileversion;
+    header.typesize = sizeof(T);
+    header.isfloat  = static_cast<T>(0.5) != static_cast<T>(0);
+
+    header.itot = dims.itot; header.jtot = dims.jtot; header.ktot = dims.ktot;
+    header.imax = dims.imax; header.jmax = dims.jmax; header.kmax = dims.kmax;
+    header.ioffset = dims.ioffset; header.joffset = dims.joffset;
+    header.igc = dims.igc; header.jgc = dims.jgc; header.kgc = dims.kgc;
+    return header;
+  }
+
+  // pread and pwrite may transfer less than requested
+  inline void readBytes(const int fd, char *buffer, size_t size, off_t offset, const std::string &name)
+  {
+    while(size > 0)
+    {
+      const ssize_t n = pread(fd, buffer, size, offset);
+      if(n <= 0)
+      {
+        Master::getInstance().printError("ERROR cannot read " + name + "\n");
+        throw 1;
+      }
+      buffer += n;
+      size -= n;
+      offset += n;
+    }
+  }
+
+  inline void writeBytes(const int fd, const char *buffer, size_t size, off_t offset, const std::string &name)
+  {
+    while(size > 0)
+    {
+      const ssize_t n = pwrite(fd, buffer, size, offset);
+      if(n <= 0)
+      {
+        Master::getInstance().printError("ERROR cannot write " + name + "\n");
+        throw 1;
+      }
+      buffer += n;
+      size -= n;
+      offset += n;
+    }
+  }
+
+  // Check that the file is a Field file of type T on the grid with these dimensions.
+  template<typename T>
+  void checkFieldFileHeader(const GridDims &dims, const std::string name)
+  {
+    Master &master = Master::getInstance();
+
+    FieldFileHeader header;
+    std::FILE *file = std::fopen(name.c_str(), "rb");
+    if(!file)
+    {
+      master.printError("ERROR cannot open " + name + "\n");
+      throw 1;
+    }
+    const bool success = std::fread(&header, sizeof(header), 1, file) == 1;
+    std::fclose(file);
+
+    const FieldFileHeader ref = createFieldFileHeader<T>(dims);
+    if(!success || std::memcmp(header.magic, ref.magic, sizeof(ref.magic)) != 0 || header.version != ref.version)
+    {
+      master.printError("ERROR " + name + " is not a Field file\n");
+      throw 1;
+    }
+
+    if(header.typesize != ref.typesize || header.isfloat != ref.isfloat)
+    {
+      master.printError("ERROR the type of the data in " + name + " does not match the Field\n");
+      throw 1;
+    }
+
+    if(std::memcmp(&header.itot, &ref.itot, sizeof(header) - offsetof(FieldFileHeader, itot)) != 0)
+    {
+      std::ostringstream message;
+      message << "ERROR the dimensions of " << name << " (" << header.itot << ", " << header.jtot << ", " << header.ktot
+              << " with " << header.igc << " ghost cells) do not match the grid\n";
+      master.printError(message.str());
+      throw 1;
+    }
+  }
+}
+
+template<class T, class TG>
+inline void saveField(const Field<T,TG> &field, const std::string filename)
+{
+  Master &master = Master::getInstance();
+  const std::string name = getFieldFileName(filename);
+
+  std::vector<char> header(fieldfileheadersize, 0);
+  const FieldFileHeader fileheader = createFieldFileHeader<T>(field.getGrid().getDims());
+  std::memcpy(header.data(), &fileheader, sizeof(fileheader));
+
+  std::FILE *file = std::fopen(name.c_str(), "wb");
+  if(!file)
+  {
+    master.printError("ERROR cannot create " + name + "\n");
+    throw 1;
+  }
+
+  const bool success =
+    std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+    std::fwrite(field.data.data(), sizeof(T), field.data.size(), file) == field.data.size();
+
+  if(std::fclose(file) != 0 || !success)
+  {
+    master.printError("ERROR cannot write " + name + "\n");
+    throw 1;
+  }
+}
+
+template<class T, class TG>
+inline void createFieldFile(Grid<TG> &grid, const std::string filename)
+{
+  Master &master = Master::getInstance();
+  const std::string name = getFieldFileName(filename);
+
+  std::vector<char> header(fieldfileheadersize, 0);
+  const FieldFileHeader fileheader = createFieldFileHeader<T>(grid.getDims());
+  std::memcpy(header.data(), &fileheader, sizeof(fileheader));
+
+  std::FILE *file = std::fopen(name.c_str(), "wb");
+  if(!file)
+  {
+    master.printError("ERROR cannot create " + name + "\n");
+    throw 1;
+  }
+
+  // the data is a hole in the file, which reads as zeros and takes no space on disk
+  const off_t size = fieldfileheadersize + grid.getncells()*sizeof(T);
+  const bool success =
+    std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+    std::fflush(file) == 0 &&
+    ftruncate(fileno(file), size) == 0;
+
+  if(std::fclose(file) != 0 || !success)
+  {
+    master.printError("ERROR cannot write " + name + "\n");
+    throw 1;
+  }
+}
+
+template<class T, class TG>
+inline Field<T,TG> mapField(Grid<TG> &grid, const std::string filename, const MapMode mode)
+{
+  const std::string name = getFieldFileName(filename);
+  checkFieldFileHeader<T>(grid.getDims(), name);
+
+  FieldStorage<T> data = FieldStorage<T>::map(name, fieldfileheadersize, grid.getncells(), mode);
+  return Field<T,TG>(grid, filename, std::move(data));
+}
+
+template<class T, class TG>
+inline Field<T,TG> mapRawField(Grid<TG> &grid, const std::string filename, const MapMode mode)
+{
+  Master &master = Master::getInstance();
+  const GridDims &dims = grid.getDims();
+
+  if((master.getNprocs() > 1 && !Master::isLocal()) || dims.igc != 0 || dims.jgc != 0 || dims.kgc != 0)
+  {
+    master.printError("ERROR raw fields can only be mapped onto a grid without ghost cells of the whole domain\n");
+    throw 1;
+  }
+
+  FieldStorage<T> data = FieldStorage<T>::map(filename, 0, grid.getncells(), mode);
+  return Field<T,TG>(grid, filename, std::move(data));
+}
+#endif
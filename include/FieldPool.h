@@ -0,0 +1,280 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FIELDPOOL
+#define FIELDPOOL
+
+#include <cstddef>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldStorage.h"
+
+template<class T, class TG> class FieldPool;
+
+// Scratch Field of a FieldPool. The Field is used through the handle as a
+// pointer, and its data returns to the pool when the handle is destructed.
+template<class T, class TG>
+class PooledField
+{
+  public:
+    PooledField() : pool(0) {}
+    ~PooledField() { release(); }
+
+    PooledField(const PooledField &) = delete;
+    PooledField &operator=(const PooledField &) = delete;
+
+    PooledField(PooledField &&);
+    PooledField &operator=(PooledField &&);
+
+    Field<T,TG> &operator*() const { return *field; }
+    Field<T,TG> *operator->() const { return field.get(); }
+    Field<T,TG> *get() const { return field.get(); }
+
+    // return the data to the pool before the handle goes out of scope
+    void release();
+
+  private:
+    friend class FieldPool<T,TG>;
+    PooledField(FieldPool<T,TG> *, Field<T,TG> *);
+
+    FieldPool<T,TG> *pool;
+    std::unique_ptr<Field<T,TG> > field;
+};
+
+// Pool of the data of scratch Fields, such as the tendencies of a time step.
+// The data of a released Field is kept per Grid and handed out again to the
+// next Field of that Grid, which saves the allocation, the page faults and the
+// parallel first touch of a new Field. The contents of a recycled Field are
+// those of its previous use, a new Field is zero. The pool is thread safe and
+// has to outlive its Fields. The data of a Grid has to be cleared before the
+// Grid is destructed, otherwise it is only dropped when its size does not match
+// the next Grid at the same address.
+template<class T, class TG>
+class FieldPool
+{
+  public:
+    FieldPool();
+    ~FieldPool();
+
+    FieldPool(const FieldPool &) = delete;
+    FieldPool &operator=(const FieldPool &) = delete;
+
+    // a Field with recycled data if the pool has any for the Grid
+    PooledField<T,TG> get(Grid<TG> &, const std::string);
+
+    // free the data that is not in use, of all Grids or of one Grid
+    void clear();
+    void clear(const Grid<TG> &);
+
+    // Number of Fields with recycled and with new data, the highest number of
+    // Fields in use at once, the highest number of bytes in use and in the
+    // pool at once and the bytes of all recycled Fields.
+    long getHits() const { return hits; }
+    long getMisses() const { return misses; }
+    long getPeakInUse() const { return peakinuse; }
+    std::size_t getPeakBytes() const { return peakbytes; }
+    std::size_t getBytesSaved() const { return bytessaved; }
+
+    void printStatistics() const;
+
+  private:
+    friend class PooledField<T,TG>;
+    void release(Field<T,TG> &);
+
+    std::map<const Grid<TG> *, std::vector<FieldStorage<T> > > buffers;
+    mutable std::mutex mutex;
+
+    long hits;
+    long misses;
+    long inuse;
+    long peakinuse;
+    std::size_t bytes;
+    std::size_t peakbytes;
+    std::size_t bytessaved;
+};
+
+
+// IMPLEMENTATION BELOW
+template<class T, class TG>
+inline PooledField<T,TG>::PooledField(FieldPool<T,TG> *poolin, Field<T,TG> *fieldin) :
+  pool(poolin), field(fieldin)
+{
+}
+
+template<class T, class TG>
+inline PooledField<T,TG>::PooledField(PooledField &&handle) :
+  pool(handle.pool), field(std::move(handle.field))
+{
+  handle.pool = 0;
+}
+
+template<class T, class TG>
+inline PooledField<T,TG> &PooledField<T,TG>::operator=(PooledField &&handle)
+{
+  if(this != &handle)
+  {
+    release();
+    pool = handle.pool;
+    field = std::move(handle.field);
+    handle.pool = 0;
+  }
+  return *this;
+}
+
+template<class T, class TG>
+inline void PooledField<T,TG>::release()
+{
+  if(field)
+    pool->release(*field);
+
+  // the Field is left without data, so it is destructed silently
+  field.reset();
+  pool = 0;
+}
+
+template<class T, class TG>
+inline FieldPool<T,TG>::FieldPool() :
+  hits(0), misses(0), inuse(0), peakinuse(0), bytes(0), peakbytes(0), bytessaved(0)
+{
+}
+
+template<class T, class TG>
+inline FieldPool<T,TG>::~FieldPool()
+{
+  if(inuse > 0)
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR FieldPool is destructed while its Fields are in use\n");
+  }
+}
+
+template<class T, class TG>
+inline PooledField<T,TG> FieldPool<T,TG>::get(Grid<TG> &grid, const std::string name)
+{
+  const std::size_t ncells = grid.getncells();
+  FieldStorage<T> storage;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<FieldStorage<T> > &free = buffers[&grid];
+    while(!free.empty() && storage.empty())
+    {
+      // data of a destructed Grid at the same address is dropped
+      if(free.back().size() == ncells)
+        storage.swap(free.back());
+      else
+        bytes -= free.back().size()*sizeof(T);
+      free.pop_back();
+    }
+
+    if(storage.empty())
+    {
+      ++misses;
+      bytes += ncells*sizeof(T);
+      peakbytes = std::max(peakbytes, bytes);
+    }
+    else
+    {
+      ++hits;
+      bytessaved += ncells*sizeof(T);
+    }
+
+    ++inuse;
+    peakinuse = std::max(peakinuse, inuse);
+  }
+
+  // a new Field is allocated outside the lock, as its first touch is a parallel loop
+  const bool recycled = !storage.empty();
+  try
+  {
+    if(recycled)
+      return PooledField<T,TG>(this, new Field<T,TG>(grid, name, std::move(storage)));
+    else
+      return PooledField<T,TG>(this, new Field<T,TG>(grid, name));
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!recycled)
+      bytes -= ncells*sizeof(T);
+    --inuse;
+    throw;
+  }
+}
+
+template<class T, class TG>
+inline void FieldPool<T,TG>::release(Field<T,TG> &field)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  buffers[&field.getGrid()].push_back(std::move(field.data));
+  --inuse;
+}
+
+template<class T, class TG>
+inline void FieldPool<T,TG>::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for(auto &free : buffers)
+    for(const FieldStorage<T> &storage : free.second)
+      bytes -= storage.size()*sizeof(T);
+  buffers.clear();
+}
+
+template<class T, class TG>
+inline void FieldPool<T,TG>::clear(const Grid<TG> &grid)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = buffers.find(&grid);
+  if(it == buffers.end())
+    return;
+
+  for(const FieldStorage<T> &storage : it->second)
+    bytes -= storage.size()*sizeof(T);
+  buffers.erase(it);
+}
+
+template<class T, class TG>
+inline void FieldPool<T,TG>::printStatistics() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ostringstream message;
+  message << "FieldPool hits: " << hits << ", misses: " << misses
+          << ", peak in use: " << peakinuse
+          << std::fixed << std::setprecision(1)
+          << ", peak (MB): " << peakbytes*1.e-6
+          << ", saved (MB): " << bytessaved*1.e-6 << "\n";
+  Master &master = Master::getInstance();
+  master.printMessage(message.str());
+}
+#endif
@@ -0,0 +1,207 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FIELDSTORAGE
+#define FIELDSTORAGE
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Master.h"
+#include "Allocator.h"
+
+enum MapMode { MapPrivate, MapShared };
+
+// Contiguous array of the data of a Field, with the part of the interface of
+// std::vector that the Field uses. The array is either allocated with the
+// AlignedAllocator, or it is a memory map of (part of) a file, in which case
+// the pages are only read from the file when they are touched and the page
+// cache is shared with the other processes that map the file. With MapPrivate
+// the file is mapped copy-on-write: writes go to private copies of the pages
+// they touch and the file is left as it is. With MapShared the writes go to
+// the file.
+template<typename T>
+class FieldStorage
+{
+  public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+    typedef std::size_t size_type;
+
+    FieldStorage() : ptr(0), n(0), mapping(0), mappingsize(0) {}
+    ~FieldStorage() { release(); }
+
+    FieldStorage(const FieldStorage &) = delete;
+    FieldStorage &operator=(const FieldStorage &) = delete;
+
+    FieldStorage(FieldStorage &&);
+    FieldStorage &operator=(FieldStorage &&);
+
+    // Map n elements at offset bytes in the file. The file is mapped from its
+    // start, such that the offset does not have to be a multiple of the page size.
+    static FieldStorage map(const std::string, std::size_t, std::size_t, MapMode);
+
+    // Resize the allocated array, the elements that are added are not initialized.
+    void resize(std::size_t);
+    void swap(FieldStorage &);
+
+    bool isMapped() const { return mapping != 0; }
+
+    T *data() { return ptr; }
+    const T *data() const { return ptr; }
+    std::size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+
+    T &operator[](const std::size_t i) { return ptr[i]; }
+    const T &operator[](const std::size_t i) const { return ptr[i]; }
+
+    iterator begin() { return ptr; }
+    iterator end() { return ptr + n; }
+    const_iterator begin() const { return ptr; }
+    const_iterator end() const { return ptr + n; }
+
+  private:
+    T *ptr;
+    std::size_t n;
+
+    // the mapped region, which starts at a page boundary
+    void *mapping;
+    std::size_t mappingsize;
+
+    AlignedAllocator<T> allocator;
+
+    void release();
+};
+
+
+// IMPLEMENTATION BELOW
+template<typename T>
+inline FieldStorage<T>::FieldStorage(FieldStorage &&storage) :
+  ptr(storage.ptr), n(storage.n), mapping(storage.mapping), mappingsize(storage.mappingsize)
+{
+  storage.ptr = 0;
+  storage.n = 0;
+  storage.mapping = 0;
+  storage.mappingsize = 0;
+}
+
+template<typename T>
+inline FieldStorage<T> &FieldStorage<T>::operator=(FieldStorage &&storage)
+{
+  if(this != &storage)
+  {
+    release();
+    swap(storage);
+  }
+  return *this;
+}
+
+template<typename T>
+inline void FieldStorage<T>::swap(FieldStorage &storage)
+{
+  std::swap(ptr, storage.ptr);
+  std::swap(n, storage.n);
+  std::swap(mapping, storage.mapping);
+  std::swap(mappingsize, storage.mappingsize);
+}
+
+template<typename T>
+inline void FieldStorage<T>::release()
+{
+  if(mapping)
+    munmap(mapping, mappingsize);
+  else if(ptr)
+    allocator.deallocate(ptr, n);
+
+  ptr = 0;
+  n = 0;
+  mapping = 0;
+  mappingsize = 0;
+}
+
+template<typename T>
+inline void FieldStorage<T>::resize(const std::size_t nin)
+{
+  if(nin == n)
+    return;
+
+  // a resized map becomes an allocated array with the same contents
+  T *ptrin = nin > 0 ? allocator.allocate(nin) : 0;
+  if(ptr)
+    std::memcpy(ptrin, ptr, std::min(n, nin)*sizeof(T));
+
+  release();
+  ptr = ptrin;
+  n = nin;
+}
+
+template<typename T>
+inline FieldStorage<T> FieldStorage<T>::map(const std::string filename, const std::size_t offset,
+                                            const std::size_t nin, const MapMode mode)
+{
+  Master &master = Master::getInstance();
+
+  const int fd = open(filename.c_str(), mode == MapShared ? O_RDWR : O_RDONLY);
+  if(fd < 0)
+  {
+    master.printError("ERROR cannot open " + filename + "\n");
+    throw 1;
+  }
+
+  struct stat filestat;
+  if(fstat(fd, &filestat) != 0 || static_cast<std::size_t>(filestat.st_size) < offset + nin*sizeof(T))
+  {
+    close(fd);
+    master.printError("ERROR " + filename + " is too small for the data of the Field\n");
+    throw 1;
+  }
+
+  FieldStorage storage;
+  storage.mappingsize = offset + nin*sizeof(T);
+
+  // The mapping stays valid after the file is closed. A private map of a
+  // read-only file may be written, as the writes do not reach the file.
+  const int flags = mode == MapShared ? MAP_SHARED : MAP_PRIVATE;
+  void *mapping = mmap(0, storage.mappingsize, PROT_READ | PROT_WRITE, flags, fd, 0);
+  close(fd);
+
+  if(mapping == MAP_FAILED)
+  {
+    master.printError("ERROR cannot map " + filename + "\n");
+    throw 1;
+  }
+
+  storage.mapping = mapping;
+  storage.ptr = reinterpret_cast<T *>(static_cast<char *>(mapping) + offset);
+  storage.n = nin;
+
+  return storage;
+}
+#endif
@@ -0,0 +1,465 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FIELDSTREAM
+#define FIELDSTREAM
+
+#include <string>
+#include <sstream>
+#include <memory>
+#include <future>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldFile.h"
+#include "Simd.h"
+
+enum StreamMode { StreamRead, StreamWrite, StreamReadWrite };
+
+// Out-of-core processing of a Field file (see FieldFile.h) that is too large
+// for the memory. The file is processed in slabs of k-planes. Each slab is a
+// Field on a slab Grid, which has the horizontal dimensions of the full grid
+// and the number of planes of a slab. A slab includes kgc ghost planes on
+// either side, taken from the neighbouring slabs or the ghost planes of the
+// file. The operators and kernels therefore work on a slab as on the whole
+// Field. The ghost cells of the file are used as they are, so they have to
+// be filled before the file is saved. A slab and its ghost planes are a
+// contiguous part of the file, which is read with a single call.
+//
+// Every stream has two slabs. While one slab is processed, the next one is
+// read and the previous one is written in the background. StreamRead only
+// reads the slabs, StreamWrite only writes them and StreamReadWrite does
+// both. A slab of StreamWrite is not read, so it has to be filled
+// completely. Only the interior planes of a slab are written, because the
+// ghost planes belong to the neighbouring slabs. The lower ghost planes of a
+// slab are the top planes of the slab below it, so with StreamReadWrite a
+// slab is read only once the slab below is released and written, unless it
+// is acquired before. These reads do not overlap with the processing.
+template<class T, class TG>
+class FieldStream
+{
+  public:
+    // The number of planes per slab is rounded down to a divisor of kmax, so
+    // that all slabs have the same Grid. A kmax with few divisors, such as a
+    // prime, can leave much thinner slabs than requested, which is reported
+    // with a warning, as every slab costs a read, a write and a synchronization.
+    FieldStream(Grid<TG> &, const std::string, long, StreamMode=StreamRead);
+    ~FieldStream();
+
+    FieldStream(const FieldStream &) = delete;
+    FieldStream &operator=(const FieldStream &) = delete;
+
+    Grid<TG>& getGrid() const { return grid; }
+    Grid<TG>& getSlabGrid() { return slabgrid; }
+    const std::string& getName() const { return name; }
+    long getNslabs() const { return nslabs; }
+    long getSlabSize() const { return slabsize; }
+
+    // Start to read slab n in the background, with StreamReadWrite once slab
+    // n-1 is released.
+    void prefetch(long);
+    // Wait until slab n is read and return it.
+    Field<T,TG>& acquire(long);
+    // Slab n, once it is acquired.
+    Field<T,TG>& getSlab(const long n) { return *slabs[n%2]; }
+    // Start to write slab n in the background once it is processed.
+    void release(long);
+    // Wait until all reads and writes have finished.
+    void wait();
+
+    // Reductions over the interior of the whole Field, see Field.h. Each
+    // reduction is a single pass over the file.
+    double sum();
+    double mean();
+    T min();
+    T max();
+    double variance();
+    double norm();
+
+  private:
+    Grid<TG> &grid;
+    std::string name;
+    StreamMode mode;
+
+    long nslabs;
+    long slabsize;
+    Grid<TG> slabgrid;
+
+    int fd;
+
+    // slab n is processed in buffer n%2, of which the reads and writes are
+    // done in the background in the order in which they are started
+    std::unique_ptr<Field<T,TG> > slabs[2];
+    std::shared_future<void> pending[2];
+    long requested[2];
+    // last released slab and the slab of which the read waits for its release
+    long released;
+    long deferred;
+
+    void startRead(long);
+    void readSlab(long);
+    void writeSlab(long);
+
+    template<class R, class F, class M>
+    R reduceSlabs(R, F, M);
+};
+
+// Call f(koffset, slabs...) for all slabs of the streams, where koffset is
+// the index of the first interior plane of the slabs in the interior of the
+// full grid. The streams need to have the same slab size.
+template<class F, class... S>
+void streamSlabs(F, S&...);
+
+
+// IMPLEMENTATION BELOW
+namespace
+{
+  inline long getStreamSlabSize(const long kmax, const long slabsizein)
+  {
+    long slabsize = std::min(std::max(slabsizein, 1L), kmax);
+    while(kmax % slabsize != 0)
+      --slabsize;
+    return slabsize;
+  }
+
+  template<class TG>
+  inline Grid<TG> createSlabGrid(const Grid<TG> &grid, const long slabsize)
+  {
+    GridDims dims = grid.getDims();
+    dims.ktot = slabsize;
+    dims.kmax = slabsize;
+    dims.ntot = dims.itot * dims.jtot * dims.ktot;
+    dims.nmax = dims.imax * dims.jmax * dims.kmax;
+    dims.kcells = dims.kmax + 2*dims.kgc;
+    dims.ncells = dims.ijcells * dims.kcells;
+    dims.kend = dims.kmax + dims.kgc;
+
+    // the heights are those of the first slab
+    GridVars<TG> vars = grid.getVars();
+    vars.z.resize(slabsize);
+
+    return Grid<TG>(dims, vars);
+  }
+}
+
+template<class T, class TG>
+inline FieldStream<T,TG>::FieldStream(Grid<TG> &gridin, const std::string namein,
+                                      const long slabsizein, const StreamMode modein) :
+  grid(gridin),
+  name(getFieldFileName(namein)),
+  mode(modein),
+  nslabs(gridin.getDims().kmax / getStreamSlabSize(gridin.getDims().kmax, slabsizein)),
+  slabsize(getStreamSlabSize(gridin.getDims().kmax, slabsizein)),
+  slabgrid(createSlabGrid(gridin, slabsize))
+{
+  Master &master = Master::getInstance();
+
+  const long kmax = grid.getDims().kmax;
+  if(2*slabsize <= std::min(slabsizein, kmax))
+  {
+    std::ostringstream message;
+    message << "WARNING FieldStream " << namein << " is processed in slabs of " << slabsize << " instead of "
+            << slabsizein << " planes, the largest divisor of kmax = " << kmax << " that is not larger\n";
+    master.printError(message.str());
+  }
+
+  checkFieldFileHeader<T>(grid.getDims(), name);
+
+  fd = open(name.c_str(), mode == StreamRead ? O_RDONLY : O_RDWR);
+  if(fd < 0)
+  {
+    master.printError("ERROR cannot open " + name + "\n");
+    throw 1;
+  }
+
+  for(int b=0; b<2; ++b)
+  {
+    slabs[b].reset(new Field<T,TG>(slabgrid, namein + " slab"));
+    requested[b] = -1;
+  }
+  released = -1;
+  deferred = -1;
+
+  std::ostringstream message;
+  message << "Constructed FieldStream " << namein << " in " << nslabs << " slabs of " << slabsize << " planes\n";
+  master.printMessage(message.str());
+}
+
+template<class T, class TG>
+inline FieldStream<T,TG>::~FieldStream()
+{
+  // the errors of the writes that are still in flight cannot be reported anymore
+  for(int b=0; b<2; ++b)
+    if(pending[b].valid())
+      pending[b].wait();
+  close(fd);
+
+  Master &master = Master::getInstance();
+  master.printMessage("Destructed FieldStream " + name + "\n");
+}
+
+template<class T, class TG>
+inline void FieldStream<T,TG>::readSlab(const long n)
+{
+  const GridDims &dims = grid.getDims();
+  const off_t offset = fieldfileheadersize + n*slabsize*dims.ijcells*sizeof(T);
+  Field<T,TG> &slab = *slabs[n%2];
+
+  readBytes(fd, reinterpret_cast<char *>(slab.data.data()), slab.data.size()*sizeof(T), offset, name);
+}
+
+template<class T, class TG>
+inline void FieldStream<T,TG>::writeSlab(const long n)
+{
+  const GridDims &dims = grid.getDims();
+  const off_t offset = fieldfileheadersize + (dims.kstart + n*slabsize)*dims.ijcells*sizeof(T);
+  const Field<T,TG> &slab = *slabs[n%2];
+
+  writeBytes(fd, reinterpret_cast<const char *>(&slab.data[dims.kstart*dims.ijcells]),
+              slabsize*dims.ijcells*sizeof(T), offset, name);
+}
+
+template<class T, class TG>
+inline void FieldStream<T,TG>::prefetch(const long n)
+{
+  const int b = n%2;
+  if(requested[b] == n)
+    return;
+  requested[b] = n;
+
+  if(mode == StreamWrite)
+    return;
+
+  if(mode == StreamReadWrite && n > 0 && released != n-1)
+  {
+    deferred = n;
+    return;
+  }
+
+  startRead(n);
+}
+
+template<class T, class TG>
+inline void FieldStream<T,TG>::startRead(const long n)
+{
+  const int b = n%2;
+
+  // The read has to wait for the write of the slab that was in the buffer
+  // before, and with StreamReadWrite for the write of the slab below.
+  std::shared_future<void> previous = pending[b];
+  std::shared_future<void> below;
+  if(mode == StreamReadWrite && n > 0)
+    below = pending[(n-1)%2];
+
+  pending[b] = std::async(std::launch::async, [this, n, previous, below]()
+  {
+    if(previous.valid())
+      previous.get();
+    if(below.valid())
+      below.get();
+    readSlab(n);
+  }).share();
+}
+
+template<class T, class TG>
+inline Field<T,TG>& FieldStream<T,TG>::acquire(const long n)
+{
+  const int b = n%2;
+  prefetch(n);
+  if(deferred == n)
+  {
+    deferred = -1;
+    startRead(n);
+  }
+  if(pending[b].valid())
+    pending[b].get();
+  return *slabs[b];
+}
+
+template<class T, class TG>
+inline void FieldStream<T,TG>::release(const long n)
+{
+  const int b = n%2;
+  released = n;
+  if(mode == StreamRead)
+    return;
+
+  pending[b] = std::async(std::launch::async, [this, n]() { writeSlab(n); }).share();
+
+  if(deferred == n+1)
+  {
+    deferred = -1;
+    startRead(n+1);
+  }
+}
+
+template<class T, class TG>
+inline void FieldStream<T,TG>::wait()
+{
+  for(int b=0; b<2; ++b)
+    if(pending[b].valid())
+      pending[b].get();
+}
+
+template<class F, class... S>
+inline void streamSlabs(F f, S&... streams)
+{
+  Master &master = Master::getInstance();
+
+  const long nslabs[] = {streams.getNslabs()...};
+  const long slabsizes[] = {streams.getSlabSize()...};
+  for(size_t s=1; s<sizeof...(S); ++s)
+    if(nslabs[s] != nslabs[0] || slabsizes[s] != slabsizes[0])
+    {
+      master.printError("ERROR the FieldStreams do not have the same slabs\n");
+      throw 1;
+    }
+
+  // the calls are sequenced in the order of the streams by the braced lists
+  int unused0[] = {(streams.prefetch(0), 0)...};
+  (void)unused0;
+
+  for(long n=0; n<nslabs[0]; ++n)
+  {
+    int unused1[] = {(streams.acquire(n), 0)...};
+    (void)unused1;
+
+    if(n+1 < nslabs[0])
+    {
+      int unused2[] = {(streams.prefetch(n+1), 0)...};
+      (void)unused2;
+    }
+
+    f(n*slabsizes[0], streams.getSlab(n)...);
+
+    int unused3[] = {(streams.release(n), 0)...};
+    (void)unused3;
+  }
+
+  int unused4[] = {(streams.wait(), 0)...};
+  (void)unused4;
+}
+
+template<class T, class TG>
+template<class R, class F, class M>
+inline R FieldStream<T,TG>::reduceSlabs(const R init, F f, M merge)
+{
+  R result = init;
+  streamSlabs([&](const long, Field<T,TG> &slab)
+  {
+    result = merge(result, slab.reduceRows(init, f, merge));
+  }, *this);
+  return result;
+}
+
+template<class T, class TG>
+inline double FieldStream<T,TG>::sum()
+{
+  double result = reduceSlabs(0.,
+      [](const T *row, const long n) { return simdSum(row, n); },
+      [](const double a, const double b) { return a + b; });
+
+  Master &master = Master::getInstance();
+  master.sum(&result, 1);
+  return result;
+}
+
+template<class T, class TG>
+inline double FieldStream<T,TG>::mean()
+{
+  return sum() / grid.getDims().ntot;
+}
+
+template<class T, class TG>
+inline T FieldStream<T,TG>::min()
+{
+  double result = reduceSlabs(std::numeric_limits<T>::max(),
+      [](const T *row, const long n) { return simdMin(row, n); },
+      [](const T a, const T b) { return std::min(a, b); });
+
+  Master &master = Master::getInstance();
+  master.min(&result, 1);
+  return static_cast<T>(result);
+}
+
+template<class T, class TG>
+inline T FieldStream<T,TG>::max()
+{
+  double result = reduceSlabs(std::numeric_limits<T>::lowest(),
+      [](const T *row, const long n) { return simdMax(row, n); },
+      [](const T a, const T b) { return std::max(a, b); });
+
+  Master &master = Master::getInstance();
+  master.max(&result, 1);
+  return static_cast<T>(result);
+}
+
+// Field::variance makes two passes, which would read the file twice. Here the
+// deviations are taken from the mean of the first slab instead, which is close
+// enough to the mean to avoid the cancellation of sum(a^2) - sum(a)^2.
+template<class T, class TG>
+inline double FieldStream<T,TG>::variance()
+{
+  Master &master = Master::getInstance();
+
+  auto add = [](const double a, const double b) { return a + b; };
+
+  T shift = 0;
+  double sums[2] = {0., 0.};
+  streamSlabs([&](const long koffset, Field<T,TG> &slab)
+  {
+    if(koffset == 0)
+    {
+      double first = slab.reduceRows(0., [](const T *row, const long n) { return simdSum(row, n); }, add);
+      master.sum(&first, 1);
+      shift = static_cast<T>(first / slabgrid.getDims().ntot);
+    }
+
+    sums[0] += slab.reduceRows(0., [](const T *row, const long n) { return simdSum(row, n); }, add);
+    sums[1] += slab.reduceRows(0., [=](const T *row, const long n) { return simdSumSquares(row, shift, n); }, add);
+  }, *this);
+
+  master.sum(sums, 2);
+  const double ntot = grid.getDims().ntot;
+  const double deviation = sums[0]/ntot - shift;
+  return sums[1]/ntot - deviation*deviation;
+}
+
+template<class T, class TG>
+inline double FieldStream<T,TG>::norm()
+{
+  double result = reduceSlabs(0.,
+      [](const T *row, const long n) { return simdSumSquares(row, static_cast<T>(0), n); },
+      [](const double a, const double b) { return a + b; });
+
+  Master &master = Master::getInstance();
+  master.sum(&result, 1);
+  return std::sqrt(result);
+}
+#endif
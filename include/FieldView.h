@@ -0,0 +1,334 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FIELDVIEW
+#define FIELDVIEW
+
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <type_traits>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+
+// Non-owning view of an ni x nj x nk box of the data of a Field, for
+// instance a sub-volume, a cross-section, a single column or the interior
+// without the ghost cells. The rows of the box are contiguous, the rows and
+// planes are jj and kk elements apart. A view does not copy any data and
+// stays valid as long as the data it refers to. Views are copied shallowly,
+// and a view of T converts into a view of const T.
+//
+// The reductions and copies work row by row with the kernels of Simd.h and
+// are distributed over the ThreadPool in chunks of rows, whatever their
+// direction, so that cross-sections and columns are also distributed. Unlike
+// those of Field, the reductions only cover the view on this process, and
+// those other than the sum and the norm refuse an empty view. The stencils
+// of Stencil.h can be applied to views with execStencil.
+//
+// Views cannot be operands of the expressions of FieldExpression.h, which
+// index their operands as contiguous arrays of the size of a Field. An
+// element-wise operation on a view is done on its rows with forEachRow, or
+// on a copy of the view into a view of a Field with assign.
+template<class T>
+class FieldView
+{
+  public:
+    typedef typename std::remove_const<T>::type value_type;
+
+    FieldView() : ptr(0), ni(0), nj(0), nk(0), jj(0), kk(0) {}
+    FieldView(T *, long, long, long, long, long);
+    // contiguous data, for instance a buffer to copy a cross-section into
+    FieldView(T *, long, long, long);
+
+    template<class U, class = typename std::enable_if<std::is_same<const U, T>::value>::type>
+    FieldView(const FieldView<U> &view) :
+      ptr(view.getData()), ni(view.getni()), nj(view.getnj()), nk(view.getnk()), jj(view.getjj()), kk(view.getkk()) {}
+
+    T& operator()(const long i, const long j, const long k) const { return ptr[i + j*jj + k*kk]; }
+
+    T *getData() const { return ptr; }
+    long getni() const { return ni; }
+    long getnj() const { return nj; }
+    long getnk() const { return nk; }
+    long getjj() const { return jj; }
+    long getkk() const { return kk; }
+    long size() const { return ni*nj*nk; }
+
+    // true if the views have the same extents, their strides may differ
+    template<class U>
+    bool hasSameShape(const FieldView<U> &view) const
+    {
+      return ni == view.getni() && nj == view.getnj() && nk == view.getnk();
+    }
+
+    // The box [i0, i1) x [j0, j1) x [k0, k1) in the indices of this view.
+    FieldView subBox(long, long, long, long, long, long) const;
+
+    // The planes at index i, j or k, which keep an extent of one in their
+    // direction, such that sliceJ is an x-z cross-section.
+    FieldView sliceI(const long i) const { return subBox(i, i+1, 0, nj, 0, nk); }
+    FieldView sliceJ(const long j) const { return subBox(0, ni, j, j+1, 0, nk); }
+    FieldView sliceK(const long k) const { return subBox(0, ni, 0, nj, k, k+1); }
+    FieldView column(const long i, const long j) const { return subBox(i, i+1, j, j+1, 0, nk); }
+
+    // Set all elements, or copy the elements of a view of the same shape.
+    void fill(value_type) const;
+    void assign(const FieldView<const value_type> &) const;
+
+    // Call f(row, ni) for every row of the view, distributed over the ThreadPool.
+    template<class F>
+    void forEachRow(F) const;
+
+    // Merge f(row, ni) over all rows, as the reductions of Field.
+    template<class R, class F, class M>
+    R reduceRows(R, F, M) const;
+
+    // reductions over the view on this process
+    double sum() const;
+    double mean() const;
+    value_type min() const;
+    value_type max() const;
+    double variance() const;
+    double norm() const;
+
+  private:
+    T *ptr;
+    long ni, nj, nk;
+    long jj, kk;
+
+    long getRowChunk() const;
+    void checkNotEmpty() const;
+};
+
+// The view of all cells of a Field including the ghost cells, of which the
+// indices equal those of Field::operator().
+template<class T, class TG>
+FieldView<T> makeView(Field<T,TG> &);
+template<class T, class TG>
+FieldView<const T> makeView(const Field<T,TG> &);
+
+// The view of the interior of a Field, of which index 0 is the first point
+// that is not a ghost cell.
+template<class T, class TG>
+FieldView<T> makeInteriorView(Field<T,TG> &);
+template<class T, class TG>
+FieldView<const T> makeInteriorView(const Field<T,TG> &);
+
+
+// IMPLEMENTATION BELOW
+template<class T>
+inline FieldView<T>::FieldView(T * const ptrin, const long niin, const long njin, const long nkin,
+                               const long jjin, const long kkin) :
+  ptr(ptrin), ni(niin), nj(njin), nk(nkin), jj(jjin), kk(kkin)
+{
+}
+
+template<class T>
+inline FieldView<T>::FieldView(T * const ptrin, const long niin, const long njin, const long nkin) :
+  ptr(ptrin), ni(niin), nj(njin), nk(nkin), jj(niin), kk(niin*njin)
+{
+}
+
+template<class T>
+inline FieldView<T> FieldView<T>::subBox(const long i0, const long i1, const long j0, const long j1,
+                                         const long k0, const long k1) const
+{
+  if(i0 < 0 || j0 < 0 || k0 < 0 || i1 > ni || j1 > nj || k1 > nk || i0 >= i1 || j0 >= j1 || k0 >= k1)
+  {
+    Master &master = Master::getInstance();
+    std::ostringstream message;
+    message << "ERROR the box [" << i0 << ", " << i1 << ") x [" << j0 << ", " << j1 << ") x [" << k0 << ", " << k1
+            << ") is not part of the view of " << ni << " x " << nj << " x " << nk << " points\n";
+    master.printError(message.str());
+    throw 1;
+  }
+
+  return FieldView(ptr + i0 + j0*jj + k0*kk, i1-i0, j1-j0, k1-k0, jj, kk);
+}
+
+// Chunks of rows of about fieldchunk elements, see Field.h. The chunks only
+// depend on the shape of the view, so the order of the merges of the
+// reductions does not depend on the number of threads.
+template<class T>
+inline long FieldView<T>::getRowChunk() const
+{
+  return std::max(fieldchunk / std::max(ni, 1L), 1L);
+}
+
+template<class T>
+inline void FieldView<T>::checkNotEmpty() const
+{
+  if(size() == 0)
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR the reduction of an empty view\n");
+    throw 1;
+  }
+}
+
+template<class T>
+template<class F>
+inline void FieldView<T>::forEachRow(F f) const
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, nj*nk, getRowChunk(), [&](const long begin, const long end)
+  {
+    for(long n=begin; n<end; ++n)
+      f(&ptr[(n%nj)*jj + (n/nj)*kk], ni);
+  });
+}
+
+template<class T>
+template<class R, class F, class M>
+inline R FieldView<T>::reduceRows(const R init, F f, M merge) const
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  return pool.parallelReduce(0, nj*nk, getRowChunk(), init, [&](const long begin, const long end)
+  {
+    R result = init;
+    for(long n=begin; n<end; ++n)
+      result = merge(result, f(&ptr[(n%nj)*jj + (n/nj)*kk], ni));
+    return result;
+  }, merge);
+}
+
+template<class T>
+inline void FieldView<T>::fill(const value_type value) const
+{
+  forEachRow([=](value_type * const row, const long n)
+  {
+    for(long i=0; i<n; ++i)
+      row[i] = value;
+  });
+}
+
+template<class T>
+inline void FieldView<T>::assign(const FieldView<const value_type> &view) const
+{
+  if(!hasSameShape(view))
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR a view can only be assigned a view of the same shape\n");
+    throw 1;
+  }
+
+  const value_type * const in = view.getData();
+  const long injj = view.getjj();
+  const long inkk = view.getkk();
+
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, nj*nk, getRowChunk(), [&](const long begin, const long end)
+  {
+    for(long n=begin; n<end; ++n)
+    {
+      const long j = n%nj;
+      const long k = n/nj;
+      simdCopyVec(&ptr[j*jj + k*kk], &in[j*injj + k*inkk], ni);
+    }
+  });
+}
+
+template<class T>
+inline double FieldView<T>::sum() const
+{
+  return reduceRows(0.,
+      [](const value_type *row, const long n) { return simdSum(row, n); },
+      [](const double a, const double b) { return a + b; });
+}
+
+template<class T>
+inline double FieldView<T>::mean() const
+{
+  checkNotEmpty();
+  return sum() / size();
+}
+
+template<class T>
+inline typename FieldView<T>::value_type FieldView<T>::min() const
+{
+  checkNotEmpty();
+  return reduceRows(ptr[0],
+      [](const value_type *row, const long n) { return simdMin(row, n); },
+      [](const value_type a, const value_type b) { return std::min(a, b); });
+}
+
+template<class T>
+inline typename FieldView<T>::value_type FieldView<T>::max() const
+{
+  checkNotEmpty();
+  return reduceRows(ptr[0],
+      [](const value_type *row, const long n) { return simdMax(row, n); },
+      [](const value_type a, const value_type b) { return std::max(a, b); });
+}
+
+// two passes, as for Field::variance
+template<class T>
+inline double FieldView<T>::variance() const
+{
+  const value_type shift = static_cast<value_type>(mean());
+
+  return reduceRows(0.,
+      [=](const value_type *row, const long n) { return simdSumSquares(row, shift, n); },
+      [](const double a, const double b) { return a + b; }) / size();
+}
+
+template<class T>
+inline double FieldView<T>::norm() const
+{
+  return std::sqrt(reduceRows(0.,
+      [](const value_type *row, const long n) { return simdSumSquares(row, static_cast<value_type>(0), n); },
+      [](const double a, const double b) { return a + b; }));
+}
+
+template<class T, class TG>
+inline FieldView<T> makeView(Field<T,TG> &field)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  return FieldView<T>(field.data.data(), dims.icells, dims.jcells, dims.kcells, dims.icells, dims.ijcells);
+}
+
+template<class T, class TG>
+inline FieldView<const T> makeView(const Field<T,TG> &field)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  return FieldView<const T>(field.data.data(), dims.icells, dims.jcells, dims.kcells, dims.icells, dims.ijcells);
+}
+
+template<class T, class TG>
+inline FieldView<T> makeInteriorView(Field<T,TG> &field)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  return makeView(field).subBox(dims.istart, dims.iend, dims.jstart, dims.jend, dims.kstart, dims.kend);
+}
+
+template<class T, class TG>
+inline FieldView<const T> makeInteriorView(const Field<T,TG> &field)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  return makeView(field).subBox(dims.istart, dims.iend, dims.jstart, dims.jend, dims.kstart, dims.kend);
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FIELDWRITER
+#define FIELDWRITER
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldFile.h"
+
+// Writer of Field files (see FieldFile.h) that does not stall the
+// computation. A write copies the Field into one of a fixed number of
+// buffers and returns, after which a dedicated I/O thread writes the
+// buffer to the file. If all buffers are in use, because the disk cannot
+// keep up, a write waits until the oldest buffer is written. Errors of
+// the I/O thread are thrown by the next call to write or flush. The file
+// names are those of the thread that calls write, so the writes of a thread
+// that is restricted to its process with Master::setLocal go to the files
+// without the process number.
+template<class T, class TG>
+class FieldWriter
+{
+  public:
+    FieldWriter(Grid<TG> &, int nbuffers=2);
+    ~FieldWriter();
+
+    FieldWriter(const FieldWriter &) = delete;
+    FieldWriter &operator=(const FieldWriter &) = delete;
+
+    // Queue the write of a snapshot of the Field to the file.
+    void write(const Field<T,TG> &, const std::string);
+
+    // Wait until all queued writes are in the files.
+    void flush();
+
+    // Total time (s) that write has waited for a free buffer.
+    double getWaitTime() const { return waittime; }
+
+  private:
+    Grid<TG> &grid;
+
+    struct Job
+    {
+      Field<T,TG> *buffer;
+      std::string filename;
+      bool local;
+    };
+
+    std::vector<std::unique_ptr<Field<T,TG> > > buffers;
+    std::vector<Field<T,TG> *> freebuffers;
+    std::deque<Job> queue;
+    int nwriting;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    std::exception_ptr error;
+    bool stopping;
+
+    double waittime;
+
+    void writerLoop();
+    void checkError();
+};
+
+
+// IMPLEMENTATION BELOW
+template<class T, class TG>
+inline FieldWriter<T,TG>::FieldWriter(Grid<TG> &gridin, const int nbuffers) :
+  grid(gridin),
+  nwriting(0),
+  stopping(false),
+  waittime(0.)
+{
+  Master &master = Master::getInstance();
+
+  for(int n=0; n<std::max(nbuffers, 1); ++n)
+  {
+    buffers.emplace_back(new Field<T,TG>(grid, "write buffer"));
+    freebuffers.push_back(buffers.back().get());
+  }
+
+  writer = std::thread(&FieldWriter::writerLoop, this);
+
+  std::ostringstream message;
+  message << "Constructed FieldWriter with " << buffers.size() << " buffer(s)\n";
+  master.printMessage(message.str());
+}
+
+template<class T, class TG>
+inline FieldWriter<T,TG>::~FieldWriter()
+{
+  // the queued writes are finished, but their errors cannot be thrown anymore
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeup.notify_all();
+  writer.join();
+
+  Master &master = Master::getInstance();
+  master.printMessage("Destructed FieldWriter\n");
+}
+
+template<class T, class TG>
+inline void FieldWriter<T,TG>::checkError()
+{
+  if(error)
+  {
+    std::exception_ptr e = error;
+    error = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+template<class T, class TG>
+inline void FieldWriter<T,TG>::write(const Field<T,TG> &field, const std::string filename)
+{
+  Master &master = Master::getInstance();
+
+  Field<T,TG> *buffer;
+  {
+    const double start = master.getTime();
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]{ return !freebuffers.empty() || error; });
+    waittime += master.getTime() - start;
+
+    checkError();
+    buffer = freebuffers.back();
+    freebuffers.pop_back();
+  }
+
+  // the copy is done with the thread pool outside of the lock, such that
+  // the I/O thread can continue
+  try
+  {
+    *buffer = field;
+  }
+  catch (...)
+  {
+    // return the buffer, otherwise the next writes would wait for it forever
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      freebuffers.push_back(buffer);
+    }
+    finished.notify_all();
+    throw;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back({buffer, filename, Master::isLocal()});
+  }
+  wakeup.notify_one();
+}
+
+template<class T, class TG>
+inline void FieldWriter<T,TG>::flush()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&]{ return (queue.empty() && nwriting == 0) || error; });
+  checkError();
+}
+
+template<class T, class TG>
+inline void FieldWriter<T,TG>::writerLoop()
+{
+  while(true)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [&]{ return stopping || !queue.empty(); });
+      if(queue.empty())
+        return;
+      job = queue.front();
+      queue.pop_front();
+      ++nwriting;
+    }
+
+    std::exception_ptr writeerror;
+    try
+    {
+      Master::setLocal(job.local);
+      saveField(*job.buffer, job.filename);
+    }
+    catch (...)
+    {
+      writeerror = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --nwriting;
+      freebuffers.push_back(job.buffer);
+      if(writeerror && !error)
+        error = writeerror;
+    }
+    finished.notify_all();
+  }
+}
+#endif
@@ -30,11 +30,26 @@
 
 struct GridDims
 {
+  // global number of grid points
   long itot;
   long jtot;
   long ktot;
   long ntot;
 
+  // number of grid points in the subdomain of this process
+  long imax;
+  long jmax;
+  long kmax;
+  long nmax;
+
+  // global index of the first point in the subdomain
+  long ioffset;
+  long joffset;
+
+  long igc;
+  long jgc;
+  long kgc;
+
   long icells;
   long jcells;
   long kcells;
@@ -51,6 +66,7 @@ struct GridDims
   long kend;
 };
 
+// The coordinates of the subdomain of this process, without ghost cells.
 template<class T>
 struct GridVars
 {
@@ -67,6 +83,7 @@ class Grid
     ~Grid();
 
     const GridDims& getDims() const { return dims; }
+    const GridVars<T>& getVars() const { return vars; }
     long getncells() const { return dims.ncells; }
 
   protected:
@@ -77,6 +94,16 @@ class Grid
 template<class T>
 Grid<T> createGrid(long, long, long, long gc=0);
 
+// true if the dimensions, the ghost cells and the subdomains are the same
+bool hasSameShape(const GridDims &, const GridDims &);
+
+// Grid of the whole domain on this process, for the analysis of whole
+// snapshots by every process, see TimeParallel.h. The reductions over its
+// Fields have to be restricted to this process with Master::setLocal, and in
+// an MPI build its ghost cells cannot be exchanged with BoundaryCyclic.
+template<class T>
+Grid<T> createLocalGrid(long, long, long, long gc=0);
+
 
 // IMPLEMENTATION BELOW
 template<class T>
@@ -95,40 +122,102 @@ inline Grid<T>::~Grid()
   master.printMessage("Destructed Grid\n");
 }
 
+inline bool hasSameShape(const GridDims &dims, const GridDims &dimsin)
+{
+  return dims.itot == dimsin.itot && dims.jtot == dimsin.jtot && dims.ktot == dimsin.ktot &&
+         dims.imax == dimsin.imax && dims.jmax == dimsin.jmax && dims.kmax == dimsin.kmax &&
+         dims.igc  == dimsin.igc  && dims.jgc  == dimsin.jgc  && dims.kgc  == dimsin.kgc &&
+         dims.ioffset == dimsin.ioffset && dims.joffset == dimsin.joffset;
+}
+
+namespace
+{
+  // Grid of the subdomain at (mpicoordx, mpicoordy) of a domain that is
+  // decomposed over npx x npy processes.
+  template<class T>
+  inline Grid<T> createSubdomainGrid(const long itotin, const long jtotin, const long ktotin, const long gc,
+                                     const int npx, const int npy, const int mpicoordx, const int mpicoordy)
+  {
+    Master &master = Master::getInstance();
+
+    if(itotin % npx != 0 || jtotin % npy != 0)
+    {
+      std::ostringstream message;
+      message << "ERROR itot = " << itotin << " is not a multiple of npx = " << npx
+              << " or jtot = " << jtotin << " is not a multiple of npy = " << npy << "\n";
+      master.printError(message.str());
+      throw 1;
+    }
+
+    if(itotin/npx < gc || jtotin/npy < gc || ktotin < gc)
+    {
+      master.printError("ERROR the subdomain of each process must be at least as large as the number of ghost cells\n");
+      throw 1;
+    }
+
+    long ntot = itotin*jtotin*ktotin;
+
+    GridDims dims;
+    dims.itot = itotin;
+    dims.jtot = jtotin;
+    dims.ktot = ktotin;
+    dims.ntot = ntot;
+
+    dims.imax = dims.itot / npx;
+    dims.jmax = dims.jtot / npy;
+    dims.kmax = dims.ktot;
+    dims.nmax = dims.imax * dims.jmax * dims.kmax;
+
+    dims.ioffset = mpicoordx * dims.imax;
+    dims.joffset = mpicoordy * dims.jmax;
+
+    dims.igc = gc;
+    dims.jgc = gc;
+    dims.kgc = gc;
+
+    dims.icells = dims.imax + 2*gc;
+    dims.jcells = dims.jmax + 2*gc;
+    dims.kcells = dims.kmax + 2*gc;
+
+    dims.ijcells = dims.icells * dims.jcells;
+    dims.ncells  = dims.icells * dims.jcells * dims.kcells;
+
+    dims.istart = gc;
+    dims.jstart = gc;
+    dims.kstart = gc;
+
+    dims.iend = dims.imax + gc;
+    dims.jend = dims.jmax + gc;
+    dims.kend = dims.kmax + gc;
+
+    GridVars<T> vars;
+    for(long i=dims.ioffset; i<dims.ioffset+dims.imax; ++i) {
+      vars.x.push_back((0.5+i)/dims.itot); }
+    for(long j=dims.joffset; j<dims.joffset+dims.jmax; ++j) {
+      vars.y.push_back((0.5+j)/dims.jtot); }
+    for(long k=0; k<dims.ktot; ++k) {
+      vars.z.push_back((0.5+k)/dims.ktot); }
+
+    return Grid<T>(dims, vars);
+  }
+}
+
 template<class T>
 inline Grid<T> createGrid(long itotin, long jtotin, long ktotin, long gc)
 {
-  long ntot = itotin*jtotin*ktotin;
-
-  GridDims dims;
-  dims.itot = itotin;
-  dims.jtot = jtotin;
-  dims.ktot = ktotin;
-  dims.ntot = ntot;
-
-  dims.icells = dims.itot + 2*gc;
-  dims.jcells = dims.jtot + 2*gc;
-  dims.kcells = dims.ktot + 2*gc;
-
-  dims.ijcells = dims.icells * dims.jcells;
-  dims.ncells  = dims.icells * dims.jcells * dims.kcells;
-
-  dims.istart = gc;
-  dims.jstart = gc;
-  dims.kstart = gc;
-
-  dims.iend = dims.itot + gc;
-  dims.jend = dims.jtot + gc;
-  dims.kend = dims.ktot + gc;
-
-  GridVars<T> vars;
-  for(int i=0; i<dims.itot; ++i) {
-    vars.x.push_back((0.5+i)/dims.itot); }
-  for(int j=0; j<dims.jtot; ++j) {
-    vars.y.push_back((0.5+j)/dims.jtot); }
-  for(int k=0; k<dims.ktot; ++k) {
-    vars.z.push_back((0.5+k)/dims.ktot); }
-  
-  return Grid<T>(dims, vars);
+  Master &master = Master::getInstance();
+
+  // decompose the domain over the default process grid if the user has not
+  // set one up yet
+  if(!master.isInitialized())
+    master.init();
+
+  return createSubdomainGrid<T>(itotin, jtotin, ktotin, gc, master.npx, master.npy, master.mpicoordx, master.mpicoordy);
+}
+
+template<class T>
+inline Grid<T> createLocalGrid(long itotin, long jtotin, long ktotin, long gc)
+{
+  return createSubdomainGrid<T>(itotin, jtotin, ktotin, gc, 1, 1, 0, 0);
 }
 #endif
@@ -0,0 +1,258 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HALF
+#define HALF
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// 16-bit floating point types to store Fields with half or a quarter of the
+// bytes of float or double. Half is the IEEE 754 binary16 type, with 11 bits
+// of precision and a range of 6e-5 to 65504. BFloat16 is the upper half of a
+// float, with 8 bits of precision and the range of float. Both are storage
+// types only: they convert to float, in which all arithmetic is done.
+// Conversions to the 16-bit types round to the nearest even value.
+//
+// The conversions are written with integer operations that compile for
+// both scalars and the vectors of Simd.h, in which the conditions become
+// masks. The vector loops of Simd.h and Stencil.h convert BFloat16 with these
+// and Half with the F16C instructions, which round the same way.
+class Half
+{
+  public:
+    Half() {}
+    Half(float);
+    operator float() const;
+
+    std::uint16_t bits;
+};
+
+class BFloat16
+{
+  public:
+    BFloat16() {}
+    BFloat16(float);
+    operator float() const;
+
+    std::uint16_t bits;
+};
+
+// The type in which the kernels compute with values of type T.
+template<typename T> struct ComputeType { typedef T type; };
+template<> struct ComputeType<Half> { typedef float type; };
+template<> struct ComputeType<BFloat16> { typedef float type; };
+
+// The limits of the 16-bit types, for instance the initial values of the
+// reductions min and max, see FieldStream.h and CompressedField.h.
+namespace std
+{
+  template<> class numeric_limits<Half>;
+  template<> class numeric_limits<BFloat16>;
+}
+
+
+// IMPLEMENTATION BELOW
+namespace
+{
+  template<typename To, typename From>
+  inline __attribute__((always_inline)) To bitCast(const From &from)
+  {
+    To to;
+    std::memcpy(&to, &from, sizeof(To));
+    return to;
+  }
+
+  // F is float or a vector of floats, U holds the 16-bit values in the low
+  // bits of unsigned 32-bit integers with the same number of elements as F.
+  template<typename F, typename U>
+  inline __attribute__((always_inline)) F convertHalfToFloat(const U h)
+  {
+    const std::uint32_t shiftedexp = 0x7c00 << 13;
+
+    U o = (h & 0x7fff) << 13;
+    const U exp = o & shiftedexp;
+    o += (127 - 15) << 23;
+
+    // infinity and NaN get the maximum exponent, subnormals are normalized
+    // by a subtraction that only involves normal floats
+    o = exp == shiftedexp ? o + ((128 - 16) << 23) : o;
+    const U subnormal = bitCast<U>(bitCast<F>(o + (1 << 23)) - bitCast<F>(U(o - o) + (113 << 23)));
+    o = exp == 0 ? subnormal : o;
+
+    return bitCast<F>(o | ((h & 0x8000) << 16));
+  }
+
+  template<typename U, typename F>
+  inline __attribute__((always_inline)) U convertFloatToHalf(const F f)
+  {
+    const std::uint32_t f32infty = 255 << 23;
+    const std::uint32_t f16max = (127 + 16) << 23;
+    const std::uint32_t denormmagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    U u = bitCast<U>(f);
+    const U sign = u & 0x80000000u;
+    u ^= sign;
+
+    // overflow to infinity, NaN stays NaN
+    const U infnan = u > f32infty ? U(u - u) + 0x7e00 : U(u - u) + 0x7c00;
+
+    // subnormals are rounded by the addition of a float with the exponent
+    // at which the last bit of the mantissa of half is the last bit of float
+    const U subnormal = bitCast<U>(bitCast<F>(u) + bitCast<F>(U(u - u) + denormmagic)) - denormmagic;
+
+    const U odd = (u >> 13) & 1;
+    const U normal = (u + ((static_cast<std::uint32_t>(15 - 127) << 23) + 0xfff) + odd) >> 13;
+
+    const U o = u >= f16max ? infnan : (u < (113u << 23) ? subnormal : normal);
+    return o | (sign >> 16);
+  }
+
+  // The BFloat16 conversions are also used for vectors, see Simd.h, which
+  // are passed by reference to avoid a vector ABI in code without AVX.
+  template<typename F, typename U>
+  inline __attribute__((always_inline)) void convertBFloat16ToFloat(F &f, const U &h)
+  {
+    const U u = h << 16;
+    std::memcpy(&f, &u, sizeof(F));
+  }
+
+  template<typename U, typename F>
+  inline __attribute__((always_inline)) void convertFloatToBFloat16(U &h, const F &f)
+  {
+    U u;
+    std::memcpy(&u, &f, sizeof(U));
+    const U rounded = (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+
+    // NaN is kept quiet, instead of being rounded to infinity
+    h = (u & 0x7fffffffu) > 0x7f800000u ? U((u >> 16) | 0x40) : rounded;
+  }
+}
+
+namespace std
+{
+  template<>
+  class numeric_limits<Half>
+  {
+    public:
+      static constexpr bool is_specialized = true;
+      static constexpr bool is_signed = true;
+      static constexpr bool is_integer = false;
+      static constexpr bool is_exact = false;
+      static constexpr bool has_infinity = true;
+      static constexpr bool has_quiet_NaN = true;
+      static constexpr bool has_signaling_NaN = true;
+      static constexpr std::float_denorm_style has_denorm = std::denorm_present;
+      static constexpr std::float_round_style round_style = std::round_to_nearest;
+      static constexpr bool is_iec559 = true;
+      static constexpr bool is_bounded = true;
+      static constexpr bool is_modulo = false;
+      static constexpr int radix = 2;
+      static constexpr int digits = 11;
+      static constexpr int min_exponent = -13;
+      static constexpr int max_exponent = 16;
+
+      static Half min()           { return fromBits(0x0400); }
+      static Half max()           { return fromBits(0x7bff); }
+      static Half lowest()        { return fromBits(0xfbff); }
+      static Half epsilon()       { return fromBits(0x1400); }
+      static Half denorm_min()    { return fromBits(0x0001); }
+      static Half infinity()      { return fromBits(0x7c00); }
+      static Half quiet_NaN()     { return fromBits(0x7e00); }
+      static Half signaling_NaN() { return fromBits(0x7d00); }
+
+    private:
+      static Half fromBits(const std::uint16_t bits)
+      {
+        Half value;
+        value.bits = bits;
+        return value;
+      }
+  };
+
+  template<>
+  class numeric_limits<BFloat16>
+  {
+    public:
+      static constexpr bool is_specialized = true;
+      static constexpr bool is_signed = true;
+      static constexpr bool is_integer = false;
+      static constexpr bool is_exact = false;
+      static constexpr bool has_infinity = true;
+      static constexpr bool has_quiet_NaN = true;
+      static constexpr bool has_signaling_NaN = true;
+      static constexpr std::float_denorm_style has_denorm = std::denorm_present;
+      static constexpr std::float_round_style round_style = std::round_to_nearest;
+      static constexpr bool is_iec559 = false;
+      static constexpr bool is_bounded = true;
+      static constexpr bool is_modulo = false;
+      static constexpr int radix = 2;
+      static constexpr int digits = 8;
+      static constexpr int min_exponent = -125;
+      static constexpr int max_exponent = 128;
+
+      static BFloat16 min()           { return fromBits(0x0080); }
+      static BFloat16 max()           { return fromBits(0x7f7f); }
+      static BFloat16 lowest()        { return fromBits(0xff7f); }
+      static BFloat16 epsilon()       { return fromBits(0x3c00); }
+      static BFloat16 denorm_min()    { return fromBits(0x0001); }
+      static BFloat16 infinity()      { return fromBits(0x7f80); }
+      static BFloat16 quiet_NaN()     { return fromBits(0x7fc0); }
+      static BFloat16 signaling_NaN() { return fromBits(0x7fa0); }
+
+    private:
+      static BFloat16 fromBits(const std::uint16_t bits)
+      {
+        BFloat16 value;
+        value.bits = bits;
+        return value;
+      }
+  };
+}
+
+inline Half::Half(const float f) :
+  bits(convertFloatToHalf<std::uint32_t>(f))
+{
+}
+
+inline Half::operator float() const
+{
+  return convertHalfToFloat<float>(static_cast<std::uint32_t>(bits));
+}
+
+inline BFloat16::BFloat16(const float f)
+{
+  std::uint32_t h;
+  convertFloatToBFloat16(h, f);
+  bits = h;
+}
+
+inline BFloat16::operator float() const
+{
+  float f;
+  convertBFloat16ToFloat(f, static_cast<std::uint32_t>(bits));
+  return f;
+}
+#endif
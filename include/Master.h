@@ -33,6 +33,7 @@
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 class Master
 {
@@ -46,8 +47,41 @@ class Master
 
     double getTime();
 
+    // reduce the n values of the array over all processes, in place
+    void sum(double *, int);
+    void max(double *, int);
+    void min(double *, int);
+
+    // Restrict the reductions of the calling thread to this process, for the
+    // analysis of whole snapshots on a local Grid, see TimeParallel.h.
+    static void setLocal(bool localin) { inLocalRegion() = localin; }
+    static bool isLocal() { return inLocalRegion(); }
+
+    // set up the npx x npy process grid, 0 lets MPI choose the dimension
+    void init(int npx=0, int npy=0);
+    bool isInitialized() const { return allocated; }
+    int getNprocs() const { return nprocs; }
+
     int mpiid;
 
+    // 2D decomposition, x is the fastest varying coordinate
+    int npx;
+    int npy;
+    int mpicoordx;
+    int mpicoordy;
+
+    // neighbouring ranks in the Cartesian communicator
+    int nnorth;
+    int nsouth;
+    int neast;
+    int nwest;
+
+    #ifdef USEMPI
+    MPI_Comm commxy;
+    MPI_Comm commx;
+    MPI_Comm commy;
+    #endif
+
   private:
     Master();
     ~Master();
@@ -59,6 +93,12 @@ class Master
     void cleanup();
     int checkError(int);
 
+    static bool &inLocalRegion();
+
+    #ifdef USEMPI
+    void allreduce(double *, int, MPI_Op);
+    #endif
+
     bool allocated;
     bool initialized;
 
@@ -73,6 +113,12 @@ inline Master &Master::getInstance()
   return master;
 }
 
+inline bool &Master::inLocalRegion()
+{
+  static thread_local bool inregion = false;
+  return inregion;
+}
+
 inline std::string Master::getVersion()
 {
   return std::string(GITHASH);
@@ -86,6 +132,15 @@ inline Master::Master()
 
   mpiid = 0;
 
+  npx = 1;
+  npy = 1;
+  mpicoordx = 0;
+  mpicoordy = 0;
+  nnorth = 0;
+  nsouth = 0;
+  neast  = 0;
+  nwest  = 0;
+
   try
   {
     // initialize the MPI
@@ -135,6 +190,15 @@ inline Master::Master()
   mpiid = 0;
   nprocs = 1;
 
+  npx = 1;
+  npy = 1;
+  mpicoordx = 0;
+  mpicoordy = 0;
+  nnorth = 0;
+  nsouth = 0;
+  neast  = 0;
+  nwest  = 0;
+
   std::ostringstream message;
   message << "Starting Master on " << nprocs << " process(es)\n";
   printMessage(message.str());
@@ -153,48 +217,60 @@ inline Master::~Master()
 inline void Master::cleanup()
 {
   #ifdef USEMPI
+  if(allocated)
+  {
+    MPI_Comm_free(&commx);
+    MPI_Comm_free(&commy);
+    MPI_Comm_free(&commxy);
+  }
+
   if(initialized)
     MPI_Finalize();
   #endif
 }
 
-/*
-int Master::init()
+#ifdef USEMPI
+inline void Master::init(const int npxin, const int npyin)
 {
-  int n;
+  if(allocated)
+  {
+    printError("Master is already initialized\n");
+    throw 1;
+  }
 
-  if(nprocs != npx*npy)
+  if(npxin > 0 && npyin > 0 && nprocs != npxin*npyin)
   {
-    if(mpiid == 0) std::printf("ERROR nprocs = %d does not equal npx*npy = %d*%d\n", nprocs, npx, npy);
-    return 1;
+    std::ostringstream message;
+    message << "ERROR nprocs = " << nprocs << " does not equal npx*npy = " << npxin << "*" << npyin << "\n";
+    printError(message.str());
+    throw 1;
   }
 
-  int dims    [2] = {npy, npx};
+  int dims    [2] = {npyin, npxin};
   int periodic[2] = {true, true};
 
   // define the dimensions of the 2-D grid layout
-  n = MPI_Dims_create(nprocs, 2, dims);
-  if(checkerror(n))
-    return 1;
+  int n = MPI_Dims_create(nprocs, 2, dims);
+  if(checkError(n))
+    throw 1;
+
+  npx = dims[1];
+  npy = dims[0];
 
   // create a 2-D grid communicator that is optimized for grid to grid transfer
-  // first, free our temporary copy of COMM_WORLD
-  n = MPI_Comm_free(&commxy);
-  if(checkerror(n))
-    return 1;
   // for now, do not reorder processes, blizzard gives large performance loss
   n = MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periodic, false, &commxy);
-  if(checkerror(n))
-    return 1;
+  if(checkError(n))
+    throw 1;
   n = MPI_Comm_rank(commxy, &mpiid);
-  if(checkerror(n))
-    return 1;
+  if(checkError(n))
+    throw 1;
 
   // retrieve the x- and y-coordinates in the 2-D grid for each process
   int mpicoords[2];
   n = MPI_Cart_coords(commxy, mpiid, 2, mpicoords);
-  if(checkerror(n))
-    return 1;
+  if(checkError(n))
+    throw 1;
 
   mpicoordx = mpicoords[1];
   mpicoordy = mpicoords[0];
@@ -203,34 +279,44 @@ int Master::init()
   int dimy[2] = {true , false};
 
   n = MPI_Cart_sub(commxy, dimx, &commx);
-  if(checkerror(n))
-    return 1;
+  if(checkError(n))
+    throw 1;
   n = MPI_Cart_sub(commxy, dimy, &commy);
-  if(checkerror(n))
-    return 1;
+  if(checkError(n))
+    throw 1;
 
   // find out who are the neighbors of this process to facilitate the communication routines
   n = MPI_Cart_shift(commxy, 1, 1, &nwest , &neast );
-  if(checkerror(n))
-    return 1;
+  if(checkError(n))
+    throw 1;
   n = MPI_Cart_shift(commxy, 0, 1, &nsouth, &nnorth);
-  if(checkerror(n))
-    return 1;
+  if(checkError(n))
+    throw 1;
 
-  // create the requests arrays for the nonblocking sends
-  int npmax;
-  npmax = std::max(npx, npy);
+  allocated = true;
 
-  // have at least as many communicators as prognostic variables
-  npmax = std::max(npmax, 8*4);
-  reqs  = new MPI_Request[npmax*2];
-  reqsn = 0;
+  std::ostringstream message;
+  message << "Decomposed domain over npx = " << npx << ", npy = " << npy << " process(es)\n";
+  printMessage(message.str());
+}
+#else
+inline void Master::init(const int npxin, const int npyin)
+{
+  if(allocated)
+  {
+    printError("Master is already initialized\n");
+    throw 1;
+  }
 
-  allocated = true;
+  if(std::max(npxin, 1) * std::max(npyin, 1) != 1)
+  {
+    printError("ERROR npx*npy must be 1 in a build without MPI\n");
+    throw 1;
+  }
 
-  return 0;
+  allocated = true;
 }
-*/
+#endif
 
 inline void Master::printMessage(std::string message)
 {
@@ -265,6 +351,31 @@ inline int Master::checkError(int n)
   return 0;
 }
 
+#ifdef USEMPI
+inline void Master::allreduce(double *var, const int n, MPI_Op op)
+{
+  if(isLocal())
+    return;
+
+  // all processes take part, also before the process grid is set up
+  MPI_Comm comm = allocated ? commxy : MPI_COMM_WORLD;
+  if(checkError(MPI_Allreduce(MPI_IN_PLACE, var, n, MPI_DOUBLE, op, comm)))
+  {
+    printError("Error in Master allreduce\n");
+    throw 1;
+  }
+}
+
+inline void Master::sum(double *var, const int n) { allreduce(var, n, MPI_SUM); }
+inline void Master::max(double *var, const int n) { allreduce(var, n, MPI_MAX); }
+inline void Master::min(double *var, const int n) { allreduce(var, n, MPI_MIN); }
+#else
+// a single process already has the result
+inline void Master::sum(double *var, const int n) {}
+inline void Master::max(double *var, const int n) {}
+inline void Master::min(double *var, const int n) {}
+#endif
+
 inline double Master::getTime()
 {
   #ifdef USEMPI
@@ -0,0 +1,386 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NETCDFFILE
+#define NETCDFFILE
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <netcdf.h>
+#ifdef USEMPI
+#include <netcdf_par.h>
+#endif
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "ThreadPool.h"
+
+enum NetcdfMode { NetcdfCreate, NetcdfRead, NetcdfWrite };
+
+// NetCDF-4 file with the dimensions x, y and z of a Grid and three dimensional
+// variables of the interior of Fields, stored as (z, y, x). Every process
+// reads and writes the hyperslab of its subdomain only. With MPI the file is
+// opened by all processes of the process grid through parallel HDF5 and the
+// data is transferred collectively, which requires a NetCDF build with
+// parallel I/O.
+//
+// The variables are written in chunks of whole subdomain planes, such that
+// the processes never share a chunk. A variable is read in blocks of levels
+// that cover whole chunks of the file and the chunk cache is sized to hold
+// one block, so every chunk is read and decompressed once.
+template<class T>
+class NetcdfFile
+{
+  public:
+    NetcdfFile(const std::string, NetcdfMode);
+    virtual ~NetcdfFile();
+
+    NetcdfFile(const NetcdfFile &) = delete;
+    NetcdfFile &operator=(const NetcdfFile &) = delete;
+
+    // Define the dimensions of the grid and write its coordinates.
+    void writeGrid(const Grid<T> &);
+
+    // Create a Grid with the dimensions and coordinates of the file.
+    Grid<T> readGrid(long gc=0);
+
+    template<class TF> void writeField(const Field<TF,T> &, const std::string);
+    template<class TF> void readField(Field<TF,T> &, const std::string);
+
+  private:
+    std::string name;
+    int ncid;
+
+    void check(int) const;
+    int getDimId(const std::string) const;
+    void checkDims(const GridDims &) const;
+
+    template<class TF, class F> void transferBlocks(const GridDims &, long, F);
+};
+
+namespace
+{
+  // the NetCDF type and the transfer functions per type of the Field
+  template<typename TF> struct NetcdfType;
+
+  template<> struct NetcdfType<double>
+  {
+    static nc_type type() { return NC_DOUBLE; }
+    static int put(int ncid, int varid, const size_t *start, const size_t *count, const double *data)
+    { return nc_put_vara_double(ncid, varid, start, count, data); }
+    static int get(int ncid, int varid, const size_t *start, const size_t *count, double *data)
+    { return nc_get_vara_double(ncid, varid, start, count, data); }
+  };
+
+  template<> struct NetcdfType<float>
+  {
+    static nc_type type() { return NC_FLOAT; }
+    static int put(int ncid, int varid, const size_t *start, const size_t *count, const float *data)
+    { return nc_put_vara_float(ncid, varid, start, count, data); }
+    static int get(int ncid, int varid, const size_t *start, const size_t *count, float *data)
+    { return nc_get_vara_float(ncid, varid, start, count, data); }
+  };
+
+  // Size of the blocks of levels in which the variables are transferred.
+  const long netcdfblocksize = 64*1024*1024;
+}
+
+
+// IMPLEMENTATION BELOW
+template<class T>
+inline NetcdfFile<T>::NetcdfFile(const std::string namein, const NetcdfMode mode) :
+  name(namein), ncid(-1)
+{
+  Master &master = Master::getInstance();
+  if(!master.isInitialized())
+    master.init();
+
+  #ifdef USEMPI
+  if(mode == NetcdfCreate)
+    check(nc_create_par(name.c_str(), NC_NETCDF4 | NC_CLOBBER | NC_MPIIO, master.commxy, MPI_INFO_NULL, &ncid));
+  else
+    check(nc_open_par(name.c_str(), (mode == NetcdfWrite ? NC_WRITE : NC_NOWRITE) | NC_MPIIO,
+                      master.commxy, MPI_INFO_NULL, &ncid));
+  #else
+  if(mode == NetcdfCreate)
+    check(nc_create(name.c_str(), NC_NETCDF4 | NC_CLOBBER, &ncid));
+  else
+    check(nc_open(name.c_str(), mode == NetcdfWrite ? NC_WRITE : NC_NOWRITE, &ncid));
+  #endif
+
+  std::ostringstream message;
+  message << "Opened NetcdfFile " << name << "\n";
+  master.printMessage(message.str());
+}
+
+template<class T>
+inline NetcdfFile<T>::~NetcdfFile()
+{
+  Master &master = Master::getInstance();
+
+  // a destructor cannot throw, so only report a failing close
+  const int status = nc_close(ncid);
+  if(status != NC_NOERR)
+    master.printError("NetCDF error in " + name + ": " + nc_strerror(status) + "\n");
+
+  std::ostringstream message;
+  message << "Closed NetcdfFile " << name << "\n";
+  master.printMessage(message.str());
+}
+
+template<class T>
+inline void NetcdfFile<T>::check(const int status) const
+{
+  if(status != NC_NOERR)
+  {
+    Master &master = Master::getInstance();
+    master.printError("NetCDF error in " + name + ": " + nc_strerror(status) + "\n");
+    throw 1;
+  }
+}
+
+template<class T>
+inline int NetcdfFile<T>::getDimId(const std::string dimname) const
+{
+  int dimid;
+  check(nc_inq_dimid(ncid, dimname.c_str(), &dimid));
+  return dimid;
+}
+
+// The dimensions of the file have to match the global dimensions of the grid.
+template<class T>
+inline void NetcdfFile<T>::checkDims(const GridDims &dims) const
+{
+  size_t itot, jtot, ktot;
+  check(nc_inq_dimlen(ncid, getDimId("x"), &itot));
+  check(nc_inq_dimlen(ncid, getDimId("y"), &jtot));
+  check(nc_inq_dimlen(ncid, getDimId("z"), &ktot));
+
+  if(static_cast<long>(itot) != dims.itot || static_cast<long>(jtot) != dims.jtot || static_cast<long>(ktot) != dims.ktot)
+  {
+    Master &master = Master::getInstance();
+    std::ostringstream message;
+    message << "ERROR the dimensions of " << name << " (" << itot << ", " << jtot << ", " << ktot
+            << ") do not match the grid (" << dims.itot << ", " << dims.jtot << ", " << dims.ktot << ")\n";
+    master.printError(message.str());
+    throw 1;
+  }
+}
+
+template<class T>
+inline void NetcdfFile<T>::writeGrid(const Grid<T> &grid)
+{
+  const GridDims &dims = grid.getDims();
+  const GridVars<T> &vars = grid.getVars();
+
+  int dimids[3];
+  check(nc_def_dim(ncid, "x", dims.itot, &dimids[0]));
+  check(nc_def_dim(ncid, "y", dims.jtot, &dimids[1]));
+  check(nc_def_dim(ncid, "z", dims.ktot, &dimids[2]));
+
+  int varids[3];
+  check(nc_def_var(ncid, "x", NetcdfType<T>::type(), 1, &dimids[0], &varids[0]));
+  check(nc_def_var(ncid, "y", NetcdfType<T>::type(), 1, &dimids[1], &varids[1]));
+  check(nc_def_var(ncid, "z", NetcdfType<T>::type(), 1, &dimids[2], &varids[2]));
+  check(nc_enddef(ncid));
+
+  // every process writes the coordinates of its subdomain
+  const size_t start[3] = {static_cast<size_t>(dims.ioffset), static_cast<size_t>(dims.joffset), 0};
+  const size_t count[3] = {static_cast<size_t>(dims.imax), static_cast<size_t>(dims.jmax), static_cast<size_t>(dims.kmax)};
+  const T *data[3] = {vars.x.data(), vars.y.data(), vars.z.data()};
+
+  for(int n=0; n<3; ++n)
+  {
+    #ifdef USEMPI
+    check(nc_var_par_access(ncid, varids[n], NC_COLLECTIVE));
+    #endif
+    check(NetcdfType<T>::put(ncid, varids[n], &start[n], &count[n], data[n]));
+  }
+}
+
+template<class T>
+inline Grid<T> NetcdfFile<T>::readGrid(const long gc)
+{
+  size_t itot, jtot, ktot;
+  check(nc_inq_dimlen(ncid, getDimId("x"), &itot));
+  check(nc_inq_dimlen(ncid, getDimId("y"), &jtot));
+  check(nc_inq_dimlen(ncid, getDimId("z"), &ktot));
+
+  // the decomposition and the checks of the dimensions of createGrid
+  const Grid<T> grid = createGrid<T>(itot, jtot, ktot, gc);
+  GridDims dims = grid.getDims();
+
+  GridVars<T> vars;
+  vars.x.resize(dims.imax);
+  vars.y.resize(dims.jmax);
+  vars.z.resize(dims.kmax);
+
+  const size_t start[3] = {static_cast<size_t>(dims.ioffset), static_cast<size_t>(dims.joffset), 0};
+  const size_t count[3] = {static_cast<size_t>(dims.imax), static_cast<size_t>(dims.jmax), static_cast<size_t>(dims.kmax)};
+  T *data[3] = {vars.x.data(), vars.y.data(), vars.z.data()};
+  const char *names[3] = {"x", "y", "z"};
+
+  for(int n=0; n<3; ++n)
+  {
+    int varid;
+    check(nc_inq_varid(ncid, names[n], &varid));
+    check(NetcdfType<T>::get(ncid, varid, &start[n], &count[n], data[n]));
+  }
+
+  return Grid<T>(dims, vars);
+}
+
+// Call f(buffer, start, count) for the blocks of kblock levels of the subdomain,
+// in which the buffer holds the interior of the levels contiguously.
+template<class T>
+template<class TF, class F>
+inline void NetcdfFile<T>::transferBlocks(const GridDims &dims, const long kblock, F f)
+{
+  std::vector<TF> buffer(kblock*dims.jmax*dims.imax);
+
+  for(long k=0; k<dims.kmax; k+=kblock)
+  {
+    const long nk = std::min(kblock, dims.kmax - k);
+    const size_t start[3] = {static_cast<size_t>(k), static_cast<size_t>(dims.joffset), static_cast<size_t>(dims.ioffset)};
+    const size_t count[3] = {static_cast<size_t>(nk), static_cast<size_t>(dims.jmax), static_cast<size_t>(dims.imax)};
+    f(buffer.data(), start, count);
+  }
+}
+
+namespace
+{
+  // Copy the interior of nk levels from level kstart of the Field into the
+  // contiguous buffer or the other way around, one level per chunk.
+  template<bool tobuffer, typename TF>
+  inline void copyInterior(TF * const buffer, TF * const field, const GridDims &dims,
+                           const long kstart, const long nk)
+  {
+    ThreadPool &pool = ThreadPool::getInstance();
+    pool.parallelFor(0, nk, 1, [&](const long begin, const long end)
+    {
+      for(long k=begin; k<end; ++k)
+        for(long j=0; j<dims.jmax; ++j)
+        {
+          TF *b = buffer + (k*dims.jmax + j)*dims.imax;
+          TF *a = field + dims.istart + (j+dims.jstart)*dims.icells + (k+kstart+dims.kstart)*dims.ijcells;
+          if(tobuffer)
+            simdCopyVec(b, a, dims.imax);
+          else
+            simdCopyVec(a, b, dims.imax);
+        }
+    });
+  }
+}
+
+template<class T>
+template<class TF>
+inline void NetcdfFile<T>::writeField(const Field<TF,T> &field, const std::string varname)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  checkDims(dims);
+
+  int dimids[3] = {getDimId("z"), getDimId("y"), getDimId("x")};
+  int varid;
+  check(nc_def_var(ncid, varname.c_str(), NetcdfType<TF>::type(), 3, dimids, &varid));
+
+  // chunks of whole subdomain planes of about 4 MB
+  const long planesize = dims.imax*dims.jmax*sizeof(TF);
+  const long kchunk = std::max(1L, std::min(dims.kmax, 4*1024*1024 / planesize));
+  const size_t chunks[3] = {static_cast<size_t>(kchunk), static_cast<size_t>(dims.jmax), static_cast<size_t>(dims.imax)};
+  check(nc_def_var_chunking(ncid, varid, NC_CHUNKED, chunks));
+  check(nc_enddef(ncid));
+
+  #ifdef USEMPI
+  check(nc_var_par_access(ncid, varid, NC_COLLECTIVE));
+  #endif
+
+  // blocks of whole chunks
+  const long kblock = std::max(1L, netcdfblocksize / (kchunk*planesize)) * kchunk;
+  TF *data = const_cast<TF *>(field.data.data());
+
+  transferBlocks<TF>(dims, kblock, [&](TF *buffer, const size_t *start, const size_t *count)
+  {
+    copyInterior<true>(buffer, data, dims, start[0], count[0]);
+    check(NetcdfType<TF>::put(ncid, varid, start, count, buffer));
+  });
+}
+
+template<class T>
+template<class TF>
+inline void NetcdfFile<T>::readField(Field<TF,T> &field, const std::string varname)
+{
+  const GridDims &dims = field.getGrid().getDims();
+  checkDims(dims);
+
+  int varid;
+  check(nc_inq_varid(ncid, varname.c_str(), &varid));
+
+  int ndims;
+  check(nc_inq_varndims(ncid, varid, &ndims));
+  int dimids[NC_MAX_VAR_DIMS];
+  check(nc_inq_vardimid(ncid, varid, dimids));
+  if(ndims != 3 || dimids[0] != getDimId("z") || dimids[1] != getDimId("y") || dimids[2] != getDimId("x"))
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR variable " + varname + " in " + name + " does not have the dimensions (z, y, x)\n");
+    throw 1;
+  }
+
+  // Read blocks of whole chunks along z and let the chunk cache hold all
+  // chunks that the hyperslab of a block touches.
+  int storage;
+  size_t chunks[3];
+  check(nc_inq_var_chunking(ncid, varid, &storage, chunks));
+
+  const long planesize = dims.imax*dims.jmax*sizeof(TF);
+  long kblock = std::max(1L, std::min(dims.kmax, netcdfblocksize / planesize));
+
+  if(storage == NC_CHUNKED)
+  {
+    const long kchunk = chunks[0];
+    kblock = std::max(1L, kblock / kchunk) * kchunk;
+
+    // the chunks that overlap the subdomain in y and x, which may start before it
+    const long nj = (dims.joffset + dims.jmax - 1) / chunks[1] - dims.joffset / chunks[1] + 1;
+    const long ni = (dims.ioffset + dims.imax - 1) / chunks[2] - dims.ioffset / chunks[2] + 1;
+    const size_t cachesize = (kblock/kchunk) * nj * ni * chunks[0]*chunks[1]*chunks[2] * sizeof(TF);
+    const size_t nelems = (kblock/kchunk) * nj * ni;
+    check(nc_set_var_chunk_cache(ncid, varid, cachesize, std::max(nelems, static_cast<size_t>(1009)), 0.75f));
+  }
+
+  #ifdef USEMPI
+  check(nc_var_par_access(ncid, varid, NC_COLLECTIVE));
+  #endif
+
+  TF *data = field.data.data();
+
+  transferBlocks<TF>(dims, kblock, [&](TF *buffer, const size_t *start, const size_t *count)
+  {
+    check(NetcdfType<TF>::get(ncid, varid, start, count, buffer));
+    copyInterior<false>(buffer, data, dims, start[0], count[0]);
+  });
+}
+#endif
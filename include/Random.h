@@ -0,0 +1,240 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RANDOM
+#define RANDOM
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "Master.h"
+#include "Grid.h"
+#include "ThreadPool.h"
+
+template<class T, class TG>
+class Field;
+
+// Counter-based random number generator Philox4x32-10 of Salmon et al.
+// (2011), as in Random123. The random numbers are a pure function of a
+// counter and a key, so any element of the sequence is computed directly
+// without a state that is shared between threads. The key is the seed and a
+// stream, such that for instance the members of an ensemble can use their
+// own seed and the fields of a member their own stream.
+class Philox
+{
+  public:
+    explicit Philox(std::uint64_t seed, std::uint32_t stream=0);
+
+    // the four random words of counter n
+    void generate(std::uint64_t n, std::uint32_t *) const;
+
+    // uniform in [0, 1) with 52 random bits
+    double uniform(std::uint64_t n) const;
+    // standard normal, with the Box-Muller transform of two uniforms
+    double normal(std::uint64_t n) const;
+    // uniform in [low, high], including high
+    long integer(std::uint64_t n, long low, long high) const;
+
+  private:
+    std::uint32_t key[2];
+    std::uint32_t stream;
+};
+
+// Fill the interior of a Field with random numbers of the element at its
+// global index i + itot*(j + jtot*k), such that the Field is identical for
+// any number of threads and any decomposition over the processes. The
+// planes are distributed over the ThreadPool, the ghost cells are not set.
+// The values of the vectorized loops may differ in the last bits from the
+// scalar functions of Philox, as with -ffast-math the loops use the vector
+// variants of the math functions.
+template<class T, class TG>
+void randomizeUniform(Field<T,TG> &, const Philox &, double low=0., double high=1.);
+
+template<class T, class TG>
+void randomizeNormal(Field<T,TG> &, const Philox &, double mean=0., double stddev=1.);
+
+template<class T, class TG>
+void randomizeInteger(Field<T,TG> &, const Philox &, long low, long high);
+
+
+// IMPLEMENTATION BELOW
+inline Philox::Philox(const std::uint64_t seed, const std::uint32_t streamin) :
+  stream(streamin)
+{
+  key[0] = static_cast<std::uint32_t>(seed);
+  key[1] = static_cast<std::uint32_t>(seed >> 32);
+}
+
+inline void Philox::generate(const std::uint64_t n, std::uint32_t * const out) const
+{
+  const std::uint32_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+  const std::uint32_t w0 = 0x9E3779B9, w1 = 0xBB67AE85;
+
+  std::uint32_t c0 = static_cast<std::uint32_t>(n);
+  std::uint32_t c1 = static_cast<std::uint32_t>(n >> 32);
+  std::uint32_t c2 = stream;
+  std::uint32_t c3 = 0;
+  std::uint32_t k0 = key[0], k1 = key[1];
+
+  for(int round=0; round<10; ++round)
+  {
+    const std::uint64_t p0 = static_cast<std::uint64_t>(m0) * c0;
+    const std::uint64_t p1 = static_cast<std::uint64_t>(m1) * c2;
+
+    c0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    c2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c1 = static_cast<std::uint32_t>(p1);
+    c3 = static_cast<std::uint32_t>(p0);
+
+    k0 += w0;
+    k1 += w1;
+  }
+
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+namespace
+{
+  // The upper 52 bits of a 64-bit word as the mantissa of a double in
+  // [1, 2), minus one. Unlike a conversion of the integer, this is exact in
+  // the vectorized loops of -ffast-math and gives the same values everywhere.
+  inline double randomToUnit(const std::uint32_t lo, const std::uint32_t hi)
+  {
+    const std::uint64_t r = (static_cast<std::uint64_t>(hi) << 32) | lo;
+    const std::uint64_t bits = (static_cast<std::uint64_t>(0x3ff) << 52) | (r >> 12);
+
+    double unit;
+    std::memcpy(&unit, &bits, sizeof(unit));
+    return unit - 1.;
+  }
+}
+
+inline double Philox::uniform(const std::uint64_t n) const
+{
+  std::uint32_t r[4];
+  generate(n, r);
+  return randomToUnit(r[0], r[1]);
+}
+
+inline double Philox::normal(const std::uint64_t n) const
+{
+  const double twopi = 6.28318530717958647693;
+
+  std::uint32_t r[4];
+  generate(n, r);
+
+  // u1 is in (0, 1], so that its logarithm is finite
+  const double u1 = 1. - randomToUnit(r[0], r[1]);
+  const double u2 = randomToUnit(r[2], r[3]);
+  return std::sqrt(-2.*std::log(u1)) * std::cos(twopi*u2);
+}
+
+// The remainder of a 64-bit word has a bias of at most the range over 2^64.
+inline long Philox::integer(const std::uint64_t n, const long low, const long high) const
+{
+  std::uint32_t r[4];
+  generate(n, r);
+
+  const std::uint64_t word  = (static_cast<std::uint64_t>(r[1]) << 32) | r[0];
+  const std::uint64_t range = static_cast<std::uint64_t>(high - low) + 1;
+  return low + static_cast<long>(range == 0 ? word : word % range);
+}
+
+namespace
+{
+  // Set every interior point of the Field to f(n), with n its global index.
+  // The values are computed in blocks of global indices that are aligned to
+  // the block size, with a loop of a fixed length. Every point is thereby
+  // computed by the same instructions, whether the vectorized loop uses other
+  // implementations of the math functions than a scalar loop or not, and
+  // regardless of where the rows of the subdomain start and end.
+  template<class T, class TG, class F>
+  inline void randomizeField(Field<T,TG> &field, F f)
+  {
+    const GridDims &dims = field.getGrid().getDims();
+    T * const data = field.data.data();
+    const long block = 16;
+
+    ThreadPool &pool = ThreadPool::getInstance();
+    pool.parallelFor(dims.kstart, dims.kend, 1, [&](const long kstart, const long kend)
+    {
+      T values[block];
+      for(long k=kstart; k<kend; ++k)
+        for(long j=dims.jstart; j<dims.jend; ++j)
+        {
+          const long nstart = dims.ioffset + dims.itot*(dims.joffset + j-dims.jstart + dims.jtot*(k-dims.kstart));
+          const long nend = nstart + dims.imax;
+          T * const row = &data[dims.istart + j*dims.icells + k*dims.ijcells];
+
+          for(long nblock=nstart/block*block; nblock<nend; nblock+=block)
+          {
+            for(long m=0; m<block; ++m)
+              values[m] = f(static_cast<std::uint64_t>(nblock + m));
+
+            for(long n=std::max(nblock, nstart); n<std::min(nblock+block, nend); ++n)
+              row[n-nstart] = values[n-nblock];
+          }
+        }
+    });
+  }
+}
+
+template<class T, class TG>
+inline void randomizeUniform(Field<T,TG> &field, const Philox &philox, const double low, const double high)
+{
+  randomizeField(field, [&](const std::uint64_t n)
+  {
+    return static_cast<T>(low + (high-low)*philox.uniform(n));
+  });
+}
+
+template<class T, class TG>
+inline void randomizeNormal(Field<T,TG> &field, const Philox &philox, const double mean, const double stddev)
+{
+  randomizeField(field, [&](const std::uint64_t n)
+  {
+    return static_cast<T>(mean + stddev*philox.normal(n));
+  });
+}
+
+template<class T, class TG>
+inline void randomizeInteger(Field<T,TG> &field, const Philox &philox, const long low, const long high)
+{
+  if(high < low)
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR the random integers need a range with low <= high\n");
+    throw 1;
+  }
+
+  randomizeField(field, [&](const std::uint64_t n)
+  {
+    return static_cast<T>(philox.integer(n, low, high));
+  });
+}
+#endif
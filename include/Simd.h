@@ -0,0 +1,939 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMD
+#define SIMD
+
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#include "Master.h"
+#include "Half.h"
+
+#define restrict RESTRICTKEYWORD
+
+// Hand-vectorized variants of the hot loops of Field and Stencil. The
+// variants are compiled for AVX2 and AVX-512 with target attributes, so that
+// they are available in a build for the baseline instruction set, and the
+// variant that is executed is selected at runtime from what the CPU supports.
+// The vectors are GCC vector extensions of float or double, that are loaded
+// and stored unaligned. Other compilers and architectures use the scalar loops.
+//
+// The kernels compute in the ComputeType of the stored type, see Half.h. The
+// 16-bit types are converted to vectors of float when they are loaded and
+// rounded back when they are stored, inside the vector loop, such that the
+// Fields take half the memory traffic of float at the vector width of float.
+// Half is converted with the F16C instructions, which the variants require.
+// The stencils of Stencil.h can also compute in double, for which the values
+// are converted from float to vectors of double with as many elements.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(__CUDACC__)
+#define SIMDDISPATCH
+#include <immintrin.h>
+#endif
+
+enum SimdLevel { SimdScalar = 0, SimdAVX2 = 1, SimdAVX512 = 2 };
+
+class Simd
+{
+  public:
+    static Simd &getInstance();
+
+    SimdLevel getLevel() const { return level; }
+    SimdLevel getSupportedLevel() const { return supported; }
+
+    // Select the kernels of a level that the CPU supports, for instance to
+    // compare the variants, by default the highest supported level is used.
+    void setLevel(SimdLevel);
+
+    static const char *getName(SimdLevel);
+
+  private:
+    Simd();
+
+    Simd(const Simd &) = delete;
+    Simd &operator=(const Simd &) = delete;
+
+    SimdLevel level;
+    SimdLevel supported;
+};
+
+// out[n] = in[n]
+template<typename T>
+void simdCopyVec(T * const restrict, const T * const restrict, long);
+// the 16-bit types are copied as their bits
+void simdCopyVec(Half * const restrict, const Half * const restrict, long);
+void simdCopyVec(BFloat16 * const restrict, const BFloat16 * const restrict, long);
+
+// out[n] = in[n] converted from TI to TO, for instance from double to Half
+template<typename TO, typename TI>
+void simdConvertVec(TO * const restrict, const TI * const restrict, long);
+
+// out[n] += in[n]
+template<typename T>
+void simdCopyAddVec(T * const restrict, const T * const restrict, long);
+
+// out[n] = a[n] + b[n], out is allowed to be a or b
+template<typename T>
+void simdAddVecs(T * const, const T * const, const T * const, long);
+
+// sum of in[n], the partial sums are in the compute precision of T
+template<typename T>
+double simdSum(const T * const, long);
+
+// sum of (in[n] - shift)^2
+template<typename T>
+double simdSumSquares(const T * const, T, long);
+
+// sums[p-1] += sum of (in[n] - shift)^p for p = 1 to 4
+template<typename T>
+void simdPowerSums(double * const, const T * const, T, long);
+
+// sums += {sum of da, sum of db, sum of da*db}, with da = a[n] - shifta and db = b[n] - shiftb
+template<typename T>
+void simdCrossSums(double * const, const T * const, const T * const, T, T, long);
+
+// minimum and maximum of in[n], size has to be at least 1
+template<typename T>
+T simdMin(const T * const, long);
+template<typename T>
+T simdMax(const T * const, long);
+
+
+// IMPLEMENTATION BELOW
+inline Simd &Simd::getInstance()
+{
+  static Simd simd;
+  return simd;
+}
+
+inline Simd::Simd()
+{
+  supported = SimdScalar;
+
+  #ifdef SIMDDISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+    supported = SimdAVX2;
+  if(supported == SimdAVX2 && __builtin_cpu_supports("avx512f"))
+    supported = SimdAVX512;
+  #endif
+
+  level = supported;
+
+  Master &master = Master::getInstance();
+  std::ostringstream message;
+  message << "Selected " << getName(level) << " kernels\n";
+  master.printMessage(message.str());
+}
+
+inline const char *Simd::getName(const SimdLevel levelin)
+{
+  switch(levelin)
+  {
+    case SimdAVX512: return "AVX-512";
+    case SimdAVX2  : return "AVX2";
+    default        : return "scalar";
+  }
+}
+
+inline void Simd::setLevel(const SimdLevel levelin)
+{
+  if(levelin > supported)
+  {
+    Master &master = Master::getInstance();
+    std::ostringstream message;
+    message << "The CPU does not support the " << getName(levelin) << " kernels\n";
+    master.printError(message.str());
+    throw 1;
+  }
+
+  level = levelin;
+}
+
+namespace
+{
+  // Load and store of vectors V of the compute type from and to arrays of
+  // type T, which are plain vector loads and stores if T is the compute type.
+  // The vectors are passed by reference, such that the inlined helpers do not
+  // have a vector ABI in the translation units that are compiled without AVX.
+  template<typename V, typename T>
+  struct SimdConvert
+  {
+    static inline __attribute__((always_inline)) void load(V &v, const T * const p)
+    {
+      v = *reinterpret_cast<const V*>(p);
+    }
+
+    static inline __attribute__((always_inline)) void store(T * const p, const V &v)
+    {
+      *reinterpret_cast<V*>(p) = v;
+    }
+  };
+
+  // scalars of the 16-bit types convert to and from float
+  template<>
+  struct SimdConvert<float, Half>
+  {
+    static inline __attribute__((always_inline)) void load(float &v, const Half * const p) { v = *p; }
+    static inline __attribute__((always_inline)) void store(Half * const p, const float &v) { *p = v; }
+  };
+
+  template<>
+  struct SimdConvert<float, BFloat16>
+  {
+    static inline __attribute__((always_inline)) void load(float &v, const BFloat16 * const p) { v = *p; }
+    static inline __attribute__((always_inline)) void store(BFloat16 * const p, const float &v) { *p = v; }
+  };
+
+  // The element type of a vector V, or V itself for a scalar.
+  template<typename V, bool isScalar = std::is_arithmetic<V>::value>
+  struct SimdElement
+  {
+    typedef V type;
+  };
+
+  template<typename V>
+  struct SimdElement<V, false>
+  {
+    typedef typename std::decay<decltype(std::declval<V>()[0])>::type type;
+  };
+
+  // Scalar or vector of type C with the number of elements of V, into which
+  // the values are loaded before they are converted to V.
+  template<typename V, typename C, bool isScalar = std::is_arithmetic<V>::value>
+  struct SimdNarrow
+  {
+    typedef C type;
+    static inline __attribute__((always_inline)) void widen(V &v, const C &n) { v = n; }
+    static inline __attribute__((always_inline)) void narrow(C &n, const V &v) { n = static_cast<C>(v); }
+  };
+
+  template<typename V, typename T>
+  inline void simdLoad(V &v, const T * const p);
+
+  template<typename V, typename T>
+  inline void simdStore(T * const p, const V &v);
+
+  // Kernels that compute in double with types of which the ComputeType is
+  // float load the values as float and convert them to double, and round the
+  // results to float before they are stored. Half and BFloat16 are therefore
+  // rounded twice, from double to float and from float to 16 bits.
+  template<typename V, typename T,
+           bool widen = !std::is_same<typename SimdElement<V>::type, typename ComputeType<T>::type>::value>
+  struct SimdLoadStore
+  {
+    static inline __attribute__((always_inline)) void load(V &v, const T * const p)
+    {
+      SimdConvert<V,T>::load(v, p);
+    }
+
+    static inline __attribute__((always_inline)) void store(T * const p, const V &v)
+    {
+      SimdConvert<V,T>::store(p, v);
+    }
+  };
+
+  template<typename V, typename T>
+  struct SimdLoadStore<V, T, true>
+  {
+    typedef SimdNarrow<V, typename ComputeType<T>::type> Narrow;
+    typedef typename Narrow::type N;
+
+    static inline __attribute__((always_inline)) void load(V &v, const T * const p)
+    {
+      N n;
+      simdLoad(n, p);
+      Narrow::widen(v, n);
+    }
+
+    static inline __attribute__((always_inline)) void store(T * const p, const V &v)
+    {
+      N n;
+      Narrow::narrow(n, v);
+      simdStore(p, n);
+    }
+  };
+
+  template<typename V, typename T>
+  inline __attribute__((always_inline)) void simdLoad(V &v, const T * const p)
+  {
+    SimdLoadStore<V,T>::load(v, p);
+  }
+
+  template<typename V, typename T>
+  inline __attribute__((always_inline)) void simdStore(T * const p, const V &v)
+  {
+    SimdLoadStore<V,T>::store(p, v);
+  }
+}
+
+#ifdef SIMDDISPATCH
+namespace
+{
+  // Vector of the given number of bytes, that may be unaligned and may
+  // alias the array of scalars it is loaded from.
+  template<typename T, int bytes>
+  struct SimdVector
+  {
+    typedef T type __attribute__((vector_size(bytes), aligned(sizeof(T)), may_alias));
+  };
+
+  template<typename V, typename C>
+  struct SimdNarrow<V, C, false>
+  {
+    typedef typename SimdVector<C, sizeof(V)/sizeof(typename SimdElement<V>::type)*sizeof(C)>::type type;
+    static inline __attribute__((always_inline)) void widen(V &v, const type &n) { v = __builtin_convertvector(n, V); }
+    static inline __attribute__((always_inline)) void narrow(type &n, const V &v) { n = __builtin_convertvector(v, type); }
+  };
+
+  // Half is converted by F16C, which rounds to the nearest even value as Half.h.
+  // The masked AVX-512 conversions avoid the undefined source operands of the
+  // unmasked ones, for which GCC warns that they may be used uninitialized.
+  // The conversions are not always_inline, as they cannot be inlined into the
+  // helpers above, which have no target. They are inlined into the variants
+  // below, whose targets include theirs.
+  typedef SimdVector<float,16>::type SimdFloat4;
+  typedef SimdVector<float,32>::type SimdFloat8;
+  typedef SimdVector<float,64>::type SimdFloat16;
+
+  inline __attribute__((target("f16c")))
+  void loadHalf(SimdFloat4 &v, const Half * const p)
+  {
+    v = reinterpret_cast<SimdFloat4>(_mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+  }
+
+  inline __attribute__((target("f16c")))
+  void loadHalf(SimdFloat8 &v, const Half * const p)
+  {
+    v = reinterpret_cast<SimdFloat8>(_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+  }
+
+  inline __attribute__((target("avx512f")))
+  void loadHalf(SimdFloat16 &v, const Half * const p)
+  {
+    v = reinterpret_cast<SimdFloat16>(_mm512_maskz_cvtph_ps(0xffff, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))));
+  }
+
+  inline __attribute__((target("f16c")))
+  void storeHalf(Half * const p, const SimdFloat4 &v)
+  {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_cvtps_ph(reinterpret_cast<__m128>(v), _MM_FROUND_TO_NEAREST_INT));
+  }
+
+  inline __attribute__((target("f16c")))
+  void storeHalf(Half * const p, const SimdFloat8 &v)
+  {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(reinterpret_cast<__m256>(v), _MM_FROUND_TO_NEAREST_INT));
+  }
+
+  inline __attribute__((target("avx512f")))
+  void storeHalf(Half * const p, const SimdFloat16 &v)
+  {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_maskz_cvtps_ph(0xffff, reinterpret_cast<__m512>(v), _MM_FROUND_TO_NEAREST_INT));
+  }
+
+  template<typename V>
+  struct SimdConvert<V, Half>
+  {
+    static inline __attribute__((always_inline)) void load(V &v, const Half * const p)
+    {
+      loadHalf(v, p);
+    }
+
+    static inline __attribute__((always_inline)) void store(Half * const p, const V &v)
+    {
+      storeHalf(p, v);
+    }
+  };
+
+  // BFloat16 is the upper half of float, see Half.h.
+  template<typename V>
+  struct SimdConvert<V, BFloat16>
+  {
+    typedef typename SimdVector<std::uint16_t,sizeof(V)/2>::type H;
+    typedef typename SimdVector<std::uint32_t,sizeof(V)>::type U;
+
+    static inline __attribute__((always_inline)) void load(V &v, const BFloat16 * const p)
+    {
+      const U h = __builtin_convertvector(*reinterpret_cast<const H*>(p), U);
+      convertBFloat16ToFloat(v, h);
+    }
+
+    static inline __attribute__((always_inline)) void store(BFloat16 * const p, const V &v)
+    {
+      U h;
+      convertFloatToBFloat16(h, v);
+      *reinterpret_cast<H*>(p) = __builtin_convertvector(h, H);
+    }
+  };
+
+  // The kernels are inlined into the variants below, which compile them
+  // for their instruction set. Every kernel finishes with a scalar loop
+  // over the elements that do not fill a complete vector.
+  template<int bytes, typename T>
+  inline __attribute__((always_inline))
+  void copyvecKernel(T * const restrict out, const T * const restrict in, const long size)
+  {
+    typedef typename SimdVector<T,bytes>::type V;
+    const long w = bytes / sizeof(T);
+
+    long n = 0;
+    for(; n+w<=size; n+=w)
+      *reinterpret_cast<V*>(&out[n]) = *reinterpret_cast<const V*>(&in[n]);
+    for(; n<size; ++n)
+      out[n] = in[n];
+  }
+
+  template<int bytes, typename T>
+  inline __attribute__((always_inline))
+  void copyaddvecKernel(T * const restrict out, const T * const restrict in, const long size)
+  {
+    typedef typename ComputeType<T>::type C;
+    typedef typename SimdVector<C,bytes>::type V;
+    const long w = bytes / sizeof(C);
+
+    long n = 0;
+    for(; n+w<=size; n+=w)
+    {
+      V a, b;
+      simdLoad(a, &out[n]);
+      simdLoad(b, &in[n]);
+      simdStore(&out[n], a + b);
+    }
+    for(; n<size; ++n)
+      out[n] = out[n] + in[n];
+  }
+
+  template<int bytes, typename TO, typename TI>
+  inline __attribute__((always_inline))
+  void convertvecKernel(TO * const restrict out, const TI * const restrict in, const long size)
+  {
+    // the vectors of the widest of both compute types fill the registers
+    typedef typename ComputeType<TO>::type CO;
+    typedef typename ComputeType<TI>::type CI;
+    const long w = bytes / (sizeof(CO) > sizeof(CI) ? sizeof(CO) : sizeof(CI));
+    typedef typename SimdVector<CO,w*sizeof(CO)>::type VO;
+    typedef typename SimdVector<CI,w*sizeof(CI)>::type VI;
+
+    long n = 0;
+    for(; n+w<=size; n+=w)
+    {
+      VI v;
+      simdLoad(v, &in[n]);
+      simdStore(&out[n], __builtin_convertvector(v, VO));
+    }
+    for(; n<size; ++n)
+      out[n] = static_cast<CO>(static_cast<CI>(in[n]));
+  }
+
+  template<int bytes, typename T>
+  inline __attribute__((always_inline))
+  void addvecsKernel(T * const out, const T * const a, const T * const b, const long size)
+  {
+    typedef typename ComputeType<T>::type C;
+    typedef typename SimdVector<C,bytes>::type V;
+    const long w = bytes / sizeof(C);
+
+    // every vector is loaded before it is stored, so out may alias a or b
+    long n = 0;
+    for(; n+w<=size; n+=w)
+    {
+      V va, vb;
+      simdLoad(va, &a[n]);
+      simdLoad(vb, &b[n]);
+      simdStore(&out[n], va + vb);
+    }
+    for(; n<size; ++n)
+      out[n] = a[n] + b[n];
+  }
+
+  // The reductions keep one vector of partial results that is reduced to
+  // a scalar at the end of the loop.
+  template<int bytes, typename T>
+  inline __attribute__((always_inline))
+  double sumKernel(const T * const in, const long size)
+  {
+    typedef typename ComputeType<T>::type C;
+    typedef typename SimdVector<C,bytes>::type V;
+    const long w = bytes / sizeof(C);
+
+    V vsum = {};
+    long n = 0;
+    for(; n+w<=size; n+=w)
+    {
+      V v;
+      simdLoad(v, &in[n]);
+      vsum += v;
+    }
+
+    double sum = 0.;
+    for(long m=0; m<w; ++m)
+      sum += vsum[m];
+    for(; n<size; ++n)
+      sum += in[n];
+    return sum;
+  }
+
+  template<int bytes, typename T>
+  inline __attribute__((always_inline))
+  double sumsquaresKernel(const T * const in, const T shift, const long size)
+  {
+    typedef typename ComputeType<T>::type C;
+    typedef typename SimdVector<C,bytes>::type V;
+    const long w = bytes / sizeof(C);
+    const C s = shift;
+
+    V vsum = {};
+    long n = 0;
+    for(; n+w<=size; n+=w)
+    {
+      V d;
+      simdLoad(d, &in[n]);
+      d -= s;
+      vsum += d*d;
+    }
+
+    double sum = 0.;
+    for(long m=0; m<w; ++m)
+      sum += vsum[m];
+    for(; n<size; ++n)
+      sum += (in[n]-s)*(in[n]-s);
+    return sum;
+  }
+
+  template<int bytes, typename T>
+  inline __attribute__((always_inline))
+  void powersumsKernel(double * const sums, const T * const in, const T shift, const long size)
+  {
+    typedef typename ComputeType<T>::type C;
+    typedef typename SimdVector<C,bytes>::type V;
+    const long w = bytes / sizeof(C);
+    const C s = shift;
+
+    V s1 = {}, s2 = {}, s3 = {}, s4 = {};
+    long n = 0;
+    for(; n+w<=size; n+=w)
+    {
+      V d;
+      simdLoad(d, &in[n]);
+      d -= s;
+      const V d2 = d*d;
+      s1 += d;
+      s2 += d2;
+      s3 += d2*d;
+      s4 += d2*d2;
+    }
+
+    for(long m=0; m<w; ++m)
+    {
+      sums[0] += s1[m];
+      sums[1] += s2[m];
+      sums[2] += s3[m];
+      sums[3] += s4[m];
+    }
+    for(; n<size; ++n)
+    {
+      const C d = in[n] - s;
+      sums[0] += d;
+      sums[1] += d*d;
+      sums[2] += d*d*d;
+      sums[3] += d*d*d*d;
+    }
+  }
+
+  template<int bytes, typename T>
+  inline __attribute__((always_inline))
+  void crosssumsKernel(double * const sums, const T * const a, const T * const b,
+                       const T shifta, const T shiftb, const long size)
+  {
+    typedef typename ComputeType<T>::type C;
+    typedef typename SimdVector<C,bytes>::type V;
+    const long w = bytes / sizeof(C);
+    const C sa0 = shifta;
+    const C sb0 = shiftb;
+
+    V sa = {}, sb = {}, sab = {};
+    long n = 0;
+    for(; n+w<=size; n+=w)
+    {
+      V da, db;
+      simdLoad(da, &a[n]);
+      simdLoad(db, &b[n]);
+      da -= sa0;
+      db -= sb0;
+      sa  += da;
+      sb  += db;
+      sab += da*db;
+    }
+
+    for(long m=0; m<w; ++m)
+    {
+      sums[0] += sa [m];
+      sums[1] += sb [m];
+      sums[2] += sab[m];
+    }
+    for(; n<size; ++n)
+    {
+      sums[0] += a[n] - sa0;
+      sums[1] += b[n] - sb0;
+      sums[2] += (a[n] - sa0)*(b[n] - sb0);
+    }
+  }
+
+  template<int bytes, bool ismax, typename T>
+  inline __attribute__((always_inline))
+  T extremeKernel(const T * const in, const long size)
+  {
+    typedef typename ComputeType<T>::type C;
+    typedef typename SimdVector<C,bytes>::type V;
+    const long w = bytes / sizeof(C);
+
+    C result = in[0];
+    long n = 0;
+    if(size >= w)
+    {
+      V vresult;
+      simdLoad(vresult, &in[0]);
+      for(n=w; n+w<=size; n+=w)
+      {
+        V v;
+        simdLoad(v, &in[n]);
+        vresult = ismax ? (v > vresult ? v : vresult) : (v < vresult ? v : vresult);
+      }
+      for(long m=0; m<w; ++m)
+        result = ismax ? std::max(result, vresult[m]) : std::min(result, vresult[m]);
+    }
+    for(; n<size; ++n)
+      result = ismax ? std::max(result, static_cast<C>(in[n])) : std::min(result, static_cast<C>(in[n]));
+    return result;
+  }
+
+  // The variants per instruction set.
+  template<typename T> __attribute__((target("avx2,fma,f16c")))
+  void copyvecAVX2(T * const restrict out, const T * const restrict in, const long size)
+  {
+    copyvecKernel<32>(out, in, size);
+  }
+
+  template<typename T> __attribute__((target("avx512f,f16c")))
+  void copyvecAVX512(T * const restrict out, const T * const restrict in, const long size)
+  {
+    copyvecKernel<64>(out, in, size);
+  }
+
+  template<typename TO, typename TI> __attribute__((target("avx2,fma,f16c")))
+  void convertvecAVX2(TO * const restrict out, const TI * const restrict in, const long size)
+  {
+    convertvecKernel<32>(out, in, size);
+  }
+
+  template<typename TO, typename TI> __attribute__((target("avx512f,f16c")))
+  void convertvecAVX512(TO * const restrict out, const TI * const restrict in, const long size)
+  {
+    convertvecKernel<64>(out, in, size);
+  }
+
+  template<typename T> __attribute__((target("avx2,fma,f16c")))
+  void copyaddvecAVX2(T * const restrict out, const T * const restrict in, const long size)
+  {
+    copyaddvecKernel<32>(out, in, size);
+  }
+
+  template<typename T> __attribute__((target("avx512f,f16c")))
+  void copyaddvecAVX512(T * const restrict out, const T * const restrict in, const long size)
+  {
+    copyaddvecKernel<64>(out, in, size);
+  }
+
+  template<typename T> __attribute__((target("avx2,fma,f16c")))
+  void addvecsAVX2(T * const out, const T * const a, const T * const b, const long size)
+  {
+    addvecsKernel<32>(out, a, b, size);
+  }
+
+  template<typename T> __attribute__((target("avx512f,f16c")))
+  void addvecsAVX512(T * const out, const T * const a, const T * const b, const long size)
+  {
+    addvecsKernel<64>(out, a, b, size);
+  }
+
+  template<typename T> __attribute__((target("avx2,fma,f16c")))
+  double sumAVX2(const T * const in, const long size)
+  {
+    return sumKernel<32>(in, size);
+  }
+
+  template<typename T> __attribute__((target("avx512f,f16c")))
+  double sumAVX512(const T * const in, const long size)
+  {
+    return sumKernel<64>(in, size);
+  }
+
+  template<typename T> __attribute__((target("avx2,fma,f16c")))
+  double sumsquaresAVX2(const T * const in, const T shift, const long size)
+  {
+    return sumsquaresKernel<32>(in, shift, size);
+  }
+
+  template<typename T> __attribute__((target("avx512f,f16c")))
+  double sumsquaresAVX512(const T * const in, const T shift, const long size)
+  {
+    return sumsquaresKernel<64>(in, shift, size);
+  }
+
+  template<typename T> __attribute__((target("avx2,fma,f16c")))
+  void powersumsAVX2(double * const sums, const T * const in, const T shift, const long size)
+  {
+    powersumsKernel<32>(sums, in, shift, size);
+  }
+
+  template<typename T> __attribute__((target("avx512f,f16c")))
+  void powersumsAVX512(double * const sums, const T * const in, const T shift, const long size)
+  {
+    powersumsKernel<64>(sums, in, shift, size);
+  }
+
+  template<typename T> __attribute__((target("avx2,fma,f16c")))
+  void crosssumsAVX2(double * const sums, const T * const a, const T * const b,
+                     const T shifta, const T shiftb, const long size)
+  {
+    crosssumsKernel<32>(sums, a, b, shifta, shiftb, size);
+  }
+
+  template<typename T> __attribute__((target("avx512f,f16c")))
+  void crosssumsAVX512(double * const sums, const T * const a, const T * const b,
+                       const T shifta, const T shiftb, const long size)
+  {
+    crosssumsKernel<64>(sums, a, b, shifta, shiftb, size);
+  }
+
+  template<bool ismax, typename T> __attribute__((target("avx2,fma,f16c")))
+  T extremeAVX2(const T * const in, const long size)
+  {
+    return extremeKernel<32, ismax>(in, size);
+  }
+
+  template<bool ismax, typename T> __attribute__((target("avx512f,f16c")))
+  T extremeAVX512(const T * const in, const long size)
+  {
+    return extremeKernel<64, ismax>(in, size);
+  }
+}
+#endif
+
+template<typename T>
+inline void simdCopyVec(T * const restrict out, const T * const restrict in, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: copyvecAVX512(out, in, size); return;
+    case SimdAVX2  : copyvecAVX2  (out, in, size); return;
+    default        : break;
+  }
+  #endif
+
+  for(long n=0; n<size; ++n)
+    out[n] = in[n];
+}
+
+inline void simdCopyVec(Half * const restrict out, const Half * const restrict in, const long size)
+{
+  simdCopyVec(reinterpret_cast<std::uint16_t*>(out), reinterpret_cast<const std::uint16_t*>(in), size);
+}
+
+inline void simdCopyVec(BFloat16 * const restrict out, const BFloat16 * const restrict in, const long size)
+{
+  simdCopyVec(reinterpret_cast<std::uint16_t*>(out), reinterpret_cast<const std::uint16_t*>(in), size);
+}
+
+template<typename TO, typename TI>
+inline void simdConvertVec(TO * const restrict out, const TI * const restrict in, const long size)
+{
+  typedef typename ComputeType<TO>::type CO;
+  typedef typename ComputeType<TI>::type CI;
+
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: convertvecAVX512(out, in, size); return;
+    case SimdAVX2  : convertvecAVX2  (out, in, size); return;
+    default        : break;
+  }
+  #endif
+
+  for(long n=0; n<size; ++n)
+    out[n] = static_cast<CO>(static_cast<CI>(in[n]));
+}
+
+template<typename T>
+inline void simdCopyAddVec(T * const restrict out, const T * const restrict in, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: copyaddvecAVX512(out, in, size); return;
+    case SimdAVX2  : copyaddvecAVX2  (out, in, size); return;
+    default        : break;
+  }
+  #endif
+
+  for(long n=0; n<size; ++n)
+    out[n] = out[n] + in[n];
+}
+
+template<typename T>
+inline void simdAddVecs(T * const out, const T * const a, const T * const b, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: addvecsAVX512(out, a, b, size); return;
+    case SimdAVX2  : addvecsAVX2  (out, a, b, size); return;
+    default        : break;
+  }
+  #endif
+
+  for(long n=0; n<size; ++n)
+    out[n] = a[n] + b[n];
+}
+template<typename T>
+inline double simdSum(const T * const in, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: return sumAVX512(in, size);
+    case SimdAVX2  : return sumAVX2  (in, size);
+    default        : break;
+  }
+  #endif
+
+  double sum = 0.;
+  for(long n=0; n<size; ++n)
+    sum += in[n];
+  return sum;
+}
+
+template<typename T>
+inline double simdSumSquares(const T * const in, const T shift, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: return sumsquaresAVX512(in, shift, size);
+    case SimdAVX2  : return sumsquaresAVX2  (in, shift, size);
+    default        : break;
+  }
+  #endif
+
+  double sum = 0.;
+  for(long n=0; n<size; ++n)
+    sum += (in[n]-shift)*(in[n]-shift);
+  return sum;
+}
+
+template<typename T>
+inline void simdPowerSums(double * const sums, const T * const in, const T shift, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: powersumsAVX512(sums, in, shift, size); return;
+    case SimdAVX2  : powersumsAVX2  (sums, in, shift, size); return;
+    default        : break;
+  }
+  #endif
+
+  typedef typename ComputeType<T>::type C;
+  const C s = shift;
+
+  for(long n=0; n<size; ++n)
+  {
+    const C d = in[n] - s;
+    sums[0] += d;
+    sums[1] += d*d;
+    sums[2] += d*d*d;
+    sums[3] += d*d*d*d;
+  }
+}
+
+template<typename T>
+inline void simdCrossSums(double * const sums, const T * const a, const T * const b,
+                          const T shifta, const T shiftb, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: crosssumsAVX512(sums, a, b, shifta, shiftb, size); return;
+    case SimdAVX2  : crosssumsAVX2  (sums, a, b, shifta, shiftb, size); return;
+    default        : break;
+  }
+  #endif
+
+  for(long n=0; n<size; ++n)
+  {
+    sums[0] += a[n] - shifta;
+    sums[1] += b[n] - shiftb;
+    sums[2] += (a[n] - shifta)*(b[n] - shiftb);
+  }
+}
+
+template<typename T>
+inline T simdMin(const T * const in, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: return extremeAVX512<false>(in, size);
+    case SimdAVX2  : return extremeAVX2  <false>(in, size);
+    default        : break;
+  }
+  #endif
+
+  T result = in[0];
+  for(long n=1; n<size; ++n)
+    result = std::min(result, in[n]);
+  return result;
+}
+
+template<typename T>
+inline T simdMax(const T * const in, const long size)
+{
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: return extremeAVX512<true>(in, size);
+    case SimdAVX2  : return extremeAVX2  <true>(in, size);
+    default        : break;
+  }
+  #endif
+
+  T result = in[0];
+  for(long n=1; n<size; ++n)
+    result = std::max(result, in[n]);
+  return result;
+}
+#endif
@@ -0,0 +1,325 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STATISTICS
+#define STATISTICS
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+
+// Central moments of the horizontal slabs, one value per interior level.
+struct MomentProfiles
+{
+  std::vector<double> mean;
+  std::vector<double> variance;
+  std::vector<double> skewness;
+  std::vector<double> kurtosis;
+};
+
+enum StatisticsType { StatisticsMean, StatisticsVariance, StatisticsSkewness, StatisticsKurtosis, StatisticsCovariance };
+
+// Request for the profile of a moment of field a, or of the covariance of
+// fields a and b, in which the indices refer to the list of fields passed to
+// Statistics::calcProfiles. The profile is filled by calcProfiles.
+struct ProfileRequest
+{
+  ProfileRequest(StatisticsType typein, int ain, int bin=-1) : type(typein), a(ain), b(bin) {}
+
+  StatisticsType type;
+  int a;
+  int b;
+  std::vector<double> profile;
+};
+
+// Profiles of statistics over the i-j planes of the interior, including the
+// planes of all processes. All requested profiles are computed in a single pass,
+// in which every field is read once. The levels are distributed over the
+// ThreadPool and for every row all statistics are accumulated while the row is
+// in the L1 cache, with the vector kernels of Simd.h. Each process accumulates
+// the powers of the deviations from the first value of its plane, which are
+// shifted to the global mean after it has been reduced over the processes.
+// This is as stable as a Welford update per value, but vectorizes.
+template<class T, class TF>
+class Statistics
+{
+  public:
+    Statistics(Grid<T> &);
+    virtual ~Statistics();
+
+    void calcProfiles(std::vector<ProfileRequest>&, const std::vector<const Field<TF,T>*>&);
+
+    void calcMean(std::vector<double>&, const Field<TF,T>&);
+    void calcMoments(MomentProfiles&, const Field<TF,T>&);
+
+    // covariance of two fields, for instance the flux w'b'
+    void calcCovariance(std::vector<double>&, const Field<TF,T>&, const Field<TF,T>&);
+
+  protected:
+    Grid<T> &grid;
+
+  private:
+    template<class F> void forLevels(F) const;
+    const TF *getPlane(const Field<TF,T>&, long) const;
+};
+
+
+// IMPLEMENTATION BELOW
+template<class T, class TF>
+inline Statistics<T,TF>::Statistics(Grid<T> &gridin) :
+  grid(gridin)
+{
+  Master &master = Master::getInstance();
+  master.printMessage("Constructed Statistics\n");
+}
+
+template<class T, class TF>
+inline Statistics<T,TF>::~Statistics()
+{
+  Master &master = Master::getInstance();
+  master.printMessage("Destructed Statistics\n");
+}
+
+// Call f(k) for the interior levels k = 0 to kmax-1, one level per chunk.
+template<class T, class TF>
+template<class F>
+inline void Statistics<T,TF>::forLevels(F f) const
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, grid.getDims().kmax, 1, [&](const long begin, const long end)
+  {
+    for(long k=begin; k<end; ++k)
+      f(k);
+  });
+}
+
+// the first interior point of interior level k
+template<class T, class TF>
+inline const TF *Statistics<T,TF>::getPlane(const Field<TF,T> &field, const long k) const
+{
+  const GridDims &dims = grid.getDims();
+  return &field.data[dims.istart + dims.jstart*dims.icells + (dims.kstart + k)*dims.ijcells];
+}
+
+template<class T, class TF>
+inline void Statistics<T,TF>::calcProfiles(std::vector<ProfileRequest> &requests,
+                                           const std::vector<const Field<TF,T>*> &fields)
+{
+  Master &master = Master::getInstance();
+  const GridDims &dims = grid.getDims();
+  const long kmax = dims.kmax;
+  const double nlocal = dims.imax*dims.jmax;
+  const double ntot = dims.itot*dims.jtot;
+  const long nfields = fields.size();
+
+  // The highest power of its deviations that is needed per field, and the
+  // pairs of fields of the covariances.
+  std::vector<int> order(nfields, 0);
+  std::vector<std::pair<int,int> > pairs;
+  std::vector<long> pairindex(requests.size(), -1);
+
+  for(size_t n=0; n<requests.size(); ++n)
+  {
+    const ProfileRequest &r = requests[n];
+    const bool iscovariance = r.type == StatisticsCovariance;
+    if(r.a < 0 || r.a >= nfields || (iscovariance && (r.b < 0 || r.b >= nfields)))
+    {
+      master.printError("Statistics request refers to a field that does not exist\n");
+      throw 1;
+    }
+    if(&fields[r.a]->getGrid() != &grid || (iscovariance && &fields[r.b]->getGrid() != &grid))
+    {
+      master.printError("Statistics request refers to a field on another Grid\n");
+      throw 1;
+    }
+
+    if(iscovariance)
+    {
+      order[r.a] = std::max(order[r.a], 1);
+      order[r.b] = std::max(order[r.b], 1);
+
+      const std::pair<int,int> pair(r.a, r.b);
+      pairindex[n] = std::find(pairs.begin(), pairs.end(), pair) - pairs.begin();
+      if(pairindex[n] == static_cast<long>(pairs.size()))
+        pairs.push_back(pair);
+    }
+    else
+      order[r.a] = std::max(order[r.a], static_cast<int>(r.type) + 1);
+  }
+  const long npairs = pairs.size();
+
+  // The single pass: the sums of the powers 1 to 4 of the deviations from the
+  // shift per field and level, and the sums of the products of the deviations
+  // per pair and level, of which the first two are not used.
+  std::vector<double> sums(4*nfields*kmax, 0.);
+  std::vector<double> products(3*npairs*kmax, 0.);
+  std::vector<TF> shift(nfields*kmax);
+
+  forLevels([&](const long k)
+  {
+    for(long f=0; f<nfields; ++f)
+      if(order[f] > 0)
+        shift[f*kmax + k] = getPlane(*fields[f], k)[0];
+
+    for(long j=0; j<dims.jmax; ++j)
+    {
+      const long jj = j*dims.icells;
+
+      for(long f=0; f<nfields; ++f)
+      {
+        const TF *row = getPlane(*fields[f], k) + jj;
+        const TF s = shift[f*kmax + k];
+        double *sum = &sums[4*(f*kmax + k)];
+
+        if(order[f] == 1)
+          sum[0] += simdSum(row, dims.imax) - dims.imax*static_cast<double>(s);
+        else if(order[f] > 1)
+          simdPowerSums(sum, row, s, dims.imax);
+      }
+
+      for(long p=0; p<npairs; ++p)
+      {
+        const int a = pairs[p].first;
+        const int b = pairs[p].second;
+        simdCrossSums(&products[3*(p*kmax + k)],
+                      getPlane(*fields[a], k) + jj, getPlane(*fields[b], k) + jj,
+                      shift[a*kmax + k], shift[b*kmax + k], dims.imax);
+      }
+    }
+  });
+
+  // the global means
+  std::vector<double> means(nfields*kmax);
+  for(long n=0; n<nfields*kmax; ++n)
+    means[n] = sums[4*n] + nlocal*shift[n];
+  master.sum(means.data(), nfields*kmax);
+  for(long n=0; n<nfields*kmax; ++n)
+    means[n] /= ntot;
+
+  // sum (a - mean)^p = sum (d + delta)^p, with d = a - shift and delta = shift - mean,
+  // and in the same way for the products of the covariances
+  std::vector<double> central(3*nfields*kmax + npairs*kmax, 0.);
+  for(long n=0; n<nfields*kmax; ++n)
+  {
+    if(order[n/kmax] < 2)
+      continue;
+
+    const double *s = &sums[4*n];
+    const double d  = shift[n] - means[n];
+    const double d2 = d*d;
+    central[3*n  ] = s[1] + 2.*d*s[0] + nlocal*d2;
+    central[3*n+1] = s[2] + 3.*d*s[1] + 3.*d2*s[0] + nlocal*d2*d;
+    central[3*n+2] = s[3] + 4.*d*s[2] + 6.*d2*s[1] + 4.*d2*d*s[0] + nlocal*d2*d2;
+  }
+
+  double *covariances = &central[3*nfields*kmax];
+  for(long p=0; p<npairs; ++p)
+    for(long k=0; k<kmax; ++k)
+    {
+      const long na = pairs[p].first *kmax + k;
+      const long nb = pairs[p].second*kmax + k;
+      const double deltaa = shift[na] - means[na];
+      const double deltab = shift[nb] - means[nb];
+      covariances[p*kmax + k] = products[3*(p*kmax + k) + 2]
+                              + deltaa*sums[4*nb] + deltab*sums[4*na] + nlocal*deltaa*deltab;
+    }
+
+  master.sum(central.data(), central.size());
+
+  for(size_t n=0; n<requests.size(); ++n)
+  {
+    ProfileRequest &r = requests[n];
+    r.profile.resize(kmax);
+
+    for(long k=0; k<kmax; ++k)
+    {
+      const long nk = r.a*kmax + k;
+      const double variance = central[3*nk] / ntot;
+
+      switch(r.type)
+      {
+        case StatisticsMean:
+          r.profile[k] = means[nk];
+          break;
+        case StatisticsVariance:
+          r.profile[k] = variance;
+          break;
+        // a uniform plane has no skewness and kurtosis
+        case StatisticsSkewness:
+          r.profile[k] = variance > 0. ? central[3*nk+1] / ntot / std::pow(variance, 1.5) : 0.;
+          break;
+        case StatisticsKurtosis:
+          r.profile[k] = variance > 0. ? central[3*nk+2] / ntot / (variance*variance) : 0.;
+          break;
+        case StatisticsCovariance:
+          r.profile[k] = covariances[pairindex[n]*kmax + k] / ntot;
+          break;
+      }
+    }
+  }
+}
+
+template<class T, class TF>
+inline void Statistics<T,TF>::calcMean(std::vector<double> &mean, const Field<TF,T> &field)
+{
+  std::vector<ProfileRequest> requests(1, ProfileRequest(StatisticsMean, 0));
+  calcProfiles(requests, std::vector<const Field<TF,T>*>(1, &field));
+  mean.swap(requests[0].profile);
+}
+
+template<class T, class TF>
+inline void Statistics<T,TF>::calcMoments(MomentProfiles &moments, const Field<TF,T> &field)
+{
+  std::vector<ProfileRequest> requests;
+  requests.push_back(ProfileRequest(StatisticsMean    , 0));
+  requests.push_back(ProfileRequest(StatisticsVariance, 0));
+  requests.push_back(ProfileRequest(StatisticsSkewness, 0));
+  requests.push_back(ProfileRequest(StatisticsKurtosis, 0));
+  calcProfiles(requests, std::vector<const Field<TF,T>*>(1, &field));
+
+  moments.mean    .swap(requests[0].profile);
+  moments.variance.swap(requests[1].profile);
+  moments.skewness.swap(requests[2].profile);
+  moments.kurtosis.swap(requests[3].profile);
+}
+
+template<class T, class TF>
+inline void Statistics<T,TF>::calcCovariance(std::vector<double> &covariance,
+                                             const Field<TF,T> &a, const Field<TF,T> &b)
+{
+  std::vector<const Field<TF,T>*> fields;
+  fields.push_back(&a);
+  fields.push_back(&b);
+
+  std::vector<ProfileRequest> requests(1, ProfileRequest(StatisticsCovariance, 0, 1));
+  calcProfiles(requests, fields);
+  covariance.swap(requests[0].profile);
+}
+#endif
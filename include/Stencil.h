@@ -0,0 +1,551 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STENCIL
+#define STENCIL
+
+#include <sstream>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "FieldView.h"
+#include "ThreadPool.h"
+#include "Simd.h"
+
+// A stencil is a compile-time list of points, each with an offset (di, dj, dk)
+// and a rational coefficient num/den. The points are unrolled into a single
+// expression, that is evaluated for scalars, for the vectors of Simd.h and in
+// CUDA kernels. An operator combines several stencils, each of which is
+// applied to its own input with its own runtime scale factor, such that for
+// instance the grid spacing of every direction can be included.
+//
+// The points are summed in the order of the list, so that two stencils with
+// the same list of points give identical results. The sums are computed in the
+// type of the scales, which is the ComputeType of the stored type, see Half.h,
+// or double. The points are converted into it when they are loaded, so that
+// for instance Fields of float or Half can be accumulated in double.
+
+#ifdef __CUDACC__
+#define STENCILINLINE __host__ __device__ inline
+#else
+#define STENCILINLINE inline __attribute__((always_inline))
+#endif
+
+namespace
+{
+  constexpr int stencilAbs(const int n) { return n < 0 ? -n : n; }
+  constexpr int stencilMax(const int a, const int b) { return a > b ? a : b; }
+
+  // CUDA kernels only compute with float and double, see Simd.h for the others
+  template<typename V, typename T>
+  STENCILINLINE void stencilLoad(V &v, const T * const p)
+  {
+    #ifdef __CUDACC__
+    v = *reinterpret_cast<const V*>(p);
+    #else
+    simdLoad(v, p);
+    #endif
+  }
+
+  template<typename V, typename T>
+  STENCILINLINE void stencilStore(T * const p, const V &v)
+  {
+    #ifdef __CUDACC__
+    *reinterpret_cast<V*>(p) = v;
+    #else
+    simdStore(p, v);
+    #endif
+  }
+}
+
+template<int di, int dj, int dk, long num, long den=1>
+struct StencilPoint
+{
+  // number of ghost cells the point needs
+  static const int width = stencilMax(stencilAbs(di), stencilMax(stencilAbs(dj), stencilAbs(dk)));
+
+  template<typename T>
+  STENCILINLINE static T coefficient() { return static_cast<T>(num) / static_cast<T>(den); }
+
+  // V is the compute type, the ComputeType of T or double, or a vector of it,
+  // into which the points of a are converted when they are loaded.
+  template<typename V, typename T>
+  STENCILINLINE static void set(V &sum, const T * const a, const long ijk, const long jj1, const long kk1)
+  {
+    typedef typename SimdElement<V>::type C;
+    V v;
+    stencilLoad(v, &a[ijk + di + dj*jj1 + dk*kk1]);
+    sum = coefficient<C>() * v;
+  }
+
+  template<typename V, typename T>
+  STENCILINLINE static void add(V &sum, const T * const a, const long ijk, const long jj1, const long kk1)
+  {
+    typedef typename SimdElement<V>::type C;
+    V v;
+    stencilLoad(v, &a[ijk + di + dj*jj1 + dk*kk1]);
+    sum += coefficient<C>() * v;
+  }
+};
+
+// Point at distance n along direction dir, with 0, 1 and 2 for x, y and z.
+template<int dir, int n, long num, long den=1>
+using AxisPoint = StencilPoint<dir==0 ? n : 0, dir==1 ? n : 0, dir==2 ? n : 0, num, den>;
+
+template<class... Points>
+struct Stencil;
+
+template<class P>
+struct Stencil<P>
+{
+  static const int width = P::width;
+
+  template<typename V, typename T>
+  STENCILINLINE static void apply(V &sum, const T * const a, const long ijk, const long jj1, const long kk1)
+  {
+    P::set(sum, a, ijk, jj1, kk1);
+  }
+
+  template<typename V, typename T>
+  STENCILINLINE static void accumulate(V &sum, const T * const a, const long ijk, const long jj1, const long kk1)
+  {
+    P::add(sum, a, ijk, jj1, kk1);
+  }
+};
+
+template<class P, class... Rest>
+struct Stencil<P, Rest...>
+{
+  static const int width = stencilMax(P::width, Stencil<Rest...>::width);
+
+  // sum = the stencil of a in point ijk
+  template<typename V, typename T>
+  STENCILINLINE static void apply(V &sum, const T * const a, const long ijk, const long jj1, const long kk1)
+  {
+    P::set(sum, a, ijk, jj1, kk1);
+    Stencil<Rest...>::accumulate(sum, a, ijk, jj1, kk1);
+  }
+
+  template<typename V, typename T>
+  STENCILINLINE static void accumulate(V &sum, const T * const a, const long ijk, const long jj1, const long kk1)
+  {
+    P::add(sum, a, ijk, jj1, kk1);
+    Stencil<Rest...>::accumulate(sum, a, ijk, jj1, kk1);
+  }
+};
+
+// Concatenate the points of several stencils into one stencil.
+template<class... Stencils>
+struct StencilJoin;
+
+template<class S>
+struct StencilJoin<S>
+{
+  typedef S type;
+};
+
+template<class... A, class... B, class... Rest>
+struct StencilJoin<Stencil<A...>, Stencil<B...>, Rest...>
+{
+  typedef typename StencilJoin<Stencil<A..., B...>, Rest...>::type type;
+};
+
+// Centered first derivatives of order 2, 4 and 6 on a collocated grid, without grid spacing.
+template<int order, int dir>
+struct FirstDerivative;
+
+template<int dir>
+struct FirstDerivative<2, dir>
+{
+  typedef Stencil<AxisPoint<dir,-1,-1,2>, AxisPoint<dir,1,1,2> > type;
+};
+
+template<int dir>
+struct FirstDerivative<4, dir>
+{
+  typedef Stencil<AxisPoint<dir,-2,1,12>, AxisPoint<dir,-1,-8,12>,
+                  AxisPoint<dir, 1,8,12>, AxisPoint<dir, 2,-1,12> > type;
+};
+
+template<int dir>
+struct FirstDerivative<6, dir>
+{
+  typedef Stencil<AxisPoint<dir,-3,-1,60>, AxisPoint<dir,-2,9,60>, AxisPoint<dir,-1,-45,60>,
+                  AxisPoint<dir, 1,45,60>, AxisPoint<dir, 2,-9,60>, AxisPoint<dir, 3,  1,60> > type;
+};
+
+// Centered second derivatives of order 2, 4 and 6 on a collocated grid, without grid spacing.
+template<int order, int dir>
+struct SecondDerivative;
+
+template<int dir>
+struct SecondDerivative<2, dir>
+{
+  typedef Stencil<AxisPoint<dir,-1,1>, AxisPoint<dir,0,-2>, AxisPoint<dir,1,1> > type;
+};
+
+template<int dir>
+struct SecondDerivative<4, dir>
+{
+  typedef Stencil<AxisPoint<dir,-2,-1,12>, AxisPoint<dir,-1,16,12>, AxisPoint<dir,0,-30,12>,
+                  AxisPoint<dir, 1,16,12>, AxisPoint<dir, 2,-1,12> > type;
+};
+
+template<int dir>
+struct SecondDerivative<6, dir>
+{
+  typedef Stencil<AxisPoint<dir,-3,2,180>, AxisPoint<dir,-2,-27,180>, AxisPoint<dir,-1,270,180>,
+                  AxisPoint<dir, 0,-490,180>,
+                  AxisPoint<dir, 1,270,180>, AxisPoint<dir, 2,-27,180>, AxisPoint<dir, 3,  2,180> > type;
+};
+
+// Second derivative of the fourth order staggered scheme of MicroHH, which is
+// the fourth order first derivative applied twice, without grid spacing.
+template<int dir>
+struct StaggeredSecondDerivative
+{
+  typedef Stencil<AxisPoint<dir,-3,1,576>, AxisPoint<dir,-2,-54,576>, AxisPoint<dir,-1,783,576>,
+                  AxisPoint<dir, 0,-1460,576>,
+                  AxisPoint<dir, 1,783,576>, AxisPoint<dir, 2,-54,576>, AxisPoint<dir, 3,  1,576> > type;
+};
+
+// The stencil of Diffusion and DiffusionGPU.
+typedef StencilJoin<StaggeredSecondDerivative<0>::type,
+                    StaggeredSecondDerivative<1>::type,
+                    StaggeredSecondDerivative<2>::type>::type DiffusionStencil;
+
+// Sum of stencils, of which stencil n is applied to in[n] and multiplied with scale[n].
+template<class... Stencils>
+struct StencilOperator;
+
+template<class S>
+struct StencilOperator<S>
+{
+  static const int width = S::width;
+  static const int nterms = 1;
+
+  template<int n, typename V, typename T, typename C>
+  STENCILINLINE static void accumulate(V &sum, const T * const * const in, const C * const scale,
+                                       const long ijk, const long jj1, const long kk1)
+  {
+    V term;
+    S::apply(term, in[n], ijk, jj1, kk1);
+    sum += scale[n]*term;
+  }
+
+  template<typename V, typename T, typename C>
+  STENCILINLINE static void apply(V &sum, const T * const * const in, const C * const scale,
+                                  const long ijk, const long jj1, const long kk1)
+  {
+    S::apply(sum, in[0], ijk, jj1, kk1);
+    sum = scale[0]*sum;
+  }
+};
+
+template<class S, class... Rest>
+struct StencilOperator<S, Rest...>
+{
+  static const int width = stencilMax(S::width, StencilOperator<Rest...>::width);
+  static const int nterms = 1 + sizeof...(Rest);
+
+  template<int n, typename V, typename T, typename C>
+  STENCILINLINE static void accumulate(V &sum, const T * const * const in, const C * const scale,
+                                       const long ijk, const long jj1, const long kk1)
+  {
+    StencilOperator<S>::template accumulate<n>(sum, in, scale, ijk, jj1, kk1);
+    StencilOperator<Rest...>::template accumulate<n+1>(sum, in, scale, ijk, jj1, kk1);
+  }
+
+  template<typename V, typename T, typename C>
+  STENCILINLINE static void apply(V &sum, const T * const * const in, const C * const scale,
+                                  const long ijk, const long jj1, const long kk1)
+  {
+    StencilOperator<S>::apply(sum, in, scale, ijk, jj1, kk1);
+    StencilOperator<Rest...>::template accumulate<1>(sum, in, scale, ijk, jj1, kk1);
+  }
+};
+
+// Ways to store the result of an operator, which is a scalar or a vector V.
+struct StencilSet
+{
+  template<class V, class T> STENCILINLINE static void apply(T * const a, const V &b) { stencilStore(a, b); }
+};
+
+struct StencilAdd
+{
+  template<class V, class T> STENCILINLINE static void apply(T * const a, const V &b)
+  {
+    V v;
+    stencilLoad(v, a);
+    stencilStore(a, v + b);
+  }
+};
+
+// Apply operator Op to the ni x nj x nk block that starts at out and at every
+// in[n]. The output and the input have their own strides, such that operators
+// can be applied to buffers that are laid out differently than the fields.
+// The scales are in the compute type C, as they may exceed the range of T,
+// which is the ComputeType of T or double.
+template<class Assign, class Op, typename T, typename C>
+void execStencil(T * const, const T * const * const, const C * const,
+                 long, long, long, long, long, long, long);
+
+// Apply operator Op to views of the same shape, see FieldView.h, distributed
+// over k. The inputs need to share their strides and need the points that the
+// operator reads around them, for instance the ghost cells of their Field.
+template<class Assign, class Op, typename T, typename C>
+void execStencil(const FieldView<T> &, const FieldView<const T> * const, const C * const, bool threaded=true);
+
+// The operators below need Fields of the same shape, of which out cannot be
+// one of the inputs, as the inputs are read around the points of out.
+
+// out = d(in)/dx, d(in)/dy or d(in)/dz for dir 0, 1 or 2, on the interior
+template<int order, int dir, class T, class TG>
+void gradient(Field<T,TG> &, const Field<T,TG> &, bool threaded=true);
+
+// out = the laplacian of in, on the interior
+template<int order, class T, class TG>
+void laplacian(Field<T,TG> &, const Field<T,TG> &, bool threaded=true);
+
+// out = du/dx + dv/dy + dw/dz, on the interior
+template<int order, class T, class TG>
+void divergence(Field<T,TG> &, const Field<T,TG> &, const Field<T,TG> &, const Field<T,TG> &, bool threaded=true);
+
+
+// IMPLEMENTATION BELOW
+namespace
+{
+  // The vector loop runs over w points at once with V a vector of w elements,
+  // the remaining points of a row are done with scalars.
+  template<class Assign, class Op, typename V, int w, typename T, typename C>
+  inline __attribute__((always_inline))
+  void stencilKernel(T * const out, const T * const * const in, const C * const scale,
+                     const long ni, const long nj, const long nk,
+                     const long outjj, const long outkk, const long injj, const long inkk)
+  {
+    // Local copies of the pointers and scales, as the stores through the
+    // vectors may alias anything and would force them to be reloaded.
+    const T *inlocal[Op::nterms];
+    C scalelocal[Op::nterms];
+    for(int n=0; n<Op::nterms; ++n)
+    {
+      inlocal[n] = in[n];
+      scalelocal[n] = scale[n];
+    }
+
+    for(long k=0; k<nk; ++k)
+      for(long j=0; j<nj; ++j)
+      {
+        long i = 0;
+        for(; i+w<=ni; i+=w)
+        {
+          V sum;
+          Op::apply(sum, inlocal, scalelocal, i + j*injj + k*inkk, injj, inkk);
+          Assign::apply(&out[i + j*outjj + k*outkk], sum);
+        }
+        for(; i<ni; ++i)
+        {
+          C sum;
+          Op::apply(sum, inlocal, scalelocal, i + j*injj + k*inkk, injj, inkk);
+          Assign::apply(&out[i + j*outjj + k*outkk], sum);
+        }
+      }
+  }
+
+  #ifdef SIMDDISPATCH
+  template<class Assign, class Op, typename T, typename C> __attribute__((target("avx2,fma,f16c")))
+  void stencilAVX2(T * const out, const T * const * const in, const C * const scale,
+                   const long ni, const long nj, const long nk,
+                   const long outjj, const long outkk, const long injj, const long inkk)
+  {
+    stencilKernel<Assign, Op, typename SimdVector<C,32>::type, 32/sizeof(C)>(
+        out, in, scale, ni, nj, nk, outjj, outkk, injj, inkk);
+  }
+
+  template<class Assign, class Op, typename T, typename C> __attribute__((target("avx512f,f16c")))
+  void stencilAVX512(T * const out, const T * const * const in, const C * const scale,
+                     const long ni, const long nj, const long nk,
+                     const long outjj, const long outkk, const long injj, const long inkk)
+  {
+    stencilKernel<Assign, Op, typename SimdVector<C,64>::type, 64/sizeof(C)>(
+        out, in, scale, ni, nj, nk, outjj, outkk, injj, inkk);
+  }
+  #endif
+
+  // Apply an operator to the interior of the grid, distributed over k.
+  template<class Assign, class Op, class T, class TG, typename C>
+  inline void execOperator(Field<T,TG> &out, const Field<T,TG> * const * const in,
+                           const C * const scale, const bool threaded)
+  {
+    const GridDims &dims = out.getGrid().getDims();
+
+    if(dims.igc < Op::width || dims.jgc < Op::width || dims.kgc < Op::width)
+    {
+      Master &master = Master::getInstance();
+      std::ostringstream message;
+      message << "The stencil requires at least " << Op::width << " ghost cells\n";
+      master.printError(message.str());
+      throw 1;
+    }
+
+    for(int n=0; n<Op::nterms; ++n)
+    {
+      if(!out.hasSameShape(*in[n]))
+      {
+        Master &master = Master::getInstance();
+        master.printError("ERROR Field " + in[n]->getName() + " does not match the shape of Field " + out.getName() + "\n");
+        throw 1;
+      }
+
+      if(in[n]->data.data() == out.data.data())
+      {
+        Master &master = Master::getInstance();
+        master.printError("ERROR the output Field " + out.getName() + " of a stencil cannot be one of its inputs\n");
+        throw 1;
+      }
+    }
+
+    const long ijk = dims.istart + dims.jstart*dims.icells + dims.kstart*dims.ijcells;
+
+    auto exec = [&](const long kstart, const long kend)
+    {
+      const T *inptr[Op::nterms];
+      for(int n=0; n<Op::nterms; ++n)
+        inptr[n] = in[n]->data.data() + ijk + (kstart-dims.kstart)*dims.ijcells;
+
+      execStencil<Assign, Op>(out.data.data() + ijk + (kstart-dims.kstart)*dims.ijcells, inptr, scale,
+                              dims.imax, dims.jmax, kend-kstart,
+                              dims.icells, dims.ijcells, dims.icells, dims.ijcells);
+    };
+
+    if(threaded)
+    {
+      ThreadPool &pool = ThreadPool::getInstance();
+      pool.parallelFor(dims.kstart, dims.kend, 1, exec);
+    }
+    else
+      exec(dims.kstart, dims.kend);
+  }
+}
+
+template<class Assign, class Op, typename T, typename C>
+inline void execStencil(T * const out, const T * const * const in, const C * const scale,
+                        const long ni, const long nj, const long nk,
+                        const long outjj, const long outkk, const long injj, const long inkk)
+{
+  static_assert(std::is_same<C, typename ComputeType<T>::type>::value || std::is_same<C, double>::value,
+                "a stencil computes in the ComputeType of the stored type or in double");
+
+  #ifdef SIMDDISPATCH
+  switch(Simd::getInstance().getLevel())
+  {
+    case SimdAVX512: stencilAVX512<Assign, Op>(out, in, scale, ni, nj, nk, outjj, outkk, injj, inkk); return;
+    case SimdAVX2  : stencilAVX2  <Assign, Op>(out, in, scale, ni, nj, nk, outjj, outkk, injj, inkk); return;
+    default        : break;
+  }
+  #endif
+
+  stencilKernel<Assign, Op, C, 1>(out, in, scale, ni, nj, nk, outjj, outkk, injj, inkk);
+}
+
+template<class Assign, class Op, typename T, typename C>
+inline void execStencil(const FieldView<T> &out, const FieldView<const T> * const in,
+                        const C * const scale, const bool threaded)
+{
+  for(int n=0; n<Op::nterms; ++n)
+    if(!out.hasSameShape(in[n]) || in[n].getjj() != in[0].getjj() || in[n].getkk() != in[0].getkk())
+    {
+      Master &master = Master::getInstance();
+      master.printError("ERROR the views of a stencil need the same shape and the inputs the same strides\n");
+      throw 1;
+    }
+
+  auto exec = [&](const long kstart, const long kend)
+  {
+    const T *inptr[Op::nterms];
+    for(int n=0; n<Op::nterms; ++n)
+      inptr[n] = in[n].getData() + kstart*in[n].getkk();
+
+    execStencil<Assign, Op>(out.getData() + kstart*out.getkk(), inptr, scale,
+                            out.getni(), out.getnj(), kend-kstart,
+                            out.getjj(), out.getkk(), in[0].getjj(), in[0].getkk());
+  };
+
+  if(threaded)
+  {
+    ThreadPool &pool = ThreadPool::getInstance();
+    pool.parallelFor(0, out.getnk(), 1, exec);
+  }
+  else
+    exec(0, out.getnk());
+}
+
+// The grid spans the unit cube, see createGrid, so the inverse grid spacing
+// of a direction equals its total number of points.
+template<int order, int dir, class T, class TG>
+inline void gradient(Field<T,TG> &out, const Field<T,TG> &in, const bool threaded)
+{
+  const GridDims &dims = out.getGrid().getDims();
+  const long ntot[3] = {dims.itot, dims.jtot, dims.ktot};
+
+  const Field<T,TG> *fields[1] = {&in};
+  typedef typename ComputeType<T>::type C;
+  const C scale[1] = {static_cast<C>(ntot[dir])};
+
+  typedef StencilOperator<typename FirstDerivative<order,dir>::type> Op;
+  execOperator<StencilSet, Op>(out, fields, scale, threaded);
+}
+
+template<int order, class T, class TG>
+inline void laplacian(Field<T,TG> &out, const Field<T,TG> &in, const bool threaded)
+{
+  const GridDims &dims = out.getGrid().getDims();
+
+  const Field<T,TG> *fields[3] = {&in, &in, &in};
+  typedef typename ComputeType<T>::type C;
+  const C scale[3] = {static_cast<C>(dims.itot*dims.itot),
+                      static_cast<C>(dims.jtot*dims.jtot),
+                      static_cast<C>(dims.ktot*dims.ktot)};
+
+  typedef StencilOperator<typename SecondDerivative<order,0>::type,
+                          typename SecondDerivative<order,1>::type,
+                          typename SecondDerivative<order,2>::type> Op;
+  execOperator<StencilSet, Op>(out, fields, scale, threaded);
+}
+
+template<int order, class T, class TG>
+inline void divergence(Field<T,TG> &out, const Field<T,TG> &u, const Field<T,TG> &v, const Field<T,TG> &w,
+                       const bool threaded)
+{
+  const GridDims &dims = out.getGrid().getDims();
+
+  const Field<T,TG> *fields[3] = {&u, &v, &w};
+  typedef typename ComputeType<T>::type C;
+  const C scale[3] = {static_cast<C>(dims.itot), static_cast<C>(dims.jtot), static_cast<C>(dims.ktot)};
+
+  typedef StencilOperator<typename FirstDerivative<order,0>::type,
+                          typename FirstDerivative<order,1>::type,
+                          typename FirstDerivative<order,2>::type> Op;
+  execOperator<StencilSet, Op>(out, fields, scale, threaded);
+}
+#endif
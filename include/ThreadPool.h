@@ -0,0 +1,312 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREADPOOL
+#define THREADPOOL
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <sstream>
+#include "Master.h"
+
+// Process-wide pool of persistent worker threads that is shared by all
+// kernels. A parallel loop is cut into chunks, every participating thread
+// (the workers plus the calling thread) owns a contiguous range of chunks
+// and threads that run out of work steal chunks from the others.
+class ThreadPool
+{
+  public:
+    static ThreadPool &getInstance();
+
+    int getNumThreads() const { return nthreads; }
+    void setNumThreads(int);
+
+    // Call f(begin, end) on chunks of at most chunk iterations that together
+    // cover [begin, end). A chunk size <= 0 selects a chunk size automatically.
+    template<class F>
+    void parallelFor(long, long, long, F);
+
+    // Reduce f(begin, end) over the chunks of [begin, end) with merge. The
+    // partial results are merged in chunk order, so the result does not
+    // depend on the number of threads.
+    template<class R, class F, class M>
+    R parallelReduce(long, long, long, R, F, M);
+
+  private:
+    ThreadPool();
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop(int, long);
+    void runJob(int);
+    void execJob(long, long, long, const std::function<void(long, long)> &);
+    long getChunkSize(long, long) const;
+
+    // Range of chunk indices owned by a thread, padded to a cache line.
+    struct ChunkRange
+    {
+      std::atomic<long> next;
+      long end;
+      char padding[64 - sizeof(std::atomic<long>) - sizeof(long)];
+    };
+
+    int nthreads;
+    std::vector<std::thread> workers;
+    std::unique_ptr<ChunkRange[]> ranges;
+
+    // The current job.
+    const std::function<void(long, long)> *job;
+    long jobbegin;
+    long jobend;
+    long jobchunk;
+    std::exception_ptr joberror;
+
+    std::mutex execmutex;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    long generation;
+    int nbusy;
+    bool stopping;
+
+    static bool &inParallelRegion();
+};
+
+
+// IMPLEMENTATION BELOW
+inline ThreadPool &ThreadPool::getInstance()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+inline ThreadPool::ThreadPool() :
+  job(0), jobbegin(0), jobend(0), jobchunk(1),
+  generation(0), nbusy(0), stopping(false)
+{
+  nthreads = std::max(1u, std::thread::hardware_concurrency());
+  startWorkers();
+}
+
+inline ThreadPool::~ThreadPool()
+{
+  stopWorkers();
+}
+
+inline bool &ThreadPool::inParallelRegion()
+{
+  static thread_local bool inregion = false;
+  return inregion;
+}
+
+inline void ThreadPool::setNumThreads(const int nthreadsin)
+{
+  std::lock_guard<std::mutex> execlock(execmutex);
+  stopWorkers();
+  nthreads = std::max(1, nthreadsin);
+  startWorkers();
+}
+
+inline void ThreadPool::startWorkers()
+{
+  ranges.reset(new ChunkRange[nthreads]);
+  stopping = false;
+
+  // the calling thread is participant 0, the workers are 1 to nthreads-1
+  for(int n=1; n<nthreads; ++n)
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this, n, generation));
+
+  Master &master = Master::getInstance();
+  std::ostringstream message;
+  message << "Starting ThreadPool with " << nthreads << " thread(s)\n";
+  master.printMessage(message.str());
+}
+
+inline void ThreadPool::stopWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeup.notify_all();
+
+  for(std::thread &t : workers)
+    t.join();
+  workers.clear();
+}
+
+inline void ThreadPool::workerLoop(const int id, long seen)
+{
+  inParallelRegion() = true;
+
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeup.wait(lock, [&]{ return stopping || generation != seen; });
+      if(stopping)
+        return;
+      seen = generation;
+    }
+
+    runJob(id);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --nbusy;
+    }
+    finished.notify_one();
+  }
+}
+
+inline void ThreadPool::runJob(const int id)
+{
+  try
+  {
+    // process the own range first, then steal from the other threads
+    for(int n=0; n<nthreads; ++n)
+    {
+      ChunkRange &range = ranges[(id+n) % nthreads];
+      while(true)
+      {
+        const long chunk = range.next.fetch_add(1);
+        if(chunk >= range.end)
+          break;
+
+        const long begin = jobbegin + chunk*jobchunk;
+        const long end = std::min(begin + jobchunk, jobend);
+        (*job)(begin, end);
+      }
+    }
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!joberror)
+      joberror = std::current_exception();
+  }
+}
+
+inline long ThreadPool::getChunkSize(const long size, const long chunk) const
+{
+  if(chunk > 0)
+    return chunk;
+
+  // aim for a few chunks per thread to balance the load
+  return std::max(1L, size / (4*nthreads));
+}
+
+inline void ThreadPool::execJob(const long begin, const long end, const long chunk,
+                                const std::function<void(long, long)> &f)
+{
+  const long nchunks = (end - begin + chunk - 1) / chunk;
+
+  std::lock_guard<std::mutex> execlock(execmutex);
+
+  job = &f;
+  jobbegin = begin;
+  jobend = end;
+  jobchunk = chunk;
+  joberror = nullptr;
+
+  for(int n=0; n<nthreads; ++n)
+  {
+    ranges[n].next = n*nchunks / nthreads;
+    ranges[n].end  = (n+1)*nchunks / nthreads;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    nbusy = nthreads-1;
+    ++generation;
+  }
+  wakeup.notify_all();
+
+  inParallelRegion() = true;
+  runJob(0);
+  inParallelRegion() = false;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&]{ return nbusy == 0; });
+  job = 0;
+
+  if(joberror)
+    std::rethrow_exception(joberror);
+}
+
+template<class F>
+inline void ThreadPool::parallelFor(const long begin, const long end, const long chunkin, F f)
+{
+  if(end <= begin)
+    return;
+
+  const long chunk = getChunkSize(end-begin, chunkin);
+
+  // run serially if there is nothing to distribute, or if called from within
+  // a parallel region, as the workers are already occupied
+  if(nthreads == 1 || end-begin <= chunk || inParallelRegion())
+  {
+    for(long n=begin; n<end; n+=chunk)
+      f(n, std::min(n+chunk, end));
+    return;
+  }
+
+  const std::function<void(long, long)> func(f);
+  execJob(begin, end, chunk, func);
+}
+
+template<class R, class F, class M>
+inline R ThreadPool::parallelReduce(const long begin, const long end, const long chunkin,
+                                    R init, F f, M merge)
+{
+  if(end <= begin)
+    return init;
+
+  // the automatic chunk size does not depend on the number of threads here
+  const long chunk = chunkin > 0 ? chunkin : std::max(1L, (end-begin) / 64);
+  const long nchunks = (end - begin + chunk - 1) / chunk;
+
+  std::vector<R> partials(nchunks, init);
+  parallelFor(begin, end, chunk, [&](const long b, const long e)
+  {
+    partials[(b-begin) / chunk] = f(b, e);
+  });
+
+  R result = init;
+  for(const R &partial : partials)
+    result = merge(result, partial);
+
+  return result;
+}
+#endif
@@ -0,0 +1,275 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TIMEPARALLEL
+#define TIMEPARALLEL
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include "Master.h"
+#include "ThreadPool.h"
+#include "Application.h"
+
+// Application that applies the same analysis to many snapshots, such as the
+// time steps of a simulation, which are distributed over the processes and
+// the threads rather than decomposing a single snapshot. The processes take
+// batches of snapshots from a counter that they share, so faster processes
+// take more batches, and the snapshots of a batch are distributed over the
+// ThreadPool, in which idle threads steal snapshots from the others. Every
+// snapshot is analysed by a single thread with the reductions of Master
+// restricted to its process, so the analysis works on whole snapshots on a
+// Grid of createLocalGrid. The results of an analysis are a fixed number of
+// values, which are gathered per snapshot and merged in the order of the
+// snapshots with a parallel reduction. The merged results are therefore the
+// same for any number of processes and threads and any distribution of the
+// work.
+class TimeParallelApplication : public Application
+{
+  public:
+    TimeParallelApplication(int, char **, long, int);
+    virtual ~TimeParallelApplication();
+
+    // analyse all snapshots and pass the merged results to finish
+    void exec();
+
+    long getNumSnapshots() const { return nsnapshots; }
+    int getNumResults() const { return nresults; }
+
+    // number of snapshots that this process has analysed in the last exec
+    long getNumAnalyzed() const { return nanalyzed; }
+
+  protected:
+    // Analyse snapshot n and store its results. The threads of a process call
+    // this concurrently, so the analysis has to use its own Fields.
+    virtual void analyze(long, double *) = 0;
+
+    // Merge the results of the snapshots that follow into the first results,
+    // by default they are summed. The threads call this concurrently on
+    // different results.
+    virtual void merge(double *, const double *);
+
+    // the merged results of all snapshots, on every process
+    virtual void finish(const double *) = 0;
+
+  private:
+    const long nsnapshots;
+    const int nresults;
+    long nanalyzed;
+
+    void analyzeBatch(long, long, std::vector<double> &);
+    void sumResults(std::vector<double> &);
+};
+
+
+// IMPLEMENTATION BELOW
+namespace
+{
+  #ifdef USEMPI
+  inline void checkMPIError(const int n, const std::string &name)
+  {
+    if(n != MPI_SUCCESS)
+    {
+      Master &master = Master::getInstance();
+      master.printError("ERROR MPI in " + name + "\n");
+      throw 1;
+    }
+  }
+
+  // Counter of the snapshots that have been handed out, in the memory of
+  // process 0, which the processes increment with atomic remote operations.
+  class SnapshotCounter
+  {
+    public:
+      SnapshotCounter()
+      {
+        Master &master = Master::getInstance();
+        const MPI_Aint size = master.mpiid == 0 ? sizeof(long) : 0;
+        checkMPIError(MPI_Win_allocate(size, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &counter, &window),
+                      "SnapshotCounter");
+
+        if(master.mpiid == 0)
+        {
+          MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, window);
+          *counter = 0;
+          MPI_Win_unlock(0, window);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+      }
+
+      ~SnapshotCounter() { MPI_Win_free(&window); }
+
+      // the first of the next n snapshots
+      long fetch(const long n)
+      {
+        long first;
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, window);
+        checkMPIError(MPI_Fetch_and_op(&n, &first, MPI_LONG, 0, 0, MPI_SUM, window), "SnapshotCounter");
+        MPI_Win_unlock(0, window);
+        return first;
+      }
+
+    private:
+      long *counter;
+      MPI_Win window;
+  };
+  #else
+  class SnapshotCounter
+  {
+    public:
+      SnapshotCounter() : counter(0) {}
+
+      long fetch(const long n)
+      {
+        const long first = counter;
+        counter += n;
+        return first;
+      }
+
+    private:
+      long counter;
+  };
+  #endif
+}
+
+inline TimeParallelApplication::TimeParallelApplication(int argc, char *argv[], const long nsnapshotsin, const int nresultsin)
+  : Application(argc, argv),
+    nsnapshots(nsnapshotsin),
+    nresults(nresultsin),
+    nanalyzed(0)
+{
+  Master &master = Master::getInstance();
+  if(nsnapshots < 1 || nresults < 1)
+  {
+    master.printError("ERROR TimeParallelApplication needs at least one snapshot and one result\n");
+    throw 1;
+  }
+
+  std::ostringstream message;
+  message << "Started TimeParallelApplication with " << nsnapshots << " snapshot(s) on "
+          << master.getNprocs() << " process(es)\n";
+  master.printMessage(message.str());
+}
+
+inline TimeParallelApplication::~TimeParallelApplication()
+{
+  Master &master = Master::getInstance();
+  master.printMessage("Finished TimeParallelApplication\n");
+}
+
+inline void TimeParallelApplication::merge(double *a, const double *b)
+{
+  for(int n=0; n<nresults; ++n)
+    a[n] += b[n];
+}
+
+// Analyse the snapshots [begin, end), one snapshot per chunk of the ThreadPool.
+inline void TimeParallelApplication::analyzeBatch(const long begin, const long end, std::vector<double> &results)
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(begin, end, 1, [&](const long nbegin, const long nend)
+  {
+    for(long n=nbegin; n<nend; ++n)
+    {
+      Master::setLocal(true);
+      try
+      {
+        analyze(n, &results[n*nresults]);
+      }
+      catch (...)
+      {
+        Master::setLocal(false);
+        throw;
+      }
+      Master::setLocal(false);
+    }
+  });
+}
+
+// Every result is set by one process and zero on the others, so the sum
+// gathers the results without rounding errors.
+inline void TimeParallelApplication::sumResults(std::vector<double> &results)
+{
+  Master &master = Master::getInstance();
+  const long blocksize = std::numeric_limits<int>::max();
+  for(long n=0; n<static_cast<long>(results.size()); n+=blocksize)
+    master.sum(&results[n], static_cast<int>(std::min(blocksize, static_cast<long>(results.size())-n)));
+}
+
+inline void TimeParallelApplication::exec()
+{
+  Master &master = Master::getInstance();
+  ThreadPool &pool = ThreadPool::getInstance();
+
+  std::vector<double> results(nsnapshots*nresults, 0.);
+  nanalyzed = 0;
+
+  // A batch holds a few snapshots per thread, such that the threads balance
+  // the load within a batch and the processes balance the load over batches.
+  const long batchsize = 2*pool.getNumThreads();
+  {
+    SnapshotCounter counter;
+    while(true)
+    {
+      const long begin = counter.fetch(batchsize);
+      if(begin >= nsnapshots)
+        break;
+
+      const long end = std::min(begin + batchsize, nsnapshots);
+      analyzeBatch(begin, end, results);
+      nanalyzed += end - begin;
+    }
+  }
+
+  sumResults(results);
+
+  // Merge the results in the order of the snapshots. A partial result is
+  // empty until it has its first snapshot, as merge has no identity.
+  typedef std::vector<double> Result;
+  const Result merged = pool.parallelReduce(0, nsnapshots, 0, Result(),
+    [&](const long begin, const long end)
+    {
+      Result result(&results[begin*nresults], &results[(begin+1)*nresults]);
+      for(long n=begin+1; n<end; ++n)
+        merge(result.data(), &results[n*nresults]);
+      return result;
+    },
+    [&](Result a, const Result &b)
+    {
+      if(a.empty())
+        return b;
+      if(!b.empty())
+        merge(a.data(), b.data());
+      return a;
+    });
+
+  std::ostringstream message;
+  message << "Analysed " << nanalyzed << " of " << nsnapshots << " snapshot(s) on process 0\n";
+  master.printMessage(message.str());
+
+  finish(merged.data());
+}
+#endif
@@ -0,0 +1,490 @@
+/*
+ * BigDataGrid
+ * Copyright (c) 2014-2015 Chiel van Heerwaarden
+ *
+ * Many of the classes and functions in BigDataGrid are derived from
+ * MicroHH (https://github.com/microhh)
+ *
+ * This file is part of BigDataGrid
+ *
+ * BigDataGrid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BigDataGrid is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BigDataGrid.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TIMESERIESFIELD
+#define TIMESERIESFIELD
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "Master.h"
+#include "Grid.h"
+#include "Field.h"
+#include "ThreadPool.h"
+
+// Sliding window of the last time levels of a Field. The levels are kept in
+// a ring of Fields that are allocated once, advancing the window hands out
+// the Field of the oldest level to be filled with the new one, for instance
+// from a file, so the data is neither copied nor reallocated. The mean, the
+// variance and the trend in time of every point are updated with the level
+// that enters and the level that leaves the window (Welford updates in
+// double), the minimum and the maximum are computed from the levels in the
+// window when they are requested. The updates for the levels that leave
+// accumulate rounding errors, so the sums are recomputed from the levels in
+// the window after every capacity levels that have left. All loops cover the
+// whole data of the Fields, including the ghost cells, and are distributed
+// over the ThreadPool.
+template<class T, class TG>
+class TimeSeriesField
+{
+  public:
+    TimeSeriesField(Grid<TG> &, const std::string, int);
+    virtual ~TimeSeriesField();
+
+    TimeSeriesField(const TimeSeriesField &) = delete;
+    TimeSeriesField &operator=(const TimeSeriesField &) = delete;
+
+    // Add a level at a time later than the newest one and return its Field,
+    // which the caller fills. The level is added to the reductions at the next
+    // call to advance or to one of the reductions.
+    Field<T,TG> &advance(double);
+    // advance and copy the Field into the new level
+    void push(const Field<T,TG> &, double);
+
+    // number of levels in the window and the maximum number of levels
+    int getSize() const { return size; }
+    int getCapacity() const { return static_cast<int>(levels.size()); }
+
+    // The level n steps back from the newest one, and its time. A level that
+    // is changed after it has been added to the reductions leaves them wrong
+    // until the next recompute.
+    Field<T,TG> &getLevel(int n=0);
+    double getTime(int n=0) const;
+
+    // recompute the mean, the variance and the trend from the levels in the window
+    void recompute();
+
+    // linear interpolation in time between the levels in the window
+    void interpolate(Field<T,TG> &, double);
+
+    // Reductions in time over the levels in the window, per point. The
+    // variance is that of the population and the trend is the slope of the
+    // least-squares line through the levels, per unit of time.
+    template<class TO> void mean(Field<TO,TG> &);
+    template<class TO> void variance(Field<TO,TG> &);
+    template<class TO> void min(Field<TO,TG> &);
+    template<class TO> void max(Field<TO,TG> &);
+    template<class TO> void trend(Field<TO,TG> &);
+
+  protected:
+    Grid<TG> &grid;
+    std::string name;
+
+  private:
+    typedef typename ComputeType<T>::type C;
+
+    std::vector<std::unique_ptr<Field<T,TG> > > levels;
+    std::vector<double> times;
+    int newest;
+    int size;
+
+    // the newest level has not been added to the reductions yet
+    bool pending;
+    // number of levels removed from the reductions since they were computed
+    int nremoved;
+
+    // mean and sums of squared deviations of the times and the values, and
+    // the sum of the products of the deviations of the times and the values
+    double tmean;
+    double tm2;
+    Field<double,TG> xmean;
+    Field<double,TG> xm2;
+    Field<double,TG> txm2;
+
+    int getIndex(int) const;
+    void addLevel(int, int);
+    void removeLevel(int);
+    void clearReductions();
+    void update();
+    void checkLevel(int) const;
+    template<class TO> void checkOutput(const Field<TO,TG> &) const;
+    template<class F> void forData(F) const;
+    template<class TO, class F> void reduceLevels(Field<TO,TG> &, F);
+};
+
+
+// IMPLEMENTATION BELOW
+template<class T, class TG>
+inline TimeSeriesField<T,TG>::TimeSeriesField(Grid<TG> &gridin, const std::string namein, const int nlevels) :
+  grid(gridin),
+  name(namein),
+  newest(-1),
+  size(0),
+  pending(false),
+  nremoved(0),
+  tmean(0.),
+  tm2(0.),
+  xmean(gridin, namein + " mean"),
+  xm2(gridin, namein + " variance"),
+  txm2(gridin, namein + " trend")
+{
+  Master &master = Master::getInstance();
+  if(nlevels < 1)
+  {
+    master.printError("ERROR TimeSeriesField " + name + " needs at least one level\n");
+    throw 1;
+  }
+
+  for(int n=0; n<nlevels; ++n)
+    levels.emplace_back(new Field<T,TG>(grid, name));
+  times.resize(nlevels);
+
+  std::ostringstream message;
+  message << "Constructed TimeSeriesField " << name << " with " << nlevels << " level(s)\n";
+  master.printMessage(message.str());
+}
+
+template<class T, class TG>
+inline TimeSeriesField<T,TG>::~TimeSeriesField()
+{
+  Master &master = Master::getInstance();
+  master.printMessage("Destructed TimeSeriesField " + name + "\n");
+}
+
+template<class T, class TG>
+inline int TimeSeriesField<T,TG>::getIndex(const int n) const
+{
+  const int nlevels = getCapacity();
+  return (newest - n + nlevels) % nlevels;
+}
+
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::checkLevel(const int n) const
+{
+  if(n < 0 || n >= size)
+  {
+    Master &master = Master::getInstance();
+    std::ostringstream message;
+    message << "ERROR TimeSeriesField " << name << " has no level " << n << "\n";
+    master.printError(message.str());
+    throw 1;
+  }
+}
+
+template<class T, class TG>
+template<class TO>
+inline void TimeSeriesField<T,TG>::checkOutput(const Field<TO,TG> &out) const
+{
+  if(static_cast<long>(out.data.size()) != grid.getncells())
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR Field " + out.getName() + " does not match the shape of TimeSeriesField " + name + "\n");
+    throw 1;
+  }
+}
+
+// Call f(begin, end) for chunks of the data of the Fields.
+template<class T, class TG>
+template<class F>
+inline void TimeSeriesField<T,TG>::forData(F f) const
+{
+  ThreadPool &pool = ThreadPool::getInstance();
+  pool.parallelFor(0, grid.getncells(), fieldchunk, f);
+}
+
+template<class T, class TG>
+inline Field<T,TG> &TimeSeriesField<T,TG>::getLevel(const int n)
+{
+  checkLevel(n);
+  return *levels[getIndex(n)];
+}
+
+template<class T, class TG>
+inline double TimeSeriesField<T,TG>::getTime(const int n) const
+{
+  checkLevel(n);
+  return times[getIndex(n)];
+}
+
+template<class T, class TG>
+inline Field<T,TG> &TimeSeriesField<T,TG>::advance(const double time)
+{
+  if(size > 0 && !(time > times[newest]))
+  {
+    Master &master = Master::getInstance();
+    master.printError("ERROR the levels of TimeSeriesField " + name + " have to advance in time\n");
+    throw 1;
+  }
+
+  update();
+
+  // the oldest level leaves the window before its Field is handed out
+  if(size == getCapacity())
+  {
+    removeLevel(getIndex(size-1));
+    ++nremoved;
+  }
+
+  newest = (newest + 1) % getCapacity();
+  times[newest] = time;
+  ++size;
+  pending = true;
+
+  return *levels[newest];
+}
+
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::push(const Field<T,TG> &field, const double time)
+{
+  checkOutput(field);
+  advance(time) = field;
+}
+
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::update()
+{
+  if(nremoved >= getCapacity())
+    recompute();
+  else if(pending)
+    addLevel(newest, size);
+  pending = false;
+}
+
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::recompute()
+{
+  clearReductions();
+  for(int n=size-1; n>=0; --n)
+    addLevel(getIndex(n), size-n);
+
+  pending = false;
+  nremoved = 0;
+}
+
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::clearReductions()
+{
+  tmean = 0.;
+  tm2 = 0.;
+
+  double *mean = xmean.data.data();
+  double *m2 = xm2.data.data();
+  double *txm = txm2.data.data();
+  forData([=](const long begin, const long end)
+  {
+    std::fill(mean+begin, mean+end, 0.);
+    std::fill(m2+begin, m2+end, 0.);
+    std::fill(txm+begin, txm+end, 0.);
+  });
+}
+
+// Welford update with the level at index, which makes count levels.
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::addLevel(const int index, const int count)
+{
+  const double n = count;
+  const double dt = times[index] - tmean;
+  tmean += dt / n;
+  tm2 += dt*(times[index] - tmean);
+
+  const T *x = levels[index]->data.data();
+  double *mean = xmean.data.data();
+  double *m2 = xm2.data.data();
+  double *txm = txm2.data.data();
+  forData([=](const long begin, const long end)
+  {
+    for(long i=begin; i<end; ++i)
+    {
+      const double xi = static_cast<C>(x[i]);
+      const double dx = xi - mean[i];
+      mean[i] += dx / n;
+      m2[i] += dx*(xi - mean[i]);
+      txm[i] += dt*(xi - mean[i]);
+    }
+  });
+}
+
+// Reverse of the Welford update for a level that leaves the window.
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::removeLevel(const int index)
+{
+  const double n = size;
+  --size;
+
+  if(size == 0)
+  {
+    clearReductions();
+    return;
+  }
+
+  const double time = times[index];
+  const double tmeanold = tmean - (time - tmean) / (n-1.);
+  const double dt = time - tmeanold;
+  tm2 -= dt*(time - tmean);
+  tmean = tmeanold;
+
+  const T *x = levels[index]->data.data();
+  double *mean = xmean.data.data();
+  double *m2 = xm2.data.data();
+  double *txm = txm2.data.data();
+  forData([=](const long begin, const long end)
+  {
+    for(long i=begin; i<end; ++i)
+    {
+      const double xi = static_cast<C>(x[i]);
+      const double meanold = mean[i] - (xi - mean[i]) / (n-1.);
+      m2[i] -= (xi - meanold)*(xi - mean[i]);
+      txm[i] -= dt*(xi - mean[i]);
+      mean[i] = meanold;
+    }
+  });
+}
+
+template<class T, class TG>
+inline void TimeSeriesField<T,TG>::interpolate(Field<T,TG> &out, const double time)
+{
+  checkOutput(out);
+  if(size == 0 || time < times[getIndex(size-1)] || time > times[newest])
+  {
+    Master &master = Master::getInstance();
+    std::ostringstream message;
+    message << "ERROR time " << time << " is outside the levels of TimeSeriesField " << name << "\n";
+    master.printError(message.str());
+    throw 1;
+  }
+
+  // the level at or after the time and the one before it
+  int n = 0;
+  while(n < size-1 && times[getIndex(n+1)] >= time)
+    ++n;
+
+  if(n == size-1 || times[getIndex(n)] == time)
+  {
+    out = *levels[getIndex(n)];
+    return;
+  }
+
+  const double t0 = times[getIndex(n+1)];
+  const double t1 = times[getIndex(n)];
+  const C w = static_cast<C>((time - t0) / (t1 - t0));
+  const T *x0 = levels[getIndex(n+1)]->data.data();
+  const T *x1 = levels[getIndex(n)]->data.data();
+  T *outptr = out.data.data();
+  forData([=](const long begin, const long end)
+  {
+    for(long i=begin; i<end; ++i)
+    {
+      const C a = x0[i];
+      const C b = x1[i];
+      outptr[i] = a + w*(b - a);
+    }
+  });
+}
+
+// out = f(r, x) for the values x of every level after the first, with r the
+// value of the first level, per point in blocks of fieldchunk points.
+template<class T, class TG>
+template<class TO, class F>
+inline void TimeSeriesField<T,TG>::reduceLevels(Field<TO,TG> &out, F f)
+{
+  checkOutput(out);
+  checkLevel(0);
+
+  std::vector<const T *> x(size);
+  for(int n=0; n<size; ++n)
+    x[n] = levels[getIndex(n)]->data.data();
+
+  TO *outptr = out.data.data();
+  forData([&](const long begin, const long end)
+  {
+    std::vector<C> r(x[0]+begin, x[0]+end);
+    for(int n=1; n<size; ++n)
+      for(long i=begin; i<end; ++i)
+        r[i-begin] = f(r[i-begin], static_cast<C>(x[n][i]));
+
+    for(long i=begin; i<end; ++i)
+      outptr[i] = static_cast<TO>(r[i-begin]);
+  });
+}
+
+template<class T, class TG>
+template<class TO>
+inline void TimeSeriesField<T,TG>::mean(Field<TO,TG> &out)
+{
+  checkOutput(out);
+  checkLevel(0);
+  update();
+
+  const double *mean = xmean.data.data();
+  TO *outptr = out.data.data();
+  forData([=](const long begin, const long end)
+  {
+    for(long i=begin; i<end; ++i)
+      outptr[i] = static_cast<TO>(mean[i]);
+  });
+}
+
+template<class T, class TG>
+template<class TO>
+inline void TimeSeriesField<T,TG>::variance(Field<TO,TG> &out)
+{
+  checkOutput(out);
+  checkLevel(0);
+  update();
+
+  const double n = size;
+  const double *m2 = xm2.data.data();
+  TO *outptr = out.data.data();
+  forData([=](const long begin, const long end)
+  {
+    for(long i=begin; i<end; ++i)
+      outptr[i] = static_cast<TO>(std::max(m2[i], 0.) / n);
+  });
+}
+
+template<class T, class TG>
+template<class TO>
+inline void TimeSeriesField<T,TG>::trend(Field<TO,TG> &out)
+{
+  checkOutput(out);
+  checkLevel(0);
+  update();
+
+  // a single level has no trend
+  const double tm2inv = tm2 > 0. ? 1./tm2 : 0.;
+  const double *txm = txm2.data.data();
+  TO *outptr = out.data.data();
+  forData([=](const long begin, const long end)
+  {
+    for(long i=begin; i<end; ++i)
+      outptr[i] = static_cast<TO>(txm[i]*tm2inv);
+  });
+}
+
+template<class T, class TG>
+template<class TO>
+inline void TimeSeriesField<T,TG>::min(Field<TO,TG> &out)
+{
+  reduceLevels(out, [](const C a, const C b) { return std::min(a, b); });
+}
+
+template<class T, class TG>
+template<class TO>
+inline void TimeSeriesField<T,TG>::max(Field<TO,TG> &out)
+{
+  reduceLevels(out, [](const C a, const C b) { return std::max(a, b); });
+}
+#endif